@@ -6,3 +6,16 @@
 function(kdeconnect_add_plugin)
     kcoreaddons_add_plugin(${ARGN} INSTALL_NAMESPACE kdeconnect)
 endfunction()
+
+# Embeds the D-Bus interface declared in a plugin's header into the plugin, so a plugin
+# that sets X-KdeConnect-LoadOnDemand can be introspected before it is created
+function(kdeconnect_add_dbus_introspection sources_var plugin_name header)
+    set(xml_file ${CMAKE_CURRENT_BINARY_DIR}/${plugin_name}.xml)
+    # Same contents the plugin is registered with, see Device::loadPendingPlugin
+    qt5_generate_dbus_interface(${header} ${xml_file} OPTIONS -P -s -m)
+
+    set(qrc_file ${CMAKE_CURRENT_BINARY_DIR}/${plugin_name}_dbus.qrc)
+    file(WRITE ${qrc_file} "<RCC><qresource prefix=\"/kdeconnect/dbus\"><file alias=\"${plugin_name}.xml\">${xml_file}</file></qresource></RCC>\n")
+    qt5_add_resources(${sources_var} ${qrc_file})
+    set(${sources_var} ${${sources_var}} PARENT_SCOPE)
+endfunction()
@@ -74,6 +74,7 @@ int main(int argc, char** argv)
     parser.addOption(QCommandLineOption(QStringList{QStringLiteral("k"), QStringLiteral("send-keys")}, i18n("Sends keys to a said device"), QStringLiteral("key")));
     parser.addOption(QCommandLineOption(QStringLiteral("my-id"), i18n("Display this device's id and exit")));
     parser.addOption(QCommandLineOption(QStringLiteral("photo"), i18n("Open the connected device's camera and transfer the photo")));
+    parser.addOption(QCommandLineOption(QStringLiteral("stats"), i18n("Display how many packets of each type every device and plugin handled, and how long it took, and how many TLS handshakes were resumed")));
 
     //Hidden because it's an implementation detail
     QCommandLineOption deviceAutocomplete(QStringLiteral("shell-device-autocompletion"));
@@ -92,6 +93,9 @@ int main(int argc, char** argv)
 
     if (parser.isSet(QStringLiteral("my-id"))) {
         QTextStream(stdout) << iface.selfId() << endl;
+    } else if (parser.isSet(QStringLiteral("stats"))) {
+        QTextStream(stdout) << blockOnReply<QString>(iface.packetStats());
+        QTextStream(stdout) << blockOnReply<QString>(iface.tlsStats());
     } else if (parser.isSet(QStringLiteral("l")) || parser.isSet(QStringLiteral("a"))) {
         bool reachable = false;
         if (parser.isSet(QStringLiteral("a"))) {
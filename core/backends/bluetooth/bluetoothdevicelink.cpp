@@ -55,7 +55,7 @@ bool BluetoothDeviceLink::sendPacket(NetworkPacket& np)
         np.setPayloadTransferInfo(uploadJob->transferInfo());
         uploadJob->start();
     }
-    int written = mSocketReader->write(np.serialize());
+    int written = mSocketReader->write(serializePacket(np));
     return (written != -1);
 }
 
@@ -80,7 +80,7 @@ void BluetoothDeviceLink::dataReceived()
     //qCDebug(KDECONNECT_CORE) << "BluetoothDeviceLink dataReceived" << packet;
 
     NetworkPacket packet((QString()));
-    NetworkPacket::unserialize(serializedPacket, &packet);
+    unserializePacket(serializedPacket, &packet);
 
     if (packet.type() == PACKET_TYPE_PAIR) {
         //TODO: Handle pair/unpair requests and forward them (to the pairing handler?)
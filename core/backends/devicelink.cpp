@@ -21,23 +21,45 @@
 #include "devicelink.h"
 #include "kdeconnectconfig.h"
 #include "linkprovider.h"
+#include "packetmetrics.h"
 
 DeviceLink::DeviceLink(const QString& deviceId, LinkProvider* parent)
     : QObject(parent)
     , m_deviceId(deviceId)
     , m_linkProvider(parent)
     , m_pairStatus(NotPaired)
+    , m_metrics(PacketMetrics::untrustedDevices())
 {
     Q_ASSERT(!deviceId.isEmpty());
 
     setProperty("deviceId", deviceId);
+
+    //Reserving marks the capacity as reserved, so resize(0) in NetworkPacket::serialize keeps it
+    m_sendBuffer.reserve(4096);
 }
 
 void DeviceLink::setPairStatus(DeviceLink::PairStatus status)
 {
+    //Anyone on the network can open links, so only paired devices are counted on their own
+    m_metrics = (status == Paired) ? PacketMetrics::device(m_deviceId) : PacketMetrics::untrustedDevices();
     if (m_pairStatus != status) {
         m_pairStatus = status;
         Q_EMIT pairStatusChanged(status);
     }
 }
 
+const QByteArray& DeviceLink::serializePacket(const NetworkPacket& np)
+{
+    np.serialize(&m_sendBuffer);
+    m_metrics->packetSent(np.typeId(), m_sendBuffer.size() + qMax<qint64>(np.payloadSize(), 0));
+    return m_sendBuffer;
+}
+
+bool DeviceLink::unserializePacket(const QByteArray& data, NetworkPacket* np)
+{
+    if (!NetworkPacket::unserialize(data, np, m_metrics)) {
+        return false;
+    }
+    m_metrics->packetReceived(np->typeId(), data.size() + qMax<qint64>(np->payloadSize(), 0));
+    return true;
+}
@@ -22,9 +22,11 @@
 #define DEVICELINK_H
 
 #include <QObject>
+#include <QVector>
 
 #include "networkpacket.h"
 
+class PacketMetrics;
 class PairingHandler;
 class NetworkPacket;
 class LinkProvider;
@@ -64,11 +66,21 @@ Q_SIGNALS:
     void pairStatusChanged(DeviceLink::PairStatus status);
     void pairingError(const QString& error);
     void receivedPacket(const NetworkPacket& np);
+    void receivedPackets(const QVector<NetworkPacket>& packets); //Several packets that arrived together, in order
+
+protected:
+    //Serializes the packet into a buffer owned by this link, so sending doesn't reallocate for every packet.
+    //The returned reference is only valid until the next call.
+    const QByteArray& serializePacket(const NetworkPacket& np);
+    //Counts the packet for this device in PacketMetrics, see NetworkPacket::unserialize
+    bool unserializePacket(const QByteArray& data, NetworkPacket* np);
 
 private:
     const QString m_deviceId;
     LinkProvider* m_linkProvider;
     PairStatus m_pairStatus;
+    QByteArray m_sendBuffer;
+    PacketMetrics* m_metrics;
 
 };
 
@@ -29,18 +29,15 @@
 
 CompositeUploadJob::CompositeUploadJob(const QString& deviceId, bool displayNotification) 
     : KCompositeJob()
-    , m_server(new Server(this))
-    , m_socket(nullptr)
-    , m_port(0)
+    , m_parallelUploads(1)
     , m_deviceId(deviceId)
     , m_running(false)
-    , m_currentJobNum(1)
+    , m_currentJobNum(0)
     , m_totalJobs(0)
-    , m_currentJobSendPayloadSize(0)
     , m_totalSendPayloadSize(0)
     , m_totalPayloadSize(0)
-    , m_currentJob(nullptr)
     , m_prevElapsedTime(0)
+    , m_prevUploaded(0)
     , m_updatePacketPending(false)
 {
     setCapabilities(Killable);
@@ -55,6 +52,11 @@ bool CompositeUploadJob::isRunning()
     return m_running;
 }
 
+void CompositeUploadJob::setParallelUploads(int parallelUploads)
+{
+    m_parallelUploads = qBound(1, parallelUploads, MAX_PORT - MIN_PORT + 1);
+}
+
 void CompositeUploadJob::start() {
     if (m_running) {
         qCWarning(KDECONNECT_CORE) << "CompositeUploadJob::start() - already running";
@@ -71,53 +73,94 @@ void CompositeUploadJob::start() {
         return;
     }
     
-    connect(m_server, &QTcpServer::newConnection, this, &CompositeUploadJob::newConnection);
-    
     m_running = true;
  
     //Give SharePlugin some time to add subjobs
-    QMetaObject::invokeMethod(this, "startNextSubJob", Qt::QueuedConnection);
+    QMetaObject::invokeMethod(this, "startNextSubJobs", Qt::QueuedConnection);
 }
 
 bool CompositeUploadJob::startListening()
 {
-    m_port = MIN_PORT;
-    while (!m_server->listen(QHostAddress::Any, m_port)) {
-        m_port++;
-        if (m_port > MAX_PORT) { //No ports available?
-            qCWarning(KDECONNECT_CORE) << "CompositeUploadJob::startListening() - Error opening a port in range" << MIN_PORT << "-" << MAX_PORT;
-            m_port = 0;
-            setError(NoPortAvailable);
-            setErrorText(i18n("Couldn't find an available port"));
-            emitResult();
-            return false;
+    //Every parallel upload gets a port of its own, so the receiver's connection tells us which file it wants
+    quint16 port = MIN_PORT;
+    while (m_slots.size() < m_parallelUploads) {
+        Server* server = new Server(this);
+        while (port <= MAX_PORT && !server->listen(QHostAddress::Any, port)) {
+            port++;
+        }
+        if (port > MAX_PORT) {
+            delete server;
+            break;
         }
+
+        server->pauseAccepting();
+        connect(server, &QTcpServer::newConnection, this, &CompositeUploadJob::newConnection);
+        m_slots.append({server, port, nullptr, nullptr});
+        qCDebug(KDECONNECT_CORE) << "CompositeUploadJob::startListening() - listening on port: " << port;
+        port++;
+    }
+
+    if (m_slots.isEmpty()) { //No ports available?
+        qCWarning(KDECONNECT_CORE) << "CompositeUploadJob::startListening() - Error opening a port in range" << MIN_PORT << "-" << MAX_PORT;
+        setError(NoPortAvailable);
+        setErrorText(i18n("Couldn't find an available port"));
+        emitResult();
+        return false;
     }
     
-    qCDebug(KDECONNECT_CORE) << "CompositeUploadJob::startListening() - listening on port: " << m_port;
     return true;
 }
 
-void CompositeUploadJob::startNextSubJob()
+int CompositeUploadJob::slotOf(const QObject* object) const
+{
+    for (int i = 0; i < m_slots.size(); i++) {
+        const UploadSlot& slot = m_slots.at(i);
+        if (slot.server == object || (slot.job && (slot.job == object || slot.socket == object))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void CompositeUploadJob::startNextSubJobs()
+{
+    for (int i = 0; i < m_slots.size() && m_running && !m_pendingJobs.isEmpty(); i++) {
+        if (!m_slots.at(i).job) {
+            startSubJob(i);
+        }
+    }
+}
+
+void CompositeUploadJob::startSubJob(int slot)
 {
-    m_currentJob = qobject_cast<UploadJob*>(subjobs().at(0));
-    m_currentJobSendPayloadSize = 0;
-    emitDescription(m_currentJob->getNetworkPacket().get<QString>(QStringLiteral("filename")));
+    UploadJob* job = m_pendingJobs.dequeue();
+    m_slots[slot].job = job;
+    m_jobProgress.insert(job, 0);
+    m_currentJobNum++;
+    emitDescription(job->getNetworkPacket().get<QString>(QStringLiteral("filename")));
 
-    connect(m_currentJob, SIGNAL(processedAmount(KJob*,KJob::Unit,qulonglong)), this, SLOT(slotProcessedAmount(KJob*,KJob::Unit,qulonglong)));
+    connect(job, SIGNAL(processedAmount(KJob*,KJob::Unit,qulonglong)), this, SLOT(slotProcessedAmount(KJob*,KJob::Unit,qulonglong)));
     //Already done by KCompositeJob
-    //connect(m_currentJob, &KJob::result, this, &CompositeUploadJob::slotResult);
+    //connect(job, &KJob::result, this, &CompositeUploadJob::slotResult);
     
-    //TODO: Create a copy of the networkpacket that can be re-injected if sending via lan fails?
-    NetworkPacket np = m_currentJob->getNetworkPacket();
+    NetworkPacket np = job->getNetworkPacket();
     np.setPayload(nullptr, np.payloadSize());
-    np.setPayloadTransferInfo({{QStringLiteral("port"), m_port}});
+    QVariantMap transferInfo = {{QStringLiteral("port"), m_slots.at(slot).port}};
+    if (job->isResumable()) {
+        transferInfo.insert(QStringLiteral("resumable"), true);
+    }
+    if (job->sendsDigest()) {
+        transferInfo.insert(QStringLiteral("digest"), QStringLiteral("sha256"));
+    }
+    np.setPayloadTransferInfo(transferInfo);
     np.set<int>(QStringLiteral("numberOfFiles"), m_totalJobs);
     np.set<quint64>(QStringLiteral("totalPayloadSize"), m_totalPayloadSize);
     
     if (Daemon::instance()->getDevice(m_deviceId)->sendPacket(np)) {
-        m_server->resumeAccepting();
+        m_slots.at(slot).server->resumeAccepting();
     } else {
+        m_running = false;
+        abortUploads();
         setError(SendingNetworkPacketFailed);
         setErrorText(i18n("Failed to send packet to %1", Daemon::instance()->getDevice(m_deviceId)->name()));
 
@@ -127,52 +170,83 @@ void CompositeUploadJob::startNextSubJob()
 
 void CompositeUploadJob::newConnection()
 {
-    m_server->pauseAccepting();
+    Server* server = qobject_cast<Server*>(sender());
+    server->pauseAccepting();
     
-    m_socket = m_server->nextPendingConnection();
+    QSslSocket* socket = server->nextPendingConnection();
     
-    if (!m_socket) {
-        qCDebug(KDECONNECT_CORE) << "CompositeUploadJob::newConnection() - m_server->nextPendingConnection() returned a nullptr";
+    if (!socket) {
+        qCDebug(KDECONNECT_CORE) << "CompositeUploadJob::newConnection() - server->nextPendingConnection() returned a nullptr";
+        return;
+    }
+
+    const int slot = slotOf(server);
+    if (slot < 0 || !m_slots.at(slot).job) {
+        qCDebug(KDECONNECT_CORE) << "CompositeUploadJob::newConnection() - no upload waiting for this connection";
+        socket->deleteLater();
         return;
     }
     
-    m_currentJob->setSocket(m_socket);
+    m_slots[slot].socket = socket;
+    m_slots.at(slot).job->setSocket(socket);
     
-    connect(m_socket, &QSslSocket::disconnected, this, &CompositeUploadJob::socketDisconnected);
-    connect(m_socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::error), this, &CompositeUploadJob::socketError);
-    connect(m_socket, QOverload<const QList<QSslError> &>::of(&QSslSocket::sslErrors), this, &CompositeUploadJob::sslError);
-    connect(m_socket, &QSslSocket::encrypted, this, &CompositeUploadJob::encrypted);
+    connect(socket, &QSslSocket::disconnected, this, &CompositeUploadJob::socketDisconnected);
+    connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::error), this, &CompositeUploadJob::socketError);
+    connect(socket, QOverload<const QList<QSslError> &>::of(&QSslSocket::sslErrors), this, &CompositeUploadJob::sslError);
+    connect(socket, &QSslSocket::encrypted, this, &CompositeUploadJob::encrypted);
     
-    LanLinkProvider::configureSslSocket(m_socket, m_deviceId, true);
+    LanLinkProvider::configureSslSocket(socket, m_deviceId, true);
 
-    m_socket->startServerEncryption();
+    socket->startServerEncryption();
 }
 
 void CompositeUploadJob::socketDisconnected()
 {
-    m_socket->close();
+    qobject_cast<QSslSocket*>(sender())->close();
 }
 
 void CompositeUploadJob::socketError(QAbstractSocket::SocketError error)
 {
     Q_UNUSED(error);
+
+    const int slot = slotOf(sender());
+    if (m_running && slot >= 0 && m_slots.at(slot).job->isResumable()) {
+        //Hand what is left to the link provider, it sends it again if the device comes back
+        //and the receiver asks only for the part it doesn't have yet
+        const QList<KJob*> jobs = subjobs();
+        for (KJob* job : jobs) {
+            Q_EMIT uploadInterrupted(qobject_cast<UploadJob*>(job)->getNetworkPacket());
+        }
+    }
+    m_running = false;
+    abortUploads();
     
     //Do not close the socket because when android closes the socket (share is cancelled) closing the socket leads to a cyclic socketError and eventually a segv
     setError(SocketError);
     emitResult();
-
-    m_running = false;
 }
 
 void CompositeUploadJob::sslError(const QList<QSslError>& errors)
 {
     Q_UNUSED(errors);
     
-    m_socket->close();
+    qobject_cast<QSslSocket*>(sender())->close();
+    m_running = false;
+    abortUploads();
     setError(SslError);
     emitResult();
+}
 
-    m_running = false;
+void CompositeUploadJob::abortUploads()
+{
+    //Called once m_running is false, so the results of the stopped jobs are ignored
+    Q_ASSERT(!m_running);
+    const QVector<UploadSlot> uploadSlots = m_slots;
+    for (const UploadSlot& slot : uploadSlots) {
+        if (slot.job && slot.socket) {
+            slot.job->stop();
+        }
+    }
 }
 
 void CompositeUploadJob::encrypted()
@@ -180,8 +254,11 @@ void CompositeUploadJob::encrypted()
     if (!m_timer.isValid()) {
         m_timer.start();
     }
-    
-    m_currentJob->start();
+
+    const int slot = slotOf(sender());
+    if (slot >= 0) {
+        m_slots.at(slot).job->start();
+    }
 }
 
 bool CompositeUploadJob::addSubjob(KJob* job)
@@ -196,21 +273,19 @@ bool CompositeUploadJob::addSubjob(KJob* job)
             setTotalAmount(Bytes, m_totalPayloadSize);
         }
         
-        QString filename;
-        QString filenameArg = QStringLiteral("filename");
-        
-        if (m_currentJob) {
-            filename = m_currentJob->getNetworkPacket().get<QString>(filenameArg);
-        } else {
-            filename = np.get<QString>(filenameArg);
+        if (m_currentJobNum == 0) {
+            emitDescription(np.get<QString>(QStringLiteral("filename")));
         }
-        
-        emitDescription(filename);
 
-        if (m_running && m_currentJob && !m_updatePacketPending) {
+        if (m_running && m_currentJobNum > 0 && !m_updatePacketPending) {
             m_updatePacketPending = true;
             QMetaObject::invokeMethod(this, "sendUpdatePacket", Qt::QueuedConnection);
         }
+
+        m_pendingJobs.enqueue(uploadJob);
+        if (m_running) {
+            QMetaObject::invokeMethod(this, "startNextSubJobs", Qt::QueuedConnection);
+        }
         
         return KCompositeJob::addSubjob(job);
     } else {
@@ -229,31 +304,50 @@ void CompositeUploadJob::sendUpdatePacket() {
     m_updatePacketPending = false;
 }
 
+void CompositeUploadJob::sendDigestPacket(UploadJob* job, quint16 port)
+{
+    //Sent before the next file is announced on the same port, so the receiver can match it by port
+    NetworkPacket np(PACKET_TYPE_SHARE_REQUEST_UPDATE);
+    np.set<int>(QStringLiteral("numberOfFiles"), m_totalJobs);
+    np.set<quint64>(QStringLiteral("totalPayloadSize"), m_totalPayloadSize);
+    np.set<int>(QStringLiteral("port"), port);
+    np.set(QStringLiteral("sha256"), QString::fromLatin1(job->digest()));
+
+    Daemon::instance()->getDevice(m_deviceId)->sendPacket(np);
+}
+
 bool CompositeUploadJob::doKill()
 {
     if (m_running) {
         m_running = false;
-        
-        return m_currentJob->stop();
+        abortUploads();
     }
     
     return true;
 }
 
 void CompositeUploadJob::slotProcessedAmount(KJob *job, KJob::Unit unit, qulonglong amount) {
-    Q_UNUSED(job);
-    
-    m_currentJobSendPayloadSize = amount;
-    quint64 uploaded = m_totalSendPayloadSize + m_currentJobSendPayloadSize;
+    m_jobProgress[job] = amount;
+
+    quint64 uploaded = m_totalSendPayloadSize;
+    for (quint64 jobUploaded : qAsConst(m_jobProgress)) {
+        uploaded += jobUploaded;
+    }
     
-    if (uploaded == m_totalPayloadSize || m_prevElapsedTime == 0 || m_timer.elapsed() - m_prevElapsedTime >= 100) {
-        m_prevElapsedTime = m_timer.elapsed();
+    const quint64 elapsed = m_timer.elapsed();
+    if (uploaded == m_totalPayloadSize || m_prevElapsedTime == 0 || elapsed - m_prevElapsedTime >= 100) {
         setProcessedAmount(unit, uploaded);
-    
-        const auto elapsed = m_timer.elapsed();
-        if (elapsed > 0) {
+
+        //Report the throughput since the last update rather than the average since the
+        //start, which also counts the time spent waiting for the other end to connect
+        if (m_prevElapsedTime > 0 && elapsed > m_prevElapsedTime && uploaded >= m_prevUploaded) {
+            emitSpeed((1000 * (uploaded - m_prevUploaded)) / (elapsed - m_prevElapsedTime));
+        } else if (elapsed > 0) {
             emitSpeed((1000 * uploaded) / elapsed);
         }
+
+        m_prevElapsedTime = elapsed;
+        m_prevUploaded = uploaded;
     }
 }
 
@@ -265,12 +359,25 @@ void CompositeUploadJob::slotResult(KJob *job) {
         return;
     }
     
-    m_totalSendPayloadSize += m_currentJobSendPayloadSize;
+    m_totalSendPayloadSize += m_jobProgress.take(job);
+
+    const int slot = slotOf(job);
+    if (slot < 0) {
+        return;
+    }
+
+    UploadJob* uploadJob = m_slots.at(slot).job;
+    if (uploadJob->sendsDigest()) {
+        sendDigestPacket(uploadJob, m_slots.at(slot).port);
+    }
+
+    //The socket belongs to the finished job
+    m_slots[slot].job = nullptr;
+    m_slots[slot].socket = nullptr;
     
-    if (hasSubjobs()) {
-        m_currentJobNum++;
-        startNextSubJob();
-    } else {
+    if (!m_pendingJobs.isEmpty()) {
+        startSubJob(slot);
+    } else if (!hasSubjobs()) {
         QPair<QString, QString> field2;
         field2.first = QStringLiteral("Files");
         field2.second = i18np("Sent 1 file", "Sent %1 files", m_totalJobs);
@@ -286,7 +393,7 @@ void CompositeUploadJob::emitDescription(const QString& currentFileName) {
     
     if (m_totalJobs > 1) {
         field2.first = i18n("Progress");
-        field2.second = i18n("Sending file %1 of %2", m_currentJobNum, m_totalJobs);
+        field2.second = i18n("Sending file %1 of %2", qMax(m_currentJobNum, 1), m_totalJobs);
     }
     
     Q_EMIT description(this, i18n("Sending to %1", Daemon::instance()->getDevice(this->m_deviceId)->name()), 
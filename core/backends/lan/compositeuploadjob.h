@@ -23,6 +23,9 @@
 
 #include "kdeconnectcore_export.h"
 #include <KCompositeJob>
+#include <QHash>
+#include <QQueue>
+#include <QVector>
 #include "server.h"
 #include "uploadjob.h"
 
@@ -38,10 +41,20 @@ public:
     QVariantMap transferInfo();
     bool isRunning();
     bool addSubjob(KJob* job) override;
+    //How many files are sent at the same time, each through its own port and TLS connection
+    void setParallelUploads(int parallelUploads);
+
+Q_SIGNALS:
+    //Emitted for every file not sent completely when a resumable upload loses its connection
+    void uploadInterrupted(const NetworkPacket& np);
     
 private:
     bool startListening();
+    void startSubJob(int slot);
+    int slotOf(const QObject* object) const;
+    void abortUploads();
     void emitDescription(const QString& currentFileName);
+    void sendDigestPacket(UploadJob* job, quint16 port);
     
 protected:
     bool doKill() override;
@@ -53,20 +66,28 @@ private:
         SocketError,
         SslError
     };
+
+    //A port with the upload currently going through it, if any
+    struct UploadSlot {
+        Server* server;
+        quint16 port;
+        UploadJob* job;
+        QSslSocket* socket;
+    };
     
-    Server *const m_server;
-    QSslSocket *m_socket;
-    quint16 m_port;
+    QVector<UploadSlot> m_slots;
+    QQueue<UploadJob*> m_pendingJobs;
+    QHash<KJob*, quint64> m_jobProgress;
+    int m_parallelUploads;
     const QString& m_deviceId;
     bool m_running;
     int m_currentJobNum;
     int m_totalJobs;
-    quint64 m_currentJobSendPayloadSize;
     quint64 m_totalSendPayloadSize;
     quint64 m_totalPayloadSize;
-    UploadJob *m_currentJob;
     QElapsedTimer m_timer;
     quint64 m_prevElapsedTime;
+    quint64 m_prevUploaded;
     bool m_updatePacketPending;
 
     const static quint16 MIN_PORT = 1739;
@@ -80,7 +101,7 @@ private Q_SLOTS:
     void encrypted();
     void slotProcessedAmount(KJob *job, KJob::Unit unit, qulonglong amount);
     void slotResult(KJob *job) override;
-    void startNextSubJob();
+    void startNextSubJobs();
     void sendUpdatePacket();
 };
 
@@ -23,6 +23,7 @@
 #include <KLocalizedString>
 
 #include "core_debug.h"
+#include "connectionmultiplexer.h"
 #include "kdeconnectconfig.h"
 #include "backends/linkprovider.h"
 #include "socketlinereader.h"
@@ -32,12 +33,20 @@
 LanDeviceLink::LanDeviceLink(const QString& deviceId, LinkProvider* parent, QSslSocket* socket, ConnectionStarted connectionSource)
     : DeviceLink(deviceId, parent)
     , m_socketLineReader(nullptr)
+    , m_multiplexer(nullptr)
+    , m_resumablePayloads(false)
+    , m_payloadDigests(false)
+    , m_parallelPayloads(false)
 {
     reset(socket, connectionSource);
 }
 
 void LanDeviceLink::reset(QSslSocket* socket, ConnectionStarted connectionSource)
 {
+    //The new connection negotiates multiplexing again
+    delete m_multiplexer;
+    m_multiplexer = nullptr;
+
     if (m_socketLineReader) {
         disconnect(m_socketLineReader->m_socket, &QAbstractSocket::disconnected, this, &QObject::deleteLater);
         delete m_socketLineReader;
@@ -60,6 +69,23 @@ void LanDeviceLink::reset(QSslSocket* socket, ConnectionStarted connectionSource
     DeviceLink::setPairStatus(certString.isEmpty()? PairStatus::NotPaired : PairStatus::Paired);
 }
 
+void LanDeviceLink::setMultiplexed(bool multiplexed)
+{
+    if (multiplexed == (m_multiplexer != nullptr)) {
+        return;
+    }
+
+    if (multiplexed) {
+        //Both ends switch right after the identity packets, before anything else is sent
+        m_multiplexer = new ConnectionMultiplexer(m_socketLineReader->m_socket, this);
+        m_socketLineReader->setDevice(m_multiplexer->defaultChannel());
+    } else {
+        m_socketLineReader->setDevice(m_socketLineReader->m_socket);
+        delete m_multiplexer;
+        m_multiplexer = nullptr;
+    }
+}
+
 QHostAddress LanDeviceLink::hostAddress() const
 {
     if (!m_socketLineReader) {
@@ -85,12 +111,32 @@ QString LanDeviceLink::name()
 bool LanDeviceLink::sendPacket(NetworkPacket& np)
 {
     if (np.payload()) {
+        //Shared files keep their own connection, they need resuming, digests and progress
+        if (m_multiplexer && np.type() != PACKET_TYPE_SHARE_REQUEST
+                && np.payloadSize() >= 0 && np.payloadSize() <= MAX_MULTIPLEXED_PAYLOAD
+                && !np.payload()->isSequential()) {
+            return sendMultiplexedPayload(np);
+        }
+
         if (np.type() == PACKET_TYPE_SHARE_REQUEST && np.payloadSize() >= 0) {
             if (!m_compositeUploadJob || !m_compositeUploadJob->isRunning()) {
                 m_compositeUploadJob = new CompositeUploadJob(deviceId(), true);
+                if (m_parallelPayloads) {
+                    m_compositeUploadJob->setParallelUploads(KdeConnectConfig::instance()->parallelUploads());
+                }
+                if (m_resumablePayloads) {
+                    LanLinkProvider* linkProvider = qobject_cast<LanLinkProvider*>(provider());
+                    const QString id = deviceId();
+                    connect(m_compositeUploadJob.data(), &CompositeUploadJob::uploadInterrupted, linkProvider, [linkProvider, id](const NetworkPacket& np) {
+                        linkProvider->uploadInterrupted(id, np);
+                    });
+                }
             }
-        
-            m_compositeUploadJob->addSubjob(new UploadJob(np));
+
+            UploadJob* uploadJob = new UploadJob(np);
+            uploadJob->setResumable(m_resumablePayloads);
+            uploadJob->setSendsDigest(m_payloadDigests);
+            m_compositeUploadJob->addSubjob(uploadJob);
     
             if (!m_compositeUploadJob->isRunning()) {
                 m_compositeUploadJob->start();
@@ -103,7 +149,7 @@ bool LanDeviceLink::sendPacket(NetworkPacket& np)
         
         return true;
     } else {
-        int written = m_socketLineReader->write(np.serialize());
+        int written = m_socketLineReader->write(serializePacket(np));
 
         //Actually we can't detect if a packet is received or not. We keep TCP
         //"ESTABLISHED" connections that look legit (return true when we use them),
@@ -112,46 +158,94 @@ bool LanDeviceLink::sendPacket(NetworkPacket& np)
     }
 }
 
-void LanDeviceLink::dataReceived()
+bool LanDeviceLink::sendMultiplexedPayload(NetworkPacket& np)
 {
-    if (m_socketLineReader->bytesAvailable() == 0) return;
+    const QSharedPointer<QIODevice> payload = np.payload();
+    if (!payload->isOpen() && !payload->open(QIODevice::ReadOnly)) {
+        qCWarning(KDECONNECT_CORE) << "Could not open payload of" << np.type() << payload->errorString();
+        return false;
+    }
+    const QByteArray data = payload->readAll();
+    payload->close();
+
+    //The packet goes first, so the other end knows the channel when the data arrives
+    const QUuid id = m_multiplexer->newChannel();
+    QVariantMap transferInfo;
+    transferInfo.insert(QStringLiteral("channel"), id.toString());
+    np.setPayloadTransferInfo(transferInfo);
+    if (m_socketLineReader->write(serializePacket(np)) == -1) {
+        return false;
+    }
 
-    const QByteArray serializedPacket = m_socketLineReader->readLine();
-    NetworkPacket packet((QString()));
-    NetworkPacket::unserialize(serializedPacket, &packet);
+    //Closing only ends the channel once everything written was sent
+    MultiplexChannel* channel = m_multiplexer->takeChannel(id);
+    channel->write(data);
+    channel->close();
+    channel->deleteLater();
+    return true;
+}
 
-    //qCDebug(KDECONNECT_CORE) << "LanDeviceLink dataReceived" << serializedPacket;
+void LanDeviceLink::dataReceived()
+{
+    //Decode every line the reader has and deliver them all at once,
+    //instead of going back to the event loop for each packet
+    QVector<NetworkPacket> packets;
+    packets.reserve(static_cast<int>(m_socketLineReader->bytesAvailable()));
+
+    while (m_socketLineReader->bytesAvailable() > 0) {
+        const QByteArray serializedPacket = m_socketLineReader->readLine();
+        NetworkPacket packet((QString()));
+        unserializePacket(serializedPacket, &packet);
+
+        //qCDebug(KDECONNECT_CORE) << "LanDeviceLink dataReceived" << serializedPacket;
+
+        if (packet.type() == PACKET_TYPE_PAIR) {
+            //Whatever arrived before the pairing packet is delivered first
+            if (!packets.isEmpty()) {
+                Q_EMIT receivedPackets(packets);
+                packets.clear();
+            }
+            //TODO: Handle pair/unpair requests and forward them (to the pairing handler?)
+            qobject_cast<LanLinkProvider*>(provider())->incomingPairPacket(this, packet);
+            continue;
+        }
 
-    if (packet.type() == PACKET_TYPE_PAIR) {
-        //TODO: Handle pair/unpair requests and forward them (to the pairing handler?)
-        qobject_cast<LanLinkProvider*>(provider())->incomingPairPacket(this, packet);
-        return;
-    }
+        if (packet.hasPayloadTransferInfo()) {
+            //qCDebug(KDECONNECT_CORE) << "HasPayloadTransferInfo";
+            const QVariantMap transferInfo = packet.payloadTransferInfo();
+
+            if (transferInfo.contains(QStringLiteral("channel"))) {
+                const QUuid id(transferInfo[QStringLiteral("channel")].toString());
+                MultiplexChannel* channel = m_multiplexer ? m_multiplexer->takeChannel(id) : nullptr;
+                if (!channel) {
+                    qCWarning(KDECONNECT_CORE) << "Payload of" << packet.type() << "is on an unknown channel" << id;
+                    continue;
+                }
+                packet.setPayload(QSharedPointer<QIODevice>(channel), packet.payloadSize());
+                packets.append(packet);
+                continue;
+            }
 
-    if (packet.hasPayloadTransferInfo()) {
-        //qCDebug(KDECONNECT_CORE) << "HasPayloadTransferInfo";
-        const QVariantMap transferInfo = packet.payloadTransferInfo();
+            QSharedPointer<QSslSocket> socket(new QSslSocket);
 
-        QSharedPointer<QSslSocket> socket(new QSslSocket);
+            LanLinkProvider::configureSslSocket(socket.data(), deviceId(), true);
 
-        LanLinkProvider::configureSslSocket(socket.data(), deviceId(), true);
+            // emit readChannelFinished when the socket gets disconnected. This seems to be a bug in upstream QSslSocket.
+            // Needs investigation and upstreaming of the fix. QTBUG-62257
+            connect(socket.data(), &QAbstractSocket::disconnected, socket.data(), &QAbstractSocket::readChannelFinished);
 
-        // emit readChannelFinished when the socket gets disconnected. This seems to be a bug in upstream QSslSocket.
-        // Needs investigation and upstreaming of the fix. QTBUG-62257
-        connect(socket.data(), &QAbstractSocket::disconnected, socket.data(), &QAbstractSocket::readChannelFinished);
+            const QString address = m_socketLineReader->peerAddress().toString();
+            const quint16 port = transferInfo[QStringLiteral("port")].toInt();
+            socket->connectToHostEncrypted(address, port, QIODevice::ReadWrite);
+            packet.setPayload(socket, packet.payloadSize());
+        }
 
-        const QString address = m_socketLineReader->peerAddress().toString();
-        const quint16 port = transferInfo[QStringLiteral("port")].toInt();
-        socket->connectToHostEncrypted(address, port, QIODevice::ReadWrite);
-        packet.setPayload(socket, packet.payloadSize());
+        packets.append(packet);
     }
 
-    Q_EMIT receivedPacket(packet);
-
-    if (m_socketLineReader->bytesAvailable() > 0) {
-        QMetaObject::invokeMethod(this, "dataReceived", Qt::QueuedConnection);
+    if (!packets.isEmpty()) {
+        Q_EMIT receivedPackets(packets);
     }
-
 }
 
 void LanDeviceLink::userRequestsPair()
@@ -177,7 +271,7 @@ void LanDeviceLink::setPairStatus(PairStatus status)
 
     DeviceLink::setPairStatus(status);
     if (status == Paired) {
-        Q_ASSERT(KdeConnectConfig::instance()->trustedDevices().contains(deviceId()));
+        Q_ASSERT(KdeConnectConfig::instance()->isTrustedDevice(deviceId()));
         Q_ASSERT(!m_socketLineReader->peerCertificate().isNull());
         KdeConnectConfig::instance()->setDeviceProperty(deviceId(), QStringLiteral("certificate"), QString::fromLatin1(m_socketLineReader->peerCertificate().toPem().data()));
     }
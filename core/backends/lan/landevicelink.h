@@ -33,6 +33,7 @@
 #include "compositeuploadjob.h"
 
 class SocketLineReader;
+class ConnectionMultiplexer;
 
 class KDECONNECTCORE_EXPORT LanDeviceLink
     : public DeviceLink
@@ -57,14 +58,32 @@ public:
 
     QHostAddress hostAddress() const;
 
+    //Whether the other end can tell us where to resume an interrupted payload from
+    void setResumablePayloads(bool resumable) { m_resumablePayloads = resumable; }
+    //Whether the other end checks the digest sent after each shared file
+    void setPayloadDigests(bool payloadDigests) { m_payloadDigests = payloadDigests; }
+    //Whether the other end accepts several shared files at once, otherwise they are sent one by one
+    void setParallelPayloads(bool parallelPayloads) { m_parallelPayloads = parallelPayloads; }
+    //Whether packets and small payloads share the connection, see ConnectionMultiplexer
+    void setMultiplexed(bool multiplexed);
+
 private Q_SLOTS:
     void dataReceived();
 
 private:
+    bool sendMultiplexedPayload(NetworkPacket& np);
+
     SocketLineReader* m_socketLineReader;
+    ConnectionMultiplexer* m_multiplexer;
     ConnectionStarted m_connectionSource;
     QHostAddress m_hostAddress;
     QPointer<CompositeUploadJob> m_compositeUploadJob;
+    bool m_resumablePayloads;
+    bool m_payloadDigests;
+    bool m_parallelPayloads;
+
+    //Bigger payloads get their own connection, so they don't hold up packets
+    const static qint64 MAX_MULTIPLEXED_PAYLOAD = 1024 * 1024;
 };
 
 #endif
@@ -41,6 +41,7 @@
 #include "daemon.h"
 #include "landevicelink.h"
 #include "lanpairinghandler.h"
+#include "tlssessioncache.h"
 #include "kdeconnectconfig.h"
 
 #define MIN_VERSION_WITH_SSL_SUPPORT 6
@@ -59,6 +60,9 @@ LanLinkProvider::LanLinkProvider(
     , m_combineBroadcastsTimer(this)
 {
 
+    m_interruptedUploadsTimer.setSingleShot(true);
+    connect(&m_interruptedUploadsTimer, &QTimer::timeout, this, &LanLinkProvider::expireInterruptedUploads);
+
     m_combineBroadcastsTimer.setInterval(0); // increase this if waiting a single event-loop iteration is not enough
     m_combineBroadcastsTimer.setSingleShot(true);
     connect(&m_combineBroadcastsTimer, &QTimer::timeout, this, &LanLinkProvider::broadcastToNetwork);
@@ -119,6 +123,19 @@ void LanLinkProvider::onStart()
     qCDebug(KDECONNECT_CORE) << "LanLinkProvider started";
 }
 
+void LanLinkProvider::createIdentityPacket(NetworkPacket* np)
+{
+    NetworkPacket::createIdentityPacket(np);
+    //We tell the sender where to resume interrupted payloads from, see UploadJob
+    np->set(QStringLiteral("resumablePayloads"), true);
+    //and we check the digest it sends after each shared file, see FileTransferJob
+    np->set(QStringLiteral("payloadDigests"), true);
+    //and small payloads can be sent on the link itself, see ConnectionMultiplexer
+    np->set(QStringLiteral("multiplexedPayloads"), true);
+    //and several shared files can be received at once, see CompositeUploadJob
+    np->set(QStringLiteral("parallelPayloads"), true);
+}
+
 void LanLinkProvider::onStop()
 {
     m_udpSocket.close();
@@ -151,7 +168,7 @@ void LanLinkProvider::broadcastToNetwork()
     QHostAddress destAddress = m_testMode? QHostAddress::LocalHost : QHostAddress(QStringLiteral("255.255.255.255"));
 
     NetworkPacket np(QLatin1String(""));
-    NetworkPacket::createIdentityPacket(&np);
+    createIdentityPacket(&np);
     np.set(QStringLiteral("tcpPort"), m_tcpPort);
 
 #ifdef Q_OS_WIN
@@ -240,7 +257,7 @@ void LanLinkProvider::connectError(QAbstractSocket::SocketError socketError)
     qCDebug(KDECONNECT_CORE) << "Socket error" << socketError;
     qCDebug(KDECONNECT_CORE) << "Fallback (1), try reverse connection (send udp packet)" << socket->errorString();
     NetworkPacket np(QLatin1String(""));
-    NetworkPacket::createIdentityPacket(&np);
+    createIdentityPacket(&np);
     np.set(QStringLiteral("tcpPort"), m_tcpPort);
     m_udpSocket.writeDatagram(np.serialize(), m_receivedIdentityPackets[socket].sender, m_udpBroadcastPort);
 
@@ -270,7 +287,7 @@ void LanLinkProvider::tcpSocketConnected()
 
     // If network is on ssl, do not believe when they are connected, believe when handshake is completed
     NetworkPacket np2(QLatin1String(""));
-    NetworkPacket::createIdentityPacket(&np2);
+    createIdentityPacket(&np2);
     socket->write(np2.serialize());
     bool success = socket->waitForBytesWritten();
 
@@ -281,7 +298,7 @@ void LanLinkProvider::tcpSocketConnected()
         // if ssl supported
         if (receivedPacket->get<int>(QStringLiteral("protocolVersion")) >= MIN_VERSION_WITH_SSL_SUPPORT) {
 
-            bool isDeviceTrusted = KdeConnectConfig::instance()->trustedDevices().contains(deviceId);
+            bool isDeviceTrusted = KdeConnectConfig::instance()->isTrustedDevice(deviceId);
             configureSslSocket(socket, deviceId, isDeviceTrusted);
 
             qCDebug(KDECONNECT_CORE) << "Starting server ssl (I'm the client TCP socket)";
@@ -403,7 +420,7 @@ void LanLinkProvider::dataReceived()
 
     if (np->get<int>(QStringLiteral("protocolVersion")) >= MIN_VERSION_WITH_SSL_SUPPORT) {
 
-        bool isDeviceTrusted = KdeConnectConfig::instance()->trustedDevices().contains(deviceId);
+        bool isDeviceTrusted = KdeConnectConfig::instance()->isTrustedDevice(deviceId);
         configureSslSocket(socket, deviceId, isDeviceTrusted);
 
         qCDebug(KDECONNECT_CORE) << "Starting client ssl (but I'm the server TCP socket)";
@@ -432,6 +449,15 @@ void LanLinkProvider::deviceLinkDestroyed(QObject* destroyedDeviceLink)
     if (linkIterator != m_links.end()) {
         Q_ASSERT(linkIterator.value() == destroyedDeviceLink);
         m_links.erase(linkIterator);
+        //The data socket usually fails before keepalive notices the link is gone
+        //From now on the device has MAX_LINK_LOSS_DELAY to come back before they expire
+        for (auto it = m_interruptedUploads.find(id); it != m_interruptedUploads.end() && it.key() == id; ++it) {
+            if (it->interrupted.elapsed() < MAX_LINK_LOSS_DELAY) {
+                it->linkLost = true;
+                it->interrupted.restart();
+            }
+        }
+        expireInterruptedUploads();
         auto pairingHandler = m_pairingHandlers.take(id);
         if (pairingHandler) {
             pairingHandler->deleteLater();
@@ -461,8 +487,11 @@ void LanLinkProvider::configureSslSocket(QSslSocket* socket, const QString& devi
         QString certString = KdeConnectConfig::instance()->getDeviceProperty(deviceId, QStringLiteral("certificate"), QString());
         socket->addCaCertificate(QSslCertificate(certString.toLatin1()));
         socket->setPeerVerifyMode(QSslSocket::VerifyPeer);
+        //Payload sockets and reconnections resume the last session instead of a full handshake
+        TlsSessionCache::instance()->attach(socket, deviceId);
     } else {
         socket->setPeerVerifyMode(QSslSocket::QueryPeer);
+        TlsSessionCache::instance()->remove(deviceId);
     }
 
     //Usually SSL errors are only bad for trusted devices. Uncomment this section to log errors in any case, for debugging.
@@ -523,7 +552,58 @@ void LanLinkProvider::addLink(const QString& deviceId, QSslSocket* socket, Netwo
             m_pairingHandlers[deviceId]->setDeviceLink(deviceLink);
         }
     }
+    deviceLink->setResumablePayloads(receivedPacket->get<bool>(QStringLiteral("resumablePayloads")));
+    deviceLink->setPayloadDigests(receivedPacket->get<bool>(QStringLiteral("payloadDigests")));
+    deviceLink->setMultiplexed(receivedPacket->get<bool>(QStringLiteral("multiplexedPayloads")));
+    deviceLink->setParallelPayloads(receivedPacket->get<bool>(QStringLiteral("parallelPayloads")));
     Q_EMIT onConnectionReceived(*receivedPacket, deviceLink);
+
+    //Send again what was being uploaded when the previous connection was lost, the receiver
+    //will ask for the missing range only
+    const QList<InterruptedUpload> interruptedUploads = m_interruptedUploads.values(deviceId);
+    m_interruptedUploads.remove(deviceId);
+    for (InterruptedUpload upload : interruptedUploads) {
+        if (upload.linkLost) {
+            qCDebug(KDECONNECT_CORE) << "Resuming upload of" << upload.np.get<QString>(QStringLiteral("filename")) << "to" << deviceId;
+            deviceLink->sendPacket(upload.np);
+        } else if (upload.np.payload()) {
+            upload.np.payload()->close();
+        }
+    }
+    expireInterruptedUploads();
+}
+
+void LanLinkProvider::uploadInterrupted(const QString& deviceId, const NetworkPacket& np)
+{
+    InterruptedUpload upload{np, QElapsedTimer(), !m_links.contains(deviceId)};
+    upload.interrupted.start();
+    m_interruptedUploads.insert(deviceId, upload);
+    expireInterruptedUploads();
+}
+
+void LanLinkProvider::expireInterruptedUploads()
+{
+    //Each entry keeps its payload open, don't hold on to the ones the device didn't come back for in time
+    qint64 nextExpiry = -1;
+    for (auto it = m_interruptedUploads.begin(); it != m_interruptedUploads.end();) {
+        const qint64 remaining = MAX_LINK_LOSS_DELAY - it->interrupted.elapsed();
+        if (remaining <= 0) {
+            qCDebug(KDECONNECT_CORE) << "Giving up on resuming" << it->np.get<QString>(QStringLiteral("filename")) << "to" << it.key();
+            if (it->np.payload()) {
+                it->np.payload()->close();
+            }
+            it = m_interruptedUploads.erase(it);
+        } else {
+            nextExpiry = (nextExpiry < 0) ? remaining : qMin(nextExpiry, remaining);
+            ++it;
+        }
+    }
+
+    if (nextExpiry < 0) {
+        m_interruptedUploadsTimer.stop();
+    } else {
+        m_interruptedUploadsTimer.start(static_cast<int>(nextExpiry));
+    }
 }
 
 LanPairingHandler* LanLinkProvider::createPairingHandler(DeviceLink* link)
@@ -546,6 +626,7 @@ void LanLinkProvider::userRequestsPair(const QString& deviceId)
 
 void LanLinkProvider::userRequestsUnpair(const QString& deviceId)
 {
+    TlsSessionCache::instance()->remove(deviceId);
     LanPairingHandler* ph = createPairingHandler(m_links.value(deviceId));
     ph->unpair();
 }
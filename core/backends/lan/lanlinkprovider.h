@@ -26,6 +26,7 @@
 #include <QSslSocket>
 #include <QUdpSocket>
 #include <QTimer>
+#include <QElapsedTimer>
 #include <QNetworkSession>
 
 #include "kdeconnectcore_export.h"
@@ -62,6 +63,9 @@ public:
     static void configureSslSocket(QSslSocket* socket, const QString& deviceId, bool isDeviceTrusted);
     static void configureSocket(QSslSocket* socket);
 
+    //An upload that was interrupted and will be sent again if the device reconnects
+    void uploadInterrupted(const QString& deviceId, const NetworkPacket& np);
+
     /**
      * This is the default UDP port both for broadcasting and receiving identity packets
      */
@@ -84,9 +88,11 @@ private Q_SLOTS:
     void deviceLinkDestroyed(QObject* destroyedDeviceLink);
     void sslErrors(const QList<QSslError>& errors);
     void broadcastToNetwork();
+    void expireInterruptedUploads();
 
 private:
     LanPairingHandler* createPairingHandler(DeviceLink* link);
+    void createIdentityPacket(NetworkPacket* np);
 
     void onNetworkConfigurationChanged(const QNetworkConfiguration& config);
     void addLink(const QString& deviceId, QSslSocket* socket, NetworkPacket* receivedPacket, LanDeviceLink::ConnectionStarted connectionOrigin);
@@ -106,6 +112,16 @@ private:
         QHostAddress sender;
     };
     QMap<QSslSocket*, PendingConnect> m_receivedIdentityPackets;
+
+    struct InterruptedUpload {
+        NetworkPacket np;
+        QElapsedTimer interrupted; //Restarted when the link is lost, entries expire MAX_LINK_LOSS_DELAY after it
+        bool linkLost; //Only uploads cut by a lost connection are resumed, not the ones cancelled by the receiver
+    };
+    QMultiMap<QString, InterruptedUpload> m_interruptedUploads;
+    QTimer m_interruptedUploadsTimer;
+    //Keepalive takes up to 25 seconds to drop a dead link, see configureSocket()
+    const static qint64 MAX_LINK_LOSS_DELAY = 30 * 1000;
     QNetworkConfiguration m_lastConfig;
     const bool m_testMode;
     QTimer m_combineBroadcastsTimer;
@@ -21,33 +21,92 @@
 
 #include "socketlinereader.h"
 
+#include <cstring>
+
 SocketLineReader::SocketLineReader(QSslSocket* socket, QObject* parent)
     : QObject(parent)
     , m_socket(socket)
+    , m_device(socket)
+    , m_end(0)
+    , m_lineStart(0)
+{
+    connect(m_device, &QIODevice::readyRead,
+            this, &SocketLineReader::dataReceived);
+}
+
+void SocketLineReader::setDevice(QIODevice* device)
 {
-    connect(m_socket, &QIODevice::readyRead,
+    disconnect(m_device, &QIODevice::readyRead,
+               this, &SocketLineReader::dataReceived);
+    m_device = device;
+    connect(m_device, &QIODevice::readyRead,
             this, &SocketLineReader::dataReceived);
+
+    if (m_device->bytesAvailable() > 0) {
+        dataReceived();
+    }
+}
+
+QByteArray SocketLineReader::readLine()
+{
+    const QPair<int, int> line = m_lines.dequeue();
+    return m_buffer.mid(line.first, line.second);
+}
+
+void SocketLineReader::compact()
+{
+    //Move the data that hasn't been read yet to the front of the buffer, so
+    //lines never wrap around and can always be copied out as a single block.
+    const int begin = m_lines.isEmpty() ? m_lineStart : m_lines.head().first;
+    if (begin == 0) {
+        return;
+    }
+
+    const int pending = m_end - begin;
+    if (pending > 0) {
+        memmove(m_buffer.data(), m_buffer.constData() + begin, pending);
+    }
+    for (QPair<int, int>& line : m_lines) {
+        line.first -= begin;
+    }
+    m_lineStart -= begin;
+    m_end = pending;
 }
 
 void SocketLineReader::dataReceived()
 {
-    while (m_socket->canReadLine()) {
-        const QByteArray line = m_socket->readLine();
-        if (line.length() > 1) { //we don't want a single \n
-            m_packets.enqueue(line);
+    compact();
+
+    //Read everything the device has in one go. This way we don't depend on
+    //readyRead being emitted again for data that was left in the device.
+    const int scanFrom = m_end;
+    qint64 available;
+    while ((available = m_device->bytesAvailable()) > 0) {
+        if (m_end + available > m_buffer.size()) {
+            m_buffer.resize(static_cast<int>(qMax<qint64>(m_buffer.size() * 2, m_end + available)));
+        }
+        const qint64 read = m_device->read(m_buffer.data() + m_end, m_buffer.size() - m_end);
+        if (read <= 0) {
+            break;
         }
+        m_end += read;
     }
 
-    //If we still have things to read from the socket, call dataReceived again
-    //We do this manually because we do not trust readyRead to be emitted again
-    //So we call this method again just in case.
-    if (m_socket->bytesAvailable() > 0) {
-        QMetaObject::invokeMethod(this, "dataReceived", Qt::QueuedConnection);
-        return;
+    //Only the new data needs to be scanned for newlines, memchr is vectorized by the libc
+    const char* data = m_buffer.constData();
+    const char* newline;
+    int scanPos = scanFrom;
+    while ((newline = static_cast<const char*>(memchr(data + scanPos, '\n', m_end - scanPos)))) {
+        const int lineEnd = newline - data + 1;
+        if (lineEnd - m_lineStart > 1) { //we don't want a single \n
+            m_lines.enqueue(qMakePair(m_lineStart, lineEnd - m_lineStart));
+        }
+        m_lineStart = lineEnd;
+        scanPos = lineEnd;
     }
 
     //If we have any packets, tell it to the world.
-    if (!m_packets.isEmpty()) {
+    if (!m_lines.isEmpty()) {
         Q_EMIT readyRead();
     }
 }
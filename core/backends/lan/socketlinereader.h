@@ -22,6 +22,7 @@
 #define SOCKETLINEREADER_H
 
 #include <QObject>
+#include <QPair>
 #include <QQueue>
 #include <QSslSocket>
 #include <QHostAddress>
@@ -31,6 +32,9 @@
 /*
  * Encapsulates a QTcpSocket and implements the same methods of its API that are
  * used by LanDeviceLink, but readyRead is emitted only when a newline is found.
+ *
+ * Everything the socket has is read into a single buffer that is reused between
+ * reads, and readLine() returns each complete line as its own copy.
  */
 class KDECONNECTCORE_EXPORT SocketLineReader
     : public QObject
@@ -40,11 +44,15 @@ class KDECONNECTCORE_EXPORT SocketLineReader
 public:
     explicit SocketLineReader(QSslSocket* socket, QObject* parent = nullptr);
 
-    QByteArray readLine() { return m_packets.dequeue(); }
-    qint64 write(const QByteArray& data) { return m_socket->write(data); }
+    QByteArray readLine();
+    qint64 write(const QByteArray& data) { return m_device->write(data); }
     QHostAddress peerAddress() const { return m_socket->peerAddress(); }
     QSslCertificate peerCertificate() const { return m_socket->peerCertificate(); }
-    qint64 bytesAvailable() const { return m_packets.size(); }
+    qint64 bytesAvailable() const { return m_lines.size(); }
+
+    //Reads and writes lines through device instead of the socket, which is
+    //still used for the peer's address and certificate
+    void setDevice(QIODevice* device);
 
     QSslSocket* m_socket;
     
@@ -55,8 +63,13 @@ private Q_SLOTS:
     void dataReceived();
 
 private:
-    QByteArray m_lastChunk;
-    QQueue<QByteArray> m_packets;
+    void compact();
+
+    QIODevice* m_device;
+    QByteArray m_buffer;
+    int m_end; //End of the data read from the socket
+    int m_lineStart; //Start of the line still being received
+    QQueue<QPair<int, int>> m_lines; //Offset and length of the complete lines not read yet
 
 };
 
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "tlssessioncache.h"
+
+#include <QSslConfiguration>
+#include <QSslSocket>
+
+#include "core_debug.h"
+
+TlsSessionCache* TlsSessionCache::instance()
+{
+    static TlsSessionCache* s_instance = new TlsSessionCache();
+    return s_instance;
+}
+
+TlsSessionCache::TlsSessionCache()
+    : m_fullHandshakes(0)
+    , m_resumedHandshakes(0)
+{
+}
+
+void TlsSessionCache::attach(QSslSocket* socket, const QString& deviceId)
+{
+    //Qt only hands out the session if it is allowed to keep it
+    QSslConfiguration config = socket->sslConfiguration();
+    config.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+    socket->setSslConfiguration(config);
+
+    //The mode is only known once the socket starts encrypting, before the handshake begins
+    QObject::connect(socket, &QSslSocket::modeChanged, socket, [this, socket, deviceId](QSslSocket::SslMode mode) {
+        QByteArray offeredSession;
+        if (mode == QSslSocket::SslClientMode) {
+            offeredSession = m_sessions.value(deviceId);
+            if (!offeredSession.isEmpty()) {
+                QSslConfiguration config = socket->sslConfiguration();
+                config.setSessionTicket(offeredSession);
+                socket->setSslConfiguration(config);
+            }
+        }
+
+        QObject::connect(socket, &QSslSocket::encrypted, socket, [this, socket, deviceId, offeredSession] {
+            handshakeDone(socket, deviceId, offeredSession);
+        });
+    });
+
+    //A session that led to errors isn't offered again
+    QObject::connect(socket, QOverload<const QList<QSslError>&>::of(&QSslSocket::sslErrors), socket, [this, deviceId] {
+        remove(deviceId);
+    });
+}
+
+void TlsSessionCache::handshakeDone(QSslSocket* socket, const QString& deviceId, const QByteArray& offeredSession)
+{
+    if (socket->mode() != QSslSocket::SslClientMode) {
+        m_fullHandshakes++;
+        return;
+    }
+
+    //Qt doesn't say whether the session was resumed, so this is an estimate: a resumed session is
+    //the one we offered, unless the server renewed its ticket, which then counts as a full handshake
+    const QByteArray session = socket->sslConfiguration().sessionTicket();
+    if (!offeredSession.isEmpty() && session == offeredSession) {
+        m_resumedHandshakes++;
+    } else {
+        m_fullHandshakes++;
+    }
+
+    if (!session.isEmpty()) {
+        m_sessions.insert(deviceId, session);
+    }
+
+    qCDebug(KDECONNECT_CORE) << "TLS handshakes with resumed sessions (estimated):" << m_resumedHandshakes << "full:" << m_fullHandshakes;
+}
+
+QString TlsSessionCache::report() const
+{
+    return QStringLiteral("#handshakes\tfull\tresumed(estimated)\tcachedSessions\n")
+        + QStringLiteral("tls\t%1\t%2\t%3\n").arg(m_fullHandshakes).arg(m_resumedHandshakes).arg(m_sessions.size());
+}
+
+void TlsSessionCache::remove(const QString& deviceId)
+{
+    m_sessions.remove(deviceId);
+}
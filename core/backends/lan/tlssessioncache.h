@@ -0,0 +1,72 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TLSSESSIONCACHE_H
+#define TLSSESSIONCACHE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+#include "kdeconnectcore_export.h"
+
+class QSslSocket;
+
+/**
+ * @short Remembers the last TLS session of every device, so new sockets can resume it
+ *
+ * Payload sockets and reconnections are short lived and would otherwise go through a
+ * full handshake each time. Sockets registered with attach() offer the cached session
+ * when they start as clients and store the one they end up with once encrypted.
+ *
+ * Qt doesn't let server sockets share their context, so only client sockets can resume.
+ * Server handshakes are still counted, as full ones.
+ *
+ * Qt 5 doesn't tell whether a handshake resumed the session, so resumedHandshakes() is
+ * an estimate: a client handshake counts as resumed when it ends with the very session it
+ * offered. A server that resumes but issues a new ticket (always the case with TLS 1.3)
+ * is counted as a full handshake, so the estimate errs on the low side.
+ */
+class KDECONNECTCORE_EXPORT TlsSessionCache
+{
+public:
+    static TlsSessionCache* instance();
+
+    void attach(QSslSocket* socket, const QString& deviceId);
+    void remove(const QString& deviceId);
+
+    quint64 fullHandshakes() const { return m_fullHandshakes; }
+    //Estimated, see above
+    quint64 resumedHandshakes() const { return m_resumedHandshakes; }
+
+    //Tab separated counters, shown by Daemon::tlsStats() and kdeconnect-cli --stats
+    QString report() const;
+
+private:
+    TlsSessionCache();
+
+    void handshakeDone(QSslSocket* socket, const QString& deviceId, const QByteArray& offeredSession);
+
+    QHash<QString, QByteArray> m_sessions;
+    quint64 m_fullHandshakes;
+    quint64 m_resumedHandshakes;
+};
+
+#endif
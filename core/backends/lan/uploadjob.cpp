@@ -22,6 +22,9 @@
 
 #include <KLocalizedString>
 
+#include <QJsonDocument>
+#include <QJsonObject>
+
 #include "lanlinkprovider.h"
 #include "kdeconnectconfig.h"
 #include "core_debug.h"
@@ -32,6 +35,11 @@ UploadJob::UploadJob(const NetworkPacket& networkPacket)
     , m_networkPacket(networkPacket)
     , m_input(networkPacket.payload())
     , m_socket(nullptr)
+    , bytesQueued(0)
+    , bytesUploaded(0)
+    , m_resumable(false)
+    , m_sendsDigest(false)
+    , m_hash(QCryptographicHash::Sha256)
 {
 }
 
@@ -43,7 +51,9 @@ void UploadJob::setSocket(QSslSocket* socket)
 
 void UploadJob::start()
 {
-     if (!m_input->open(QIODevice::ReadOnly)) {
+    //A payload that is sent again after an interruption may still be open.
+    //Chunks are read into m_buffer, a buffer in the device would only add another copy
+    if (!m_input->isOpen() && !m_input->open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
         qCWarning(KDECONNECT_CORE) << "error when opening the input to upload";
         return; //TODO: Handle error, clean up...
     }
@@ -54,44 +64,142 @@ void UploadJob::start()
     }
 
     connect(m_input.data(), &QIODevice::aboutToClose, this, &UploadJob::aboutToClose);
-    
-    bytesUploaded = 0;
+
+    if (m_resumable) {
+        connect(m_socket, &QIODevice::readyRead, this, &UploadJob::readResumeOffset);
+        readResumeOffset();
+    } else {
+        startUpload(0);
+    }
+}
+
+void UploadJob::readResumeOffset()
+{
+    if (!m_socket->canReadLine()) {
+        return;
+    }
+    disconnect(m_socket, &QIODevice::readyRead, this, &UploadJob::readResumeOffset);
+
+    const QJsonObject reply = QJsonDocument::fromJson(m_socket->readLine()).object();
+    qint64 offset = static_cast<qint64>(reply.value(QStringLiteral("resumeOffset")).toDouble());
+    if (offset < 0 || offset > m_input->size()) {
+        qCWarning(KDECONNECT_CORE) << "Invalid resume offset" << offset << "for" << m_networkPacket.get<QString>(QStringLiteral("filename"));
+        offset = 0;
+    }
+    if (offset > 0) {
+        qCDebug(KDECONNECT_CORE) << "Resuming upload of" << m_networkPacket.get<QString>(QStringLiteral("filename")) << "from" << offset;
+    }
+    startUpload(offset);
+}
+
+void UploadJob::startUpload(qint64 offset)
+{
+    m_buffer.resize(CHUNK_SIZE);
+
+    //The digest covers the whole payload, also the part the receiver already has
+    if (m_sendsDigest && !hashInput(offset)) {
+        qCWarning(KDECONNECT_CORE) << "error when hashing the input to upload";
+        m_input->close();
+        return;
+    }
+
+    if (m_input->pos() != offset && !m_input->seek(offset)) {
+        qCWarning(KDECONNECT_CORE) << "error when seeking the input to upload";
+        m_input->close();
+        return;
+    }
+
+    //What the receiver already has counts as uploaded
+    bytesQueued = offset;
+    bytesUploaded = offset;
     setProcessedAmount(Bytes, bytesUploaded);
     
     connect(m_socket, &QSslSocket::encryptedBytesWritten, this, &UploadJob::encryptedBytesWritten);
-        
+
     uploadNextPacket();
 }
 
+bool UploadJob::hashInput(qint64 length)
+{
+    m_hash.reset();
+    if (length > 0 && m_input->pos() != 0 && !m_input->seek(0)) {
+        return false;
+    }
+
+    qint64 hashed = 0;
+    while (hashed < length) {
+        const qint64 chunkSize = qMin(length - hashed, qint64(CHUNK_SIZE));
+        if (m_input->read(m_buffer.data(), chunkSize) != chunkSize) {
+            return false;
+        }
+        m_hash.addData(m_buffer.constData(), static_cast<int>(chunkSize));
+        hashed += chunkSize;
+    }
+    return true;
+}
+
+QByteArray UploadJob::digest() const
+{
+    return m_hash.result().toHex();
+}
+
+qint64 UploadJob::bytesInFlight() const
+{
+    return m_socket->bytesToWrite() + m_socket->encryptedBytesToWrite();
+}
+
 void UploadJob::uploadNextPacket()
 {
-    qint64 bytesAvailable = m_input->bytesAvailable();
+    //Keep the socket fed up to the high watermark, so TLS records are written
+    //back to back instead of waiting for each chunk to be flushed
+    bool failed = false;
+    while (bytesInFlight() < HIGH_WATERMARK) {
+        const qint64 bytesAvailable = m_input->bytesAvailable();
+        if (bytesAvailable <= 0) {
+            break;
+        }
+
+        const qint64 bytesRead = m_input->read(m_buffer.data(), qMin<qint64>(bytesAvailable, m_buffer.size()));
+        const qint64 bytesWritten = (bytesRead > 0) ? m_socket->write(m_buffer.constData(), bytesRead) : -1;
+        if (bytesWritten > 0 && m_sendsDigest) {
+            m_hash.addData(m_buffer.constData(), static_cast<int>(bytesWritten));
+        }
 
-    if ( bytesAvailable > 0) {
-        qint64 bytesToSend = qMin(m_input->bytesAvailable(), (qint64)4096);
-        bytesUploading = m_socket->write(m_input->read(bytesToSend));
+        if (bytesWritten < 0) {
+            failed = true;
+            break;
+        }
+        bytesQueued += bytesWritten;
     }
-    
-    if (bytesAvailable <= 0 || bytesUploading < 0) {
+
+    if (failed || (m_input->bytesAvailable() <= 0 && bytesInFlight() == 0)) {
+        if (!failed) {
+            bytesUploaded = bytesQueued;
+            setProcessedAmount(Bytes, bytesUploaded);
+        }
         m_input->close();
-        disconnect(m_socket, &QSslSocket::encryptedBytesWritten, this, &UploadJob::encryptedBytesWritten);
     }
 }
 
 void UploadJob::encryptedBytesWritten(qint64 bytes)
 {
     Q_UNUSED(bytes);
-        
-    if (m_socket->encryptedBytesToWrite() == 0) {
-        bytesUploaded += bytesUploading;
+
+    //The encrypted queue includes the TLS overhead, so this can lag a bit behind but never overshoots
+    const qint64 uploaded = bytesQueued - bytesInFlight();
+    if (uploaded > bytesUploaded) {
+        bytesUploaded = uploaded;
         setProcessedAmount(Bytes, bytesUploaded);
-    
+    }
+
+    if (bytesInFlight() <= LOW_WATERMARK) {
         uploadNextPacket();
     }
 }
 
 void UploadJob::aboutToClose()
 {
+    disconnect(m_socket, &QSslSocket::encryptedBytesWritten, this, &UploadJob::encryptedBytesWritten);
     m_socket->disconnectFromHost();
     emitResult();
 }
@@ -23,11 +23,13 @@
 
 #include <KJob>
 
+#include <QByteArray>
 #include <QIODevice>
 #include <QVariantMap>
 #include <QSslSocket>
 #include "server.h"
 #include <QElapsedTimer>
+#include <QCryptographicHash>
 #include <networkpacket.h>
 
 class KDECONNECTCORE_EXPORT UploadJob
@@ -38,22 +40,44 @@ public:
     explicit UploadJob(const NetworkPacket& networkPacket);
 
     void setSocket(QSslSocket* socket);
+    //The receiver answers with the offset to start from before any data is sent, see FileTransferJob
+    void setResumable(bool resumable) { m_resumable = resumable; }
+    bool isResumable() const { return m_resumable; }
+    //A SHA-256 of the whole payload is computed while it is sent, see digest()
+    void setSendsDigest(bool sendsDigest) { m_sendsDigest = sendsDigest; }
+    bool sendsDigest() const { return m_sendsDigest; }
+    QByteArray digest() const;
     void start() override;
     bool stop();
     const NetworkPacket getNetworkPacket();
 
 private:
+    qint64 bytesInFlight() const;
+    void startUpload(qint64 offset);
+    bool hashInput(qint64 length);
+
     const NetworkPacket m_networkPacket;
     QSharedPointer<QIODevice> m_input;
     QSslSocket* m_socket;
-    qint64 bytesUploading;
+    QByteArray m_buffer;
+    qint64 bytesQueued;
     qint64 bytesUploaded;
+    bool m_resumable;
+    bool m_sendsDigest;
+    QCryptographicHash m_hash;
 
     const static quint16 MIN_PORT = 1739;
     const static quint16 MAX_PORT = 1764;
+
+    const static qint64 CHUNK_SIZE = 256 * 1024;
+    //Reading from the input pauses when more than HIGH_WATERMARK bytes are queued in the socket,
+    //and resumes below LOW_WATERMARK
+    const static qint64 LOW_WATERMARK = 512 * 1024;
+    const static qint64 HIGH_WATERMARK = 2 * 1024 * 1024;
     
 private Q_SLOTS:
     void uploadNextPacket();
+    void readResumeOffset();
     void encryptedBytesWritten(qint64 bytes);
     void aboutToClose();
 };
@@ -36,11 +36,12 @@ QString LoopbackDeviceLink::name()
 bool LoopbackDeviceLink::sendPacket(NetworkPacket& input)
 {
     NetworkPacket output((QString()));
-    NetworkPacket::unserialize(input.serialize(), &output);
+    unserializePacket(serializePacket(input), &output);
 
     //LoopbackDeviceLink does not need deviceTransferInfo
     if (input.hasPayload()) {
-        bool b = input.payload()->open(QIODevice::ReadOnly);
+        //Local files are handed over unbuffered, so the receiver doesn't read them through an extra copy
+        bool b = input.payload()->open(QIODevice::ReadOnly | QIODevice::Unbuffered);
         Q_ASSERT(b);
         output.setPayload(input.payload(), input.payloadSize());
     }
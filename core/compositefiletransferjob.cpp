@@ -32,10 +32,8 @@ CompositeFileTransferJob::CompositeFileTransferJob(const QString& deviceId)
     , m_running(false)
     , m_currentJobNum(1)
     , m_totalJobs(0)
-    , m_currentJobSendPayloadSize(0)
     , m_totalSendPayloadSize(0)
     , m_totalPayloadSize(0)
-    , m_currentJob(nullptr)
     , m_prevElapsedTime(0)
 {
     setCapabilities(Killable);
@@ -48,17 +46,23 @@ bool CompositeFileTransferJob::isRunning() const
 
 void CompositeFileTransferJob::start()
 {
-    QMetaObject::invokeMethod(this, "startNextSubJob", Qt::QueuedConnection);
+    //The sender decides how many files go at once, every file it announces is received right away
+    //instead of leaving its data waiting in the socket
     m_running = true;
+    m_timer.start();
+    const QList<KJob*> jobs = subjobs();
+    for (KJob* job : jobs) {
+        startSubJob(job);
+    }
 }
 
-void CompositeFileTransferJob::startNextSubJob()
+void CompositeFileTransferJob::startSubJob(KJob* job)
 {
-    m_currentJob = qobject_cast<FileTransferJob*>(subjobs().at(0));
-    m_currentJobSendPayloadSize = 0;
-    emitDescription(m_currentJob->destination().toString());
-    m_currentJob->start();
-    connect(m_currentJob, QOverload<KJob*,KJob::Unit,qulonglong>::of(&FileTransferJob::processedAmount), this, &CompositeFileTransferJob::slotProcessedAmount);
+    FileTransferJob* transferJob = qobject_cast<FileTransferJob*>(job);
+    m_jobProgress.insert(job, 0);
+    emitDescription(transferJob->destination().toString());
+    transferJob->start();
+    connect(transferJob, QOverload<KJob*,KJob::Unit,qulonglong>::of(&FileTransferJob::processedAmount), this, &CompositeFileTransferJob::slotProcessedAmount);
 }
 
 bool CompositeFileTransferJob::addSubjob(KJob* job)
@@ -79,11 +83,13 @@ bool CompositeFileTransferJob::addSubjob(KJob* job)
         QString filename = np->get<QString>(QStringLiteral("filename"));
         emitDescription(filename);
 
-        if (!hasSubjobs()) {
-            QMetaObject::invokeMethod(this, "startNextSubJob", Qt::QueuedConnection);
+        if (!KCompositeJob::addSubjob(job)) {
+            return false;
         }
-
-        return KCompositeJob::addSubjob(job);
+        if (m_running) {
+            startSubJob(job);
+        }
+        return true;
     } else {
         qCDebug(KDECONNECT_CORE) << "CompositeFileTransferJob::addSubjob() - you can only add FileTransferJob's, ignoring";
         return false;
@@ -94,17 +100,20 @@ bool CompositeFileTransferJob::addSubjob(KJob* job)
 bool CompositeFileTransferJob::doKill()
 {
     m_running = false;
-    if (m_currentJob) {
-        return m_currentJob->kill();
+    const QList<KJob*> jobs = subjobs();
+    for (KJob* job : jobs) {
+        job->kill();
     }
     return true;
 }
 
 void CompositeFileTransferJob::slotProcessedAmount(KJob *job, KJob::Unit unit, qulonglong amount)
 {
-    Q_UNUSED(job);
-    m_currentJobSendPayloadSize = amount;
-    quint64 uploaded = m_totalSendPayloadSize + m_currentJobSendPayloadSize;
+    m_jobProgress[job] = amount;
+    quint64 uploaded = m_totalSendPayloadSize;
+    for (quint64 jobUploaded : qAsConst(m_jobProgress)) {
+        uploaded += jobUploaded;
+    }
 
     if (uploaded == m_totalPayloadSize || m_prevElapsedTime == 0 || m_timer.elapsed() - m_prevElapsedTime >= 100) {
         m_prevElapsedTime = m_timer.elapsed();
@@ -126,15 +135,12 @@ void CompositeFileTransferJob::slotResult(KJob *job)
         return;
     }
 
-    m_totalSendPayloadSize += m_currentJobSendPayloadSize;
+    m_totalSendPayloadSize += m_jobProgress.take(job);
 
     setProcessedAmount(Files, m_currentJobNum);
 
     if (m_currentJobNum < m_totalJobs) {
         m_currentJobNum++;
-        if (!subjobs().empty()) {
-            startNextSubJob();
-        }
     } else {
         emitResult();
     }
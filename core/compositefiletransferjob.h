@@ -24,6 +24,7 @@
 #include "kdeconnectcore_export.h"
 #include <KCompositeJob>
 #include <QElapsedTimer>
+#include <QHash>
 
 class FileTransferJob;
 
@@ -45,19 +46,18 @@ protected:
 private Q_SLOTS:
     void slotProcessedAmount(KJob *job, KJob::Unit unit, qulonglong amount);
     void slotResult(KJob *job) override;
-    void startNextSubJob();
 
 private:
+    void startSubJob(KJob* job);
     void emitDescription(const QString& currentFileName);
 
     QString m_deviceId;
     bool m_running;
     int m_currentJobNum;
     int m_totalJobs;
-    quint64 m_currentJobSendPayloadSize;
+    QHash<KJob*, quint64> m_jobProgress;
     quint64 m_totalSendPayloadSize;
     quint64 m_totalPayloadSize;
-    FileTransferJob *m_currentJob;
     QElapsedTimer m_timer;
     quint64 m_prevElapsedTime;
 
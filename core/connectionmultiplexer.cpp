@@ -0,0 +1,323 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "connectionmultiplexer.h"
+#include "core_debug.h"
+
+#include <QtEndian>
+#include <QSet>
+
+#include <cstring>
+
+static const QUuid DEFAULT_CHANNEL_ID(QStringLiteral("{a0d0aaf4-1072-4d81-aa35-902a954b1266}"));
+static const quint16 PROTOCOL_VERSION = 1;
+
+ConnectionMultiplexer::ConnectionMultiplexer(QIODevice* device, QObject* parent)
+    : QObject(parent)
+    , m_device(device)
+    , m_flushScheduled(false)
+{
+    m_unclaimedChannelsTimer.setInterval(UNCLAIMED_CHANNEL_TIMEOUT / 2);
+    connect(&m_unclaimedChannelsTimer, &QTimer::timeout, this, &ConnectionMultiplexer::expireUnclaimedChannels);
+
+    uchar versions[4];
+    qToBigEndian(PROTOCOL_VERSION, versions);
+    qToBigEndian(PROTOCOL_VERSION, versions + 2);
+    sendMessage(MESSAGE_PROTOCOL_VERSION, QUuid(), reinterpret_cast<const char*>(versions), sizeof(versions));
+
+    QSharedPointer<MultiplexChannelState> defaultState = addChannel(DEFAULT_CHANNEL_ID);
+    defaultState->claimed = true;
+    m_defaultChannel = new MultiplexChannel(this, defaultState, this);
+    requestData(defaultState.data());
+
+    connect(m_device, &QIODevice::readyRead, this, &ConnectionMultiplexer::readMessages);
+    connect(m_device, &QIODevice::readChannelFinished, this, &ConnectionMultiplexer::deviceClosed);
+    connect(m_device, &QIODevice::aboutToClose, this, &ConnectionMultiplexer::deviceClosed);
+
+    //Data that arrived before we were created doesn't get another readyRead
+    readMessages();
+}
+
+ConnectionMultiplexer::~ConnectionMultiplexer()
+{
+    deviceClosed();
+}
+
+QSharedPointer<MultiplexChannelState> ConnectionMultiplexer::addChannel(const QUuid& id)
+{
+    QSharedPointer<MultiplexChannelState> state(new MultiplexChannelState);
+    state->id = id;
+    m_channels.insert(id, state);
+    return state;
+}
+
+QUuid ConnectionMultiplexer::newChannel()
+{
+    const QUuid id = QUuid::createUuid();
+    addChannel(id);
+    sendMessage(MESSAGE_OPEN_CHANNEL, id);
+    return id;
+}
+
+MultiplexChannel* ConnectionMultiplexer::takeChannel(const QUuid& id)
+{
+    //The other end may not have told us about the channel yet
+    QSharedPointer<MultiplexChannelState> state = m_channels.value(id);
+    if (!state) {
+        state = addChannel(id);
+    }
+    if (state->claimed) {
+        return nullptr;
+    }
+
+    state->claimed = true;
+    MultiplexChannel* channel = new MultiplexChannel(this, state);
+    requestData(state.data());
+    return channel;
+}
+
+void ConnectionMultiplexer::readMessages()
+{
+    m_buffer.append(m_device->readAll());
+
+    QSet<MultiplexChannel*> readyChannels;
+    int pos = 0;
+    while (m_buffer.size() - pos >= HEADER_SIZE) {
+        const char* header = m_buffer.constData() + pos;
+        const int length = qFromBigEndian<quint16>(reinterpret_cast<const uchar*>(header + 1));
+        if (m_buffer.size() - pos < HEADER_SIZE + length) {
+            break;
+        }
+
+        const QUuid id = QUuid::fromRfc4122(QByteArray::fromRawData(header + 3, 16));
+        const MessageType type = static_cast<MessageType>(header[0]);
+        if (type == MESSAGE_WRITE || type == MESSAGE_CLOSE_CHANNEL) {
+            //Looked up first, closing can forget about the channel
+            const QSharedPointer<MultiplexChannelState> state = m_channels.value(id);
+            if (state && state->channel) {
+                readyChannels.insert(state->channel);
+            }
+        }
+        if (!handleMessage(type, id, header + HEADER_SIZE, length)) {
+            //The connection was closed, whatever else the other end sent is discarded
+            pos = m_buffer.size();
+            break;
+        }
+        pos += HEADER_SIZE + length;
+    }
+    m_buffer.remove(0, pos);
+
+    //Channels are told once about everything that arrived in this batch
+    for (MultiplexChannel* channel : qAsConst(readyChannels)) {
+        if (channel->bytesAvailable() > 0) {
+            Q_EMIT channel->readyRead();
+        }
+        if (channel->m_state->remoteClosed) {
+            Q_EMIT channel->readChannelFinished();
+        }
+    }
+}
+
+bool ConnectionMultiplexer::handleMessage(MessageType type, const QUuid& id, const char* data, int length)
+{
+    if (type == MESSAGE_PROTOCOL_VERSION) {
+        if (length < 4) {
+            return true;
+        }
+        const quint16 lowest = qFromBigEndian<quint16>(reinterpret_cast<const uchar*>(data));
+        const quint16 highest = qFromBigEndian<quint16>(reinterpret_cast<const uchar*>(data + 2));
+        if (PROTOCOL_VERSION < lowest || PROTOCOL_VERSION > highest) {
+            qCWarning(KDECONNECT_CORE) << "Unsupported multiplexing protocol versions" << lowest << "-" << highest;
+            m_device->close();
+            return false;
+        }
+        return true;
+    }
+
+    if (type == MESSAGE_OPEN_CHANNEL) {
+        if (!m_channels.contains(id)) {
+            int unclaimed = 0;
+            for (const QSharedPointer<MultiplexChannelState>& state : qAsConst(m_channels)) {
+                unclaimed += state->claimed ? 0 : 1;
+            }
+            if (unclaimed >= MAX_UNCLAIMED_CHANNELS) {
+                protocolError("Too many channels nobody took", id);
+                return false;
+            }
+            addChannel(id)->openedByRemote.start();
+            if (!m_unclaimedChannelsTimer.isActive()) {
+                m_unclaimedChannelsTimer.start();
+            }
+        }
+        return true;
+    }
+
+    //Messages about unknown channels are ignored
+    const QSharedPointer<MultiplexChannelState> state = m_channels.value(id);
+    if (!state) {
+        return true;
+    }
+
+    switch (type) {
+    case MESSAGE_CLOSE_CHANNEL:
+        state->remoteClosed = true;
+        state->writeBuffer.clear();
+        if (state->closeSent) {
+            m_channels.remove(id);
+        }
+        break;
+    case MESSAGE_READ:
+        if (length >= 2) {
+            state->credit += qFromBigEndian<quint16>(reinterpret_cast<const uchar*>(data));
+            scheduleFlush();
+        }
+        break;
+    case MESSAGE_WRITE:
+        //Nothing limits what we buffer for a channel but the credit we gave, so that is enforced
+        if (length > state->requested) {
+            protocolError("Data beyond the credit of channel", id);
+            return false;
+        }
+        if (!state->localClosed) {
+            state->readBuffer.append(data, length);
+        }
+        state->requested -= length;
+        break;
+    default:
+        qCDebug(KDECONNECT_CORE) << "Unknown multiplexing message type" << type;
+        break;
+    }
+    return true;
+}
+
+void ConnectionMultiplexer::protocolError(const char* reason, const QUuid& id)
+{
+    qCWarning(KDECONNECT_CORE) << "Closing multiplexed connection:" << reason << id;
+    m_device->close();
+}
+
+void ConnectionMultiplexer::expireUnclaimedChannels()
+{
+    bool unclaimedLeft = false;
+    for (auto it = m_channels.begin(); it != m_channels.end();) {
+        MultiplexChannelState* state = it->data();
+        if (!state->claimed && state->openedByRemote.isValid() && state->openedByRemote.elapsed() >= UNCLAIMED_CHANNEL_TIMEOUT) {
+            qCDebug(KDECONNECT_CORE) << "Dropping multiplexed channel nobody took" << state->id;
+            sendMessage(MESSAGE_CLOSE_CHANNEL, state->id);
+            it = m_channels.erase(it);
+            continue;
+        }
+        unclaimedLeft |= !state->claimed;
+        ++it;
+    }
+
+    if (!unclaimedLeft) {
+        m_unclaimedChannelsTimer.stop();
+    }
+}
+
+void ConnectionMultiplexer::sendMessage(MessageType type, const QUuid& id, const char* data, int length)
+{
+    Q_ASSERT(length <= MAX_MESSAGE_LENGTH);
+    char header[HEADER_SIZE];
+    header[0] = static_cast<char>(type);
+    qToBigEndian(static_cast<quint16>(length), reinterpret_cast<uchar*>(header + 1));
+    memcpy(header + 3, id.toRfc4122().constData(), 16);
+
+    m_device->write(header, HEADER_SIZE);
+    if (length > 0) {
+        m_device->write(data, length);
+    }
+}
+
+void ConnectionMultiplexer::requestData(MultiplexChannelState* state)
+{
+    if (!state->claimed || state->remoteClosed || state->localClosed) {
+        return;
+    }
+
+    //Keep the other end allowed to send up to a window of data we haven't read yet
+    qint64 wanted = CHANNEL_WINDOW - state->readBuffer.size() - state->requested;
+    while (wanted >= MAX_MESSAGE_LENGTH / 2) {
+        const quint16 amount = static_cast<quint16>(qMin<qint64>(wanted, MAX_MESSAGE_LENGTH));
+        uchar data[2];
+        qToBigEndian(amount, data);
+        sendMessage(MESSAGE_READ, state->id, reinterpret_cast<const char*>(data), sizeof(data));
+        state->requested += amount;
+        wanted -= amount;
+    }
+}
+
+void ConnectionMultiplexer::scheduleFlush()
+{
+    if (!m_flushScheduled) {
+        m_flushScheduled = true;
+        QMetaObject::invokeMethod(this, "flush", Qt::QueuedConnection);
+    }
+}
+
+void ConnectionMultiplexer::flush()
+{
+    m_flushScheduled = false;
+
+    for (auto it = m_channels.begin(); it != m_channels.end();) {
+        MultiplexChannelState* state = it->data();
+
+        qint64 written = 0;
+        while (!state->writeBuffer.isEmpty() && state->credit > 0) {
+            const int length = static_cast<int>(qMin<qint64>(qMin<qint64>(state->writeBuffer.size(), state->credit), MAX_MESSAGE_LENGTH));
+            sendMessage(MESSAGE_WRITE, state->id, state->writeBuffer.constData(), length);
+            state->writeBuffer.remove(0, length);
+            state->credit -= length;
+            written += length;
+        }
+        if (written > 0 && state->channel) {
+            Q_EMIT state->channel->bytesWritten(written);
+        }
+
+        if (state->localClosed && state->writeBuffer.isEmpty() && !state->closeSent) {
+            sendMessage(MESSAGE_CLOSE_CHANNEL, state->id);
+            state->closeSent = true;
+        }
+
+        if (state->closeSent && state->remoteClosed) {
+            it = m_channels.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void ConnectionMultiplexer::deviceClosed()
+{
+    m_unclaimedChannelsTimer.stop();
+
+    //Nothing else will arrive, channels still get to read what they have
+    const QList<QSharedPointer<MultiplexChannelState>> channels = m_channels.values();
+    m_channels.clear();
+    for (const QSharedPointer<MultiplexChannelState>& state : channels) {
+        const bool wasClosed = state->remoteClosed;
+        state->remoteClosed = true;
+        state->writeBuffer.clear();
+        if (!wasClosed && state->channel) {
+            Q_EMIT state->channel->readChannelFinished();
+        }
+    }
+}
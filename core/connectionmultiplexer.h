@@ -0,0 +1,112 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONNECTIONMULTIPLEXER_H
+#define CONNECTIONMULTIPLEXER_H
+
+#include <QHash>
+#include <QObject>
+#include <QSharedPointer>
+#include <QTimer>
+#include <QUuid>
+
+#include "kdeconnectcore_export.h"
+#include "multiplexchannel.h"
+
+/**
+ * @short Splits a single connection into any number of channels
+ *
+ * Implements version 1 of the protocol described in
+ * core/backends/bluetooth/Multiplexing protocol.md on top of any QIODevice.
+ * The default channel exists from the start on both ends, other channels are
+ * opened with newChannel() and their id is passed to the other end, which gets
+ * them with takeChannel().
+ *
+ * Every channel only receives as much data as it asked for, so a slow reader
+ * doesn't hold up the rest of the connection. An other end that writes more than
+ * that gets its connection closed. Channels it opens and nobody takes are dropped
+ * after UNCLAIMED_CHANNEL_TIMEOUT.
+ */
+class KDECONNECTCORE_EXPORT ConnectionMultiplexer
+    : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ConnectionMultiplexer(QIODevice* device, QObject* parent = nullptr);
+    ~ConnectionMultiplexer() override;
+
+    /**
+     * The channel both ends have from the start. It is owned by the multiplexer
+     */
+    MultiplexChannel* defaultChannel() const { return m_defaultChannel; }
+
+    /**
+     * Opens a new channel and tells the other end about it
+     */
+    QUuid newChannel();
+
+    /**
+     * Returns the channel with the given id, whether it was opened by us or by the
+     * other end, or nullptr if it was already taken. The caller owns the channel.
+     */
+    MultiplexChannel* takeChannel(const QUuid& id);
+
+private Q_SLOTS:
+    void readMessages();
+    void flush();
+    void deviceClosed();
+    void expireUnclaimedChannels();
+
+private:
+    friend class MultiplexChannel;
+
+    enum MessageType : quint8 {
+        MESSAGE_PROTOCOL_VERSION = 0,
+        MESSAGE_OPEN_CHANNEL = 1,
+        MESSAGE_CLOSE_CHANNEL = 2,
+        MESSAGE_READ = 3,
+        MESSAGE_WRITE = 4,
+    };
+
+    QSharedPointer<MultiplexChannelState> addChannel(const QUuid& id);
+    bool handleMessage(MessageType type, const QUuid& id, const char* data, int length);
+    void protocolError(const char* reason, const QUuid& id);
+    void sendMessage(MessageType type, const QUuid& id, const char* data = nullptr, int length = 0);
+    void requestData(MultiplexChannelState* state);
+    void scheduleFlush();
+
+    QIODevice* m_device;
+    QByteArray m_buffer;
+    QHash<QUuid, QSharedPointer<MultiplexChannelState>> m_channels;
+    MultiplexChannel* m_defaultChannel;
+    bool m_flushScheduled;
+    QTimer m_unclaimedChannelsTimer;
+
+    const static int HEADER_SIZE = 19;
+    const static int MAX_MESSAGE_LENGTH = 0xFFFF;
+    //How much unread data a channel accepts from the other end
+    const static int CHANNEL_WINDOW = 256 * 1024;
+    //The packet that claims a channel follows right after it is opened
+    const static int UNCLAIMED_CHANNEL_TIMEOUT = 30 * 1000;
+    const static int MAX_UNCLAIMED_CHANNELS = 64;
+};
+
+#endif
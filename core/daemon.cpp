@@ -21,21 +21,29 @@
 #include "daemon.h"
 
 #include <QDBusMetaType>
+#include <QDBusMessage>
 #include <QNetworkAccessManager>
 #include <QDebug>
 #include <QPointer>
+#include <QThread>
+#include <QHash>
+#include <QSet>
 
 #include "core_debug.h"
 #include "kdeconnectconfig.h"
 #include "networkpacket.h"
 #include "dbushelper.h"
 #include "notificationserverinfo.h"
+#include "pluginloader.h"
+#include "startupprofiler.h"
+#include "packetmetrics.h"
 
 #ifdef KDECONNECT_BLUETOOTH
     #include "backends/bluetooth/bluetoothlinkprovider.h"
 #endif
 
 #include "backends/lan/lanlinkprovider.h"
+#include "backends/lan/tlssessioncache.h"
 #include "backends/loopback/loopbacklinkprovider.h"
 #include "device.h"
 #include "backends/devicelink.h"
@@ -46,16 +54,62 @@
 
 static Daemon* s_instance = nullptr;
 
+//Loads what doesn't need the main thread, so the daemon can answer D-Bus calls in the meantime
+class StartupWorker : public QThread
+{
+public:
+    using QThread::QThread;
+
+protected:
+    void run() override
+    {
+        StartupProfiler::Span span("StartupWorker");
+        //Loads or generates our certificate and private key
+        KdeConnectConfig::instance();
+        //Scans the plugins' metadata
+        PluginLoader::instance();
+    }
+};
+
 struct DaemonPrivate
 {
     //Different ways to find devices and connect to them
     QSet<LinkProvider*> m_linkProviders;
 
-    //Every known device
-    QMap<QString, Device*> m_devices;
+    //Every known device, by id and by name
+    QHash<QString, Device*> m_devices;
+    QMultiHash<QString, Device*> m_devicesByName;
+    QHash<Device*, QString> m_indexedNames;
+    QSet<QString> m_pairingRequests;
+
+    //What devices() and deviceNames() returned for each combination of filters,
+    //dropped whenever a device is added, removed or changes
+    mutable QHash<int, QStringList> m_filteredIds;
+    mutable QHash<int, QMap<QString, QString>> m_filteredNames;
+
+    void invalidateFilteredViews()
+    {
+        m_filteredIds.clear();
+        m_filteredNames.clear();
+    }
+
+    void indexName(Device* device)
+    {
+        const auto indexed = m_indexedNames.constFind(device);
+        if (indexed != m_indexedNames.constEnd()) {
+            m_devicesByName.remove(*indexed, device);
+        }
+        m_indexedNames.insert(device, device->name());
+        m_devicesByName.insert(device->name(), device);
+    }
 
     QSet<QString> m_discoveryModeAcquisitions;
     bool m_testMode;
+
+    StartupWorker* m_startupWorker;
+    bool m_started = false;
+    //D-Bus calls received before finishInit(), with how to answer them
+    QList<QPair<QDBusMessage, std::function<QVariant()>>> m_delayedReplies;
 };
 
 Daemon* Daemon::instance()
@@ -72,6 +126,11 @@ Daemon::Daemon(QObject* parent, bool testMode)
     s_instance = this;
     d->m_testMode = testMode;
 
+    StartupProfiler::instance();
+    d->m_startupWorker = new StartupWorker(this);
+    connect(d->m_startupWorker, &QThread::finished, this, &Daemon::finishInit);
+    d->m_startupWorker->start();
+
     // HACK init may call pure virtual functions from this class so it can't be called directly from the ctor
     QTimer::singleShot(0, this, &Daemon::init);
 }
@@ -80,6 +139,36 @@ void Daemon::init()
 {
     qCDebug(KDECONNECT_CORE) << "Daemon starting";
 
+    {
+        //Calls that need the devices or our certificate wait for the startup worker
+        StartupProfiler::Span span("Daemon D-Bus registration");
+        qDBusRegisterMetaType< QMap<QString,QString> >();
+        DbusHelper::sessionBus().registerService(QStringLiteral("org.kde.kdeconnect"));
+        DbusHelper::sessionBus().registerObject(QStringLiteral("/modules/kdeconnect"), this, QDBusConnection::ExportScriptableContents);
+    }
+
+    const qint64 registeredMs = StartupProfiler::instance()->elapsedNs() / 1000000;
+    if (registeredMs > STARTUP_DBUS_BUDGET_MS) {
+        qCWarning(KDECONNECT_CORE) << "Daemon took" << registeredMs << "ms to be on D-Bus, more than" << STARTUP_DBUS_BUDGET_MS;
+    }
+
+    //Tests expect a fully started daemon once the event loop ran once
+    if (d->m_testMode) {
+        d->m_startupWorker->wait();
+    }
+    if (d->m_startupWorker->isFinished()) {
+        finishInit();
+    }
+}
+
+void Daemon::finishInit()
+{
+    if (d->m_started) {
+        return;
+    }
+    d->m_started = true;
+    StartupProfiler::Span span("Daemon::finishInit");
+
     //Load backends
     if (d->m_testMode)
         d->m_linkProviders.insert(new LoopbackLinkProvider());
@@ -94,26 +183,63 @@ void Daemon::init()
     }
 
     //Read remembered paired devices
-    const QStringList& list = KdeConnectConfig::instance()->trustedDevices();
-    for (const QString& id : list) {
-        addDevice(new Device(this, id));
+    {
+        StartupProfiler::Span span("Trusted devices");
+        const QStringList& list = KdeConnectConfig::instance()->trustedDevices();
+        for (const QString& id : list) {
+            addDevice(new Device(this, id));
+        }
     }
 
     //Listen to new devices
-    for (LinkProvider* a : qAsConst(d->m_linkProviders)) {
-        connect(a, &LinkProvider::onConnectionReceived,
-                this, &Daemon::onNewDeviceLink);
-        a->onStart();
+    {
+        StartupProfiler::Span span("Link providers");
+        for (LinkProvider* a : qAsConst(d->m_linkProviders)) {
+            connect(a, &LinkProvider::onConnectionReceived,
+                    this, &Daemon::onNewDeviceLink);
+            a->onStart();
+        }
     }
 
-    //Register on DBus
-    qDBusRegisterMetaType< QMap<QString,QString> >();
-    DbusHelper::sessionBus().registerService(QStringLiteral("org.kde.kdeconnect"));
-    DbusHelper::sessionBus().registerObject(QStringLiteral("/modules/kdeconnect"), this, QDBusConnection::ExportScriptableContents);
+    {
+        StartupProfiler::Span span("NotificationServerInfo");
+        NotificationServerInfo::instance().init();
+    }
 
-    NotificationServerInfo::instance().init();
+    const auto delayedReplies = d->m_delayedReplies;
+    d->m_delayedReplies.clear();
+    for (const auto& delayed : delayedReplies) {
+        const QVariant value = delayed.second();
+        DbusHelper::sessionBus().send(value.isValid() ? delayed.first.createReply(value) : delayed.first.createReply());
+    }
 
     qCDebug(KDECONNECT_CORE) << "Daemon started";
+    StartupProfiler::instance()->dump();
+}
+
+bool Daemon::delayReplyUntilStarted(const std::function<QVariant()>& reply) const
+{
+    if (d->m_started || !calledFromDBus()) {
+        return false;
+    }
+    setDelayedReply(true);
+    d->m_delayedReplies.append(qMakePair(message(), reply));
+    return true;
+}
+
+QString Daemon::startupProfile() const
+{
+    return StartupProfiler::instance()->report();
+}
+
+QString Daemon::packetStats() const
+{
+    return PacketMetrics::report();
+}
+
+QString Daemon::tlsStats() const
+{
+    return TlsSessionCache::instance()->report();
 }
 
 void Daemon::acquireDiscoveryMode(const QString& key)
@@ -141,6 +267,11 @@ void Daemon::releaseDiscoveryMode(const QString& key)
 void Daemon::removeDevice(Device* device)
 {
     d->m_devices.remove(device->id());
+    d->m_devicesByName.remove(d->m_indexedNames.take(device), device);
+    if (d->m_pairingRequests.remove(device->id())) {
+        Q_EMIT pairingRequestsChanged();
+    }
+    d->invalidateFilteredViews();
     device->deleteLater();
     Q_EMIT deviceRemoved(device->id());
     Q_EMIT deviceListChanged();
@@ -171,12 +302,7 @@ void Daemon::forceOnNetworkChange()
 
 Device*Daemon::getDevice(const QString& deviceId)
 {
-    for (Device* device : qAsConst(d->m_devices)) {
-        if (device->id() == deviceId) {
-            return device;
-        }
-    }
-    return nullptr;
+    return d->m_devices.value(deviceId);
 }
 
 const QSet<LinkProvider*>& Daemon::getLinkProviders() const
@@ -186,24 +312,35 @@ const QSet<LinkProvider*>& Daemon::getLinkProviders() const
 
 QStringList Daemon::devices(bool onlyReachable, bool onlyTrusted) const
 {
-    QStringList ret;
-    for (Device* device : qAsConst(d->m_devices)) {
-        if (onlyReachable && !device->isReachable()) continue;
-        if (onlyTrusted && !device->isTrusted()) continue;
-        ret.append(device->id());
+    const int filter = (onlyReachable ? 1 : 0) | (onlyTrusted ? 2 : 0);
+    auto cached = d->m_filteredIds.constFind(filter);
+    if (cached == d->m_filteredIds.constEnd()) {
+        QStringList ret;
+        for (Device* device : qAsConst(d->m_devices)) {
+            if (onlyReachable && !device->isReachable()) continue;
+            if (onlyTrusted && !device->isTrusted()) continue;
+            ret.append(device->id());
+        }
+        ret.sort();
+        cached = d->m_filteredIds.insert(filter, ret);
     }
-    return ret;
+    return *cached;
 }
 
 QMap<QString, QString> Daemon::deviceNames(bool onlyReachable, bool onlyTrusted) const
 {
-    QMap<QString, QString> ret;
-    for (Device* device : qAsConst(d->m_devices)) {
-        if (onlyReachable && !device->isReachable()) continue;
-        if (onlyTrusted && !device->isTrusted()) continue;
-        ret[device->id()] = device->name();
+    const int filter = (onlyReachable ? 1 : 0) | (onlyTrusted ? 2 : 0);
+    auto cached = d->m_filteredNames.constFind(filter);
+    if (cached == d->m_filteredNames.constEnd()) {
+        QMap<QString, QString> ret;
+        for (Device* device : qAsConst(d->m_devices)) {
+            if (onlyReachable && !device->isReachable()) continue;
+            if (onlyTrusted && !device->isTrusted()) continue;
+            ret[device->id()] = device->name();
+        }
+        cached = d->m_filteredNames.insert(filter, ret);
     }
-    return ret;
+    return *cached;
 }
 
 void Daemon::onNewDeviceLink(const NetworkPacket& identityPacket, DeviceLink* dl)
@@ -212,9 +349,9 @@ void Daemon::onNewDeviceLink(const NetworkPacket& identityPacket, DeviceLink* dl
 
     //qCDebug(KDECONNECT_CORE) << "Device discovered" << id << "via" << dl->provider()->name();
 
-    if (d->m_devices.contains(id)) {
+    Device* device = d->m_devices.value(id);
+    if (device) {
         qCDebug(KDECONNECT_CORE) << "It is a known device" << identityPacket.get<QString>(QStringLiteral("deviceName"));
-        Device* device = d->m_devices[id];
         bool wasReachable = device->isReachable();
         device->addLink(identityPacket, dl);
         if (!wasReachable) {
@@ -223,7 +360,7 @@ void Daemon::onNewDeviceLink(const NetworkPacket& identityPacket, DeviceLink* dl
         }
     } else {
         qCDebug(KDECONNECT_CORE) << "It is a new device" << identityPacket.get<QString>(QStringLiteral("deviceName"));
-        Device* device = new Device(this, identityPacket, dl);
+        device = new Device(this, identityPacket, dl);
 
         //we discard the connections that we created but it's not paired.
         if (!isDiscoveringDevices() && !device->isTrusted() && !dl->linkShouldBeKeptAlive()) {
@@ -239,6 +376,7 @@ void Daemon::onDeviceStatusChanged()
     Device* device = (Device*)sender();
 
     //qCDebug(KDECONNECT_CORE) << "Device" << device->name() << "status changed. Reachable:" << device->isReachable() << ". Paired: " << device->isPaired();
+    d->invalidateFilteredViews();
 
     if (!device->isReachable() && !device->isTrusted()) {
         //qCDebug(KDECONNECT_CORE) << "Destroying device" << device->name();
@@ -252,6 +390,9 @@ void Daemon::onDeviceStatusChanged()
 
 void Daemon::setAnnouncedName(const QString& name)
 {
+    if (delayReplyUntilStarted([this, name] { setAnnouncedName(name); return QVariant(); })) {
+        return;
+    }
     qCDebug(KDECONNECT_CORE()) << "Announcing name";
     KdeConnectConfig::instance()->setName(name);
     forceOnNetworkChange();
@@ -260,6 +401,9 @@ void Daemon::setAnnouncedName(const QString& name)
 
 QString Daemon::announcedName()
 {
+    if (delayReplyUntilStarted([this] { return QVariant(announcedName()); })) {
+        return QString();
+    }
     return KdeConnectConfig::instance()->name();
 }
 
@@ -284,11 +428,13 @@ bool Daemon::isDiscoveringDevices() const
 
 QString Daemon::deviceIdByName(const QString& name) const
 {
-    for (Device* device : qAsConst(d->m_devices)) {
-        if (device->name() == name && device->isTrusted())
-            return device->id();
+    //Several devices can share a name, the one with the lowest id wins as when the devices were searched in order
+    QString id;
+    for (auto it = d->m_devicesByName.constFind(name); it != d->m_devicesByName.constEnd() && it.key() == name; ++it) {
+        if ((*it)->isTrusted() && (id.isEmpty() || (*it)->id() < id))
+            id = (*it)->id();
     }
-    return {};
+    return id;
 }
 
 void Daemon::addDevice(Device* device)
@@ -296,12 +442,26 @@ void Daemon::addDevice(Device* device)
     const QString id = device->id();
     connect(device, &Device::reachableChanged, this, &Daemon::onDeviceStatusChanged);
     connect(device, &Device::trustedChanged, this, &Daemon::onDeviceStatusChanged);
-    connect(device, &Device::hasPairingRequestsChanged, this, &Daemon::pairingRequestsChanged);
     connect(device, &Device::hasPairingRequestsChanged, this, [this, device](bool hasPairingRequests) {
+        if (hasPairingRequests) {
+            d->m_pairingRequests.insert(device->id());
+        } else {
+            d->m_pairingRequests.remove(device->id());
+        }
+        Q_EMIT pairingRequestsChanged();
         if (hasPairingRequests)
             askPairingConfirmation(device);
     } );
+    connect(device, &Device::nameChanged, this, [this, device] {
+        d->indexName(device);
+        d->invalidateFilteredViews();
+    });
     d->m_devices[id] = device;
+    d->indexName(device);
+    if (device->hasPairingRequests()) {
+        d->m_pairingRequests.insert(id);
+    }
+    d->invalidateFilteredViews();
 
     Q_EMIT deviceAdded(id);
     Q_EMIT deviceListChanged();
@@ -309,20 +469,20 @@ void Daemon::addDevice(Device* device)
 
 QStringList Daemon::pairingRequests() const
 {
-    QStringList ret;
-    for(Device* dev: qAsConst(d->m_devices)) {
-        if (dev->hasPairingRequests())
-            ret += dev->id();
-    }
-    return ret;
+    QStringList ids = d->m_pairingRequests.toList();
+    ids.sort();
+    return ids;
 }
 
 Daemon::~Daemon()
 {
-
+    d->m_startupWorker->wait();
 }
 
 QString Daemon::selfId() const
 {
+    if (delayReplyUntilStarted([this] { return QVariant(selfId()); })) {
+        return QString();
+    }
     return KdeConnectConfig::instance()->deviceId();
 }
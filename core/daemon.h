@@ -22,8 +22,10 @@
 #define KDECONNECT_DAEMON_H
 
 #include <QObject>
+#include <QDBusContext>
 #include <QSet>
 #include <QMap>
+#include <functional>
 
 #include "kdeconnectcore_export.h"
 #include "device.h"
@@ -35,6 +37,7 @@ class QNetworkAccessManager;
 
 class KDECONNECTCORE_EXPORT Daemon
     : public QObject
+    , protected QDBusContext
 {
     Q_OBJECT
     Q_CLASSINFO("D-Bus Interface", "org.kde.kdeconnect.daemon")
@@ -61,6 +64,13 @@ public:
     QStringList pairingRequests() const;
 
     Q_SCRIPTABLE QString selfId() const;
+
+    //How long each step of the startup took, see StartupProfiler
+    Q_SCRIPTABLE QString startupProfile() const;
+    //Packets sent, received, decode and dispatch times by device, plugin and packet type
+    Q_SCRIPTABLE QString packetStats() const;
+    //TLS handshakes with trusted devices, full and resumed, see TlsSessionCache
+    Q_SCRIPTABLE QString tlsStats() const;
 public Q_SLOTS:
     Q_SCRIPTABLE void acquireDiscoveryMode(const QString& id);
     Q_SCRIPTABLE void releaseDiscoveryMode(const QString& id);
@@ -91,9 +101,16 @@ Q_SIGNALS:
 private Q_SLOTS:
     void onNewDeviceLink(const NetworkPacket& identityPacket, DeviceLink* dl);
     void onDeviceStatusChanged();
+    void finishInit();
 
 private:
     void init();
+    //Whether a D-Bus call that needs KdeConnectConfig is answered with reply() once finishInit() ran,
+    //so the main thread doesn't wait for the startup worker meanwhile
+    bool delayReplyUntilStarted(const std::function<QVariant()>& reply) const;
+
+    //Time after starting in which we should be answering D-Bus calls
+    const static int STARTUP_DBUS_BUDGET_MS = 200;
 
 protected:
     void addDevice(Device* device);
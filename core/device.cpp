@@ -23,6 +23,12 @@
 #include <QVector>
 #include <QSet>
 #include <QSslCertificate>
+#include <QDBusPendingCallWatcher>
+#include <QDBusVirtualObject>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QPointer>
+#include <QCoreApplication>
 
 #include <KSharedConfig>
 #include <KConfigGroup>
@@ -38,6 +44,7 @@
 #include "kdeconnectconfig.h"
 #include "daemon.h"
 #include "dbushelper.h"
+#include "packetmetrics.h"
 
 //In older Qt released, qAsConst isnt available
 #include "qtcompat_p.h"
@@ -65,10 +72,93 @@ public:
     QVector<DeviceLink *> m_deviceLinks;
     QHash<QString, KdeConnectPlugin *> m_plugins;
 
-    QMultiMap<QString, KdeConnectPlugin *> m_pluginsByIncomingCapability;
+    //Indexed by NetworkPacket::typeId()
+    QVector<QVector<KdeConnectPlugin *>> m_pluginsByIncomingType;
     QSet<QString> m_supportedPlugins;
     QSet<QString> m_allPlugins;
     QSet<PairingHandler *> m_pairRequests;
+
+    //Enabled plugins that are only created when their first packet or D-Bus call arrives
+    QHash<QString, PendingPluginObject *> m_pendingPlugins;
+    QVector<QStringList> m_pendingPluginsByIncomingType;
+
+    //Created by the first packet dispatched, which only happens once the device is trusted
+    PacketMetrics* m_metrics = nullptr;
+
+    PacketMetrics* metrics()
+    {
+        if (!m_metrics) {
+            m_metrics = PacketMetrics::device(m_deviceId);
+        }
+        return m_metrics;
+    }
+};
+
+/**
+ * Takes the D-Bus path of a plugin that loads on demand until the plugin is created.
+ * The first call creates it, the call is then passed on to the plugin and its reply sent back.
+ */
+class PendingPluginObject : public QDBusVirtualObject
+{
+public:
+    PendingPluginObject(Device* device, const QString& pluginName)
+        : QDBusVirtualObject(device)
+        , m_device(device)
+        , m_pluginName(pluginName)
+        //Plugins that load on demand have to use the usual path for the placeholder to work
+        , m_dbusPath(device->dbusPath() + QLatin1Char('/') + pluginName.mid(pluginName.indexOf(QLatin1Char('_')) + 1))
+        , m_libraryPath(PluginLoader::instance()->getPluginInfo(pluginName).fileName())
+    {
+        DbusHelper::sessionBus().registerVirtualObject(m_dbusPath, this);
+    }
+
+    QString dbusPath() const { return m_dbusPath; }
+
+    //Called from the D-Bus thread, the plugin can't be created here
+    QString introspect(const QString& path) const override
+    {
+        Q_UNUSED(path);
+        return PluginLoader::dbusIntrospection(m_pluginName, m_libraryPath);
+    }
+
+    bool handleMessage(const QDBusMessage& message, const QDBusConnection& connection) override
+    {
+        if (message.type() != QDBusMessage::MethodCallMessage) {
+            return false;
+        }
+
+        //Objects can't be registered while D-Bus is delivering a message. The device can be
+        //removed by the main thread before the call gets there.
+        message.setDelayedReply(true);
+        const QPointer<Device> device = m_device;
+        const QString pluginName = m_pluginName;
+        QTimer::singleShot(0, QCoreApplication::instance(), [device, pluginName, message, connection] {
+            if (!device || !device->loadPendingPlugin(pluginName)) {
+                connection.send(message.createErrorReply(QDBusError::UnknownObject, message.path()));
+                return;
+            }
+
+            QDBusMessage call = QDBusMessage::createMethodCall(connection.baseService(), message.path(), message.interface(), message.member());
+            call.setArguments(message.arguments());
+            QDBusPendingCallWatcher* watcher = new QDBusPendingCallWatcher(connection.asyncCall(call));
+            QObject::connect(watcher, &QDBusPendingCallWatcher::finished, [message, connection](QDBusPendingCallWatcher* watcher) {
+                const QDBusMessage reply = watcher->reply();
+                if (reply.type() == QDBusMessage::ErrorMessage) {
+                    connection.send(message.createErrorReply(reply.errorName(), reply.errorMessage()));
+                } else {
+                    connection.send(message.createReply(reply.arguments()));
+                }
+                watcher->deleteLater();
+            });
+        });
+        return true;
+    }
+
+private:
+    QPointer<Device> m_device;
+    QString m_pluginName;
+    QString m_dbusPath;
+    QString m_libraryPath;
 };
 
 static void warn(const QString& info)
@@ -148,39 +238,50 @@ QStringList Device::supportedPlugins() const
 
 bool Device::hasPlugin(const QString& name) const
 {
-    return d->m_plugins.contains(name);
+    //Plugins that load on demand count as loaded, they are created when used
+    return d->m_plugins.contains(name) || d->m_pendingPlugins.contains(name);
 }
 
 QStringList Device::loadedPlugins() const
 {
-    return d->m_plugins.keys();
+    return d->m_plugins.keys() + d->m_pendingPlugins.keys();
 }
 
 void Device::reloadPlugins()
 {
     QHash<QString, KdeConnectPlugin*> newPluginMap, oldPluginMap = d->m_plugins;
-    QMultiMap<QString, KdeConnectPlugin*> newPluginsByIncomingCapability;
+    QVector<QVector<KdeConnectPlugin*>> newPluginsByIncomingType(NetworkPacket::registeredTypes());
+    QSet<QString> newPendingPlugins;
+    const QStringList oldPendingPlugins = d->m_pendingPlugins.keys();
 
     if (isTrusted() && isReachable()) { //Do not load any plugin for unpaired devices, nor useless loading them for unreachable devices
 
         PluginLoader* loader = PluginLoader::instance();
 
         for (const QString& pluginName : qAsConst(d->m_supportedPlugins)) {
-            const KPluginMetaData service = loader->getPluginInfo(pluginName);
-
             const bool pluginEnabled = isPluginEnabled(pluginName);
-            const QSet<QString> incomingCapabilities = KPluginMetaData::readStringList(service.rawData(), QStringLiteral("X-KdeConnect-SupportedPacketType")).toSet();
+            const QStringList incomingCapabilities = loader->incomingCapabilities(pluginName);
 
             if (pluginEnabled) {
                 KdeConnectPlugin* plugin = d->m_plugins.take(pluginName);
 
+                //Still advertised, but not created until it's needed
+                if (!plugin && loader->loadsOnDemand(pluginName)) {
+                    newPendingPlugins.insert(pluginName);
+                    continue;
+                }
+
                 if (!plugin) {
                     plugin = loader->instantiatePluginForDevice(pluginName, this);
                 }
                 Q_ASSERT(plugin);
 
                 for (const QString& interface : incomingCapabilities) {
-                    newPluginsByIncomingCapability.insert(interface, plugin);
+                    const int typeId = NetworkPacket::registerType(interface);
+                    if (typeId >= newPluginsByIncomingType.size()) {
+                        newPluginsByIncomingType.resize(typeId + 1);
+                    }
+                    newPluginsByIncomingType[typeId].append(plugin);
                 }
 
                 newPluginMap[pluginName] = plugin;
@@ -188,13 +289,14 @@ void Device::reloadPlugins()
         }
     }
 
-    const bool differentPlugins = oldPluginMap != newPluginMap;
+    const bool differentPlugins = oldPluginMap != newPluginMap || oldPendingPlugins.toSet() != newPendingPlugins;
 
     //Erase all left plugins in the original map (meaning that we don't want
     //them anymore, otherwise they would have been moved to the newPluginMap)
     qDeleteAll(d->m_plugins);
     d->m_plugins = newPluginMap;
-    d->m_pluginsByIncomingCapability = newPluginsByIncomingCapability;
+    d->m_pluginsByIncomingType = newPluginsByIncomingType;
+    setPendingPlugins(newPendingPlugins);
 
     QDBusConnection bus = DbusHelper::sessionBus();
     for (KdeConnectPlugin* plugin : qAsConst(d->m_plugins)) {
@@ -294,6 +396,8 @@ void Device::addLink(const NetworkPacket& identityPacket, DeviceLink* link)
 
     connect(link, &DeviceLink::receivedPacket,
             this, &Device::privateReceivedPacket);
+    connect(link, &DeviceLink::receivedPackets,
+            this, &Device::privateReceivedPackets);
 
     std::sort(d->m_deviceLinks.begin(), d->m_deviceLinks.end(), lessThan);
 
@@ -395,17 +499,105 @@ bool Device::sendPacket(NetworkPacket& np)
     return false;
 }
 
+void Device::setPendingPlugins(const QSet<QString>& pluginNames)
+{
+    for (auto it = d->m_pendingPlugins.begin(); it != d->m_pendingPlugins.end();) {
+        if (pluginNames.contains(it.key())) {
+            ++it;
+        } else {
+            DbusHelper::sessionBus().unregisterObject(it.value()->dbusPath());
+            it.value()->deleteLater();
+            it = d->m_pendingPlugins.erase(it);
+        }
+    }
+
+    d->m_pendingPluginsByIncomingType.clear();
+    PluginLoader* loader = PluginLoader::instance();
+    for (const QString& pluginName : pluginNames) {
+        if (!d->m_pendingPlugins.contains(pluginName)) {
+            d->m_pendingPlugins.insert(pluginName, new PendingPluginObject(this, pluginName));
+        }
+        const QStringList incomingCapabilities = loader->incomingCapabilities(pluginName);
+        for (const QString& interface : incomingCapabilities) {
+            const int typeId = NetworkPacket::registerType(interface);
+            if (typeId >= d->m_pendingPluginsByIncomingType.size()) {
+                d->m_pendingPluginsByIncomingType.resize(typeId + 1);
+            }
+            d->m_pendingPluginsByIncomingType[typeId].append(pluginName);
+        }
+    }
+}
+
+KdeConnectPlugin* Device::loadPendingPlugin(const QString& pluginName)
+{
+    PendingPluginObject* pendingObject = d->m_pendingPlugins.take(pluginName);
+    if (!pendingObject) {
+        return d->m_plugins.value(pluginName);
+    }
+    DbusHelper::sessionBus().unregisterObject(pendingObject->dbusPath());
+    pendingObject->deleteLater();
+    for (QStringList& pluginNames : d->m_pendingPluginsByIncomingType) {
+        pluginNames.removeOne(pluginName);
+    }
+
+    qCDebug(KDECONNECT_CORE) << "Loading" << pluginName << "on demand for" << name();
+    KdeConnectPlugin* plugin = PluginLoader::instance()->instantiatePluginForDevice(pluginName, this);
+    if (!plugin) {
+        return nullptr;
+    }
+    d->m_plugins[pluginName] = plugin;
+
+    const QStringList incomingCapabilities = PluginLoader::instance()->incomingCapabilities(pluginName);
+    for (const QString& interface : incomingCapabilities) {
+        const int typeId = NetworkPacket::registerType(interface);
+        if (typeId >= d->m_pluginsByIncomingType.size()) {
+            d->m_pluginsByIncomingType.resize(typeId + 1);
+        }
+        d->m_pluginsByIncomingType[typeId].append(plugin);
+    }
+
+    plugin->connected();
+    const QString dbusPath = plugin->dbusPath();
+    if (!dbusPath.isEmpty()) {
+        DbusHelper::sessionBus().registerObject(dbusPath, plugin, QDBusConnection::ExportAllProperties | QDBusConnection::ExportScriptableInvokables | QDBusConnection::ExportScriptableSignals | QDBusConnection::ExportScriptableSlots);
+    }
+    return plugin;
+}
+
+QVector<KdeConnectPlugin*> Device::pluginsForPacket(const NetworkPacket& np)
+{
+    int typeId = np.typeId();
+    if (typeId < 0) {
+        //Decoded before the plugins registered their packet types
+        typeId = NetworkPacket::typeIdOf(np.type());
+    }
+
+    //The first packet for a plugin that loads on demand creates it
+    const QStringList pendingPlugins = d->m_pendingPluginsByIncomingType.value(typeId);
+    for (const QString& pluginName : pendingPlugins) {
+        loadPendingPlugin(pluginName);
+    }
+
+    return d->m_pluginsByIncomingType.value(typeId);
+}
+
 void Device::privateReceivedPacket(const NetworkPacket& np)
 {
     Q_ASSERT(np.type() != PACKET_TYPE_PAIR);
     if (isTrusted()) {
-        const QList<KdeConnectPlugin*> plugins = d->m_pluginsByIncomingCapability.values(np.type());
+        const QVector<KdeConnectPlugin*> plugins = pluginsForPacket(np);
         if (plugins.isEmpty()) {
             qWarning() << "discarding unsupported packet" << np.type() << "for" << name();
         }
+        QElapsedTimer dispatchTimer;
+        dispatchTimer.start();
         for (KdeConnectPlugin* plugin : plugins) {
+            PacketMetrics* pluginMetrics = plugin->metrics();
+            const qint64 pluginStart = dispatchTimer.nsecsElapsed();
             plugin->receivePacket(np);
+            pluginMetrics->packetDispatched(np.typeId(), dispatchTimer.nsecsElapsed() - pluginStart);
         }
+        d->metrics()->packetDispatched(np.typeId(), dispatchTimer.nsecsElapsed());
     } else {
         qCDebug(KDECONNECT_CORE) << "device" << name() << "not paired, ignoring packet" << np.type();
         unpair();
@@ -413,9 +605,53 @@ void Device::privateReceivedPacket(const NetworkPacket& np)
 
 }
 
+void Device::privateReceivedPackets(const QVector<NetworkPacket>& packets)
+{
+    //Consecutive packets of the same type go to their plugins together, so the order is kept
+    int runStart = 0;
+    while (runStart < packets.size()) {
+        const QString& type = packets[runStart].type();
+        const int typeId = packets[runStart].typeId();
+        Q_ASSERT(type != PACKET_TYPE_PAIR);
+
+        int runEnd = runStart + 1;
+        while (runEnd < packets.size()
+               && (typeId >= 0 ? packets[runEnd].typeId() == typeId : packets[runEnd].type() == type)) {
+            ++runEnd;
+        }
+
+        //Checked for every run, since a plugin could have unpaired the device
+        if (!isTrusted()) {
+            qCDebug(KDECONNECT_CORE) << "device" << name() << "not paired, ignoring packet" << type;
+            unpair();
+            return;
+        }
+
+        const QVector<KdeConnectPlugin*> plugins = pluginsForPacket(packets[runStart]);
+        if (plugins.isEmpty()) {
+            qWarning() << "discarding unsupported packet" << type << "for" << name();
+        } else {
+            const bool wholeBatch = (runStart == 0 && runEnd == packets.size());
+            const QVector<NetworkPacket> run = wholeBatch ? packets : packets.mid(runStart, runEnd - runStart);
+            //A run is recorded as one dispatch, since plugins handle it as one
+            QElapsedTimer dispatchTimer;
+            dispatchTimer.start();
+            for (KdeConnectPlugin* plugin : plugins) {
+                PacketMetrics* pluginMetrics = plugin->metrics();
+                const qint64 pluginStart = dispatchTimer.nsecsElapsed();
+                plugin->receivePackets(run);
+                pluginMetrics->packetDispatched(typeId, dispatchTimer.nsecsElapsed() - pluginStart);
+            }
+            d->metrics()->packetDispatched(typeId, dispatchTimer.nsecsElapsed());
+        }
+
+        runStart = runEnd;
+    }
+}
+
 bool Device::isTrusted() const
 {
-    return KdeConnectConfig::instance()->trustedDevices().contains(id());
+    return KdeConnectConfig::instance()->isTrustedDevice(id());
 }
 
 QStringList Device::availableLinks() const
@@ -506,8 +742,11 @@ void Device::setName(const QString& name)
     }
 }
 
-KdeConnectPlugin* Device::plugin(const QString& pluginName) const
+KdeConnectPlugin* Device::plugin(const QString& pluginName)
 {
+    if (d->m_pendingPlugins.contains(pluginName)) {
+        return loadPendingPlugin(pluginName);
+    }
     return d->m_plugins[pluginName];
 }
 
@@ -557,8 +796,11 @@ QString Device::encryptionInfo() const
 
 QString Device::pluginIconName(const QString& pluginName)
 {
-    if (hasPlugin(pluginName)) {
+    if (d->m_plugins.contains(pluginName)) {
         return d->m_plugins[pluginName]->iconName();
     }
+    if (d->m_pendingPlugins.contains(pluginName)) {
+        return PluginLoader::instance()->getPluginInfo(pluginName).iconName();
+    }
     return QString();
 }
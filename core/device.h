@@ -30,6 +30,7 @@
 
 class DeviceLink;
 class KdeConnectPlugin;
+class PendingPluginObject;
 
 class KDECONNECTCORE_EXPORT Device
     : public QObject
@@ -94,7 +95,8 @@ public:
 
     Q_SCRIPTABLE QString pluginsConfigFile() const;
 
-    KdeConnectPlugin* plugin(const QString& pluginName) const;
+    //Creates the plugin first if it loads on demand and nothing needed it yet
+    KdeConnectPlugin* plugin(const QString& pluginName);
     Q_SCRIPTABLE void setPluginEnabled(const QString& pluginName, bool enabled);
     Q_SCRIPTABLE bool isPluginEnabled(const QString& pluginName) const;
 
@@ -123,6 +125,7 @@ public Q_SLOTS:
     Q_SCRIPTABLE QString pluginIconName(const QString& pluginName);
 private Q_SLOTS:
     void privateReceivedPacket(const NetworkPacket& np);
+    void privateReceivedPackets(const QVector<NetworkPacket>& packets);
     void linkDestroyed(QObject* o);
     void pairStatusChanged(DeviceLink::PairStatus current);
     void addPairingRequest(PairingHandler* handler);
@@ -143,6 +146,11 @@ private: //Methods
 
     void setName(const QString& name);
     QString iconForStatus(bool reachable, bool paired) const;
+    QVector<KdeConnectPlugin*> pluginsForPacket(const NetworkPacket& np);
+    KdeConnectPlugin* loadPendingPlugin(const QString& pluginName);
+    void setPendingPlugins(const QSet<QString>& pluginNames);
+
+    friend class PendingPluginObject;
 
 private:
     class DevicePrivate;
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef FILESTAMP_H
+#define FILESTAMP_H
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+//Tells whether a file was written since it was last looked at. QSettings writes a new file
+//and renames it over the old one, so on Unix every write gives it a new inode, even when
+//the size and modification time (in milliseconds) stay the same
+struct FileStamp
+{
+    qint64 size = -1;
+    QDateTime modified;
+    quint64 inode = 0;
+
+    static FileStamp of(const QString& fileName)
+    {
+        const QFileInfo file(fileName);
+        FileStamp stamp;
+        stamp.size = file.exists() ? file.size() : -1;
+        stamp.modified = file.lastModified();
+#ifdef Q_OS_UNIX
+        struct stat st;
+        if (::stat(QFile::encodeName(fileName).constData(), &st) == 0) {
+            stamp.inode = st.st_ino;
+        }
+#endif
+        return stamp;
+    }
+
+    bool operator==(const FileStamp& other) const
+    {
+        return size == other.size && modified == other.modified && inode == other.inode;
+    }
+
+    bool operator!=(const FileStamp& other) const
+    {
+        return !(*this == other);
+    }
+};
+
+#endif
@@ -24,15 +24,32 @@
 #include <core_debug.h>
 
 #include <qalgorithms.h>
+#include <QDateTime>
+#include <QDir>
 #include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTimer>
 #include <QDebug>
 
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
 #include <KLocalizedString>
 
 FileTransferJob::FileTransferJob(const NetworkPacket* np, const QUrl& destination)
     : KJob()
     , m_origin(np->payload())
     , m_reply(nullptr)
+    , m_file(nullptr)
+    , m_hash(QCryptographicHash::Sha256)
+    , m_resumable(np->payloadTransferInfo().value(QStringLiteral("resumable")).toBool())
+    , m_lastModified(np->get<qint64>(QStringLiteral("lastModified"), -1))
+    , m_verifyDigest(false)
+    , m_awaitingDigest(false)
     , m_from(QStringLiteral("KDE Connect"))
     , m_destination(destination)
     , m_speedBytes(0)
@@ -47,6 +64,9 @@ FileTransferJob::FileTransferJob(const NetworkPacket* np, const QUrl& destinatio
         qCWarning(KDECONNECT_CORE) << "Destination QUrl" << m_destination << "lacks a scheme. Setting its scheme to 'file'.";
         m_destination.setScheme(QStringLiteral("file"));
     }
+    //Only what we write ourselves can be hashed on the way
+    m_verifyDigest = m_destination.isLocalFile()
+        && np->payloadTransferInfo().value(QStringLiteral("digest")).toString() == QLatin1String("sha256");
 
     setCapabilities(Killable);
     qCDebug(KDECONNECT_CORE) << "FileTransferJob Downloading payload to" << destination << "size:" << m_size;
@@ -67,7 +87,8 @@ void FileTransferJob::doStart()
         return;
     }
 
-    if (m_origin->bytesAvailable())
+    //The sender of a resumable payload waits to be told where to start from
+    if (m_origin->bytesAvailable() || m_resumable)
         startTransfer();
     connect(m_origin.data(), &QIODevice::readyRead, this, &FileTransferJob::startTransfer);
 }
@@ -75,14 +96,25 @@ void FileTransferJob::doStart()
 void FileTransferJob::startTransfer()
 {
     // Don't put each ready read
-    if (m_reply)
+    if (m_reply || m_file)
         return;
 
     setProcessedAmount(Bytes, 0);
+    if (m_size >= 0) {
+        setTotalAmount(Bytes, m_size);
+    }
+
+    if (m_destination.isLocalFile()) {
+        startLocalTransfer();
+        return;
+    }
+
+    if (m_resumable) {
+        sendResumeOffset(0);
+    }
 
     QNetworkRequest req(m_destination);
     if (m_size >= 0) {
-        setTotalAmount(Bytes, m_size);
         req.setHeader(QNetworkRequest::ContentLengthHeader, m_size);
     }
     m_reply = Daemon::instance()->networkAccessManager()->put(req, m_origin.data());
@@ -104,6 +136,293 @@ void FileTransferJob::startTransfer()
     connect(m_reply, &QNetworkReply::finished, this, &FileTransferJob::transferFinished);
 }
 
+void FileTransferJob::startLocalTransfer()
+{
+    //The data goes to a ".part" file next to the destination, which is only renamed into place once complete
+    const qint64 offset = m_resumable ? resumeOffset() : 0;
+    QFile::remove(resumeFileName());
+
+    m_file = new QFile(partFileName(), this);
+    const QIODevice::OpenMode mode = (offset > 0) ? QIODevice::ReadWrite : (QIODevice::WriteOnly | QIODevice::Truncate);
+    if (!m_file->open(mode | QIODevice::Unbuffered) || !m_file->resize(offset) || !m_file->seek(offset)) {
+        localTransferFailed(m_file->errorString());
+        return;
+    }
+
+#ifdef Q_OS_LINUX
+    //Reserve the whole file upfront, so it isn't fragmented and we fail early if it doesn't fit
+    if (m_size > offset) {
+        const int ret = posix_fallocate(m_file->handle(), offset, m_size - offset);
+        if (ret == ENOSPC) {
+            localTransferFailed(QString::fromLocal8Bit(strerror(ret)));
+            return;
+        }
+    }
+#endif
+
+    if (m_resumable) {
+        sendResumeOffset(offset);
+    }
+    m_written = offset;
+
+    m_buffer.resize(64 * 1024);
+    connect(m_origin.data(), &QIODevice::readyRead, this, &FileTransferJob::readLocalData);
+    connect(m_origin.data(), &QIODevice::readChannelFinished, this, &FileTransferJob::originFinished);
+    readLocalData();
+}
+
+void FileTransferJob::sendResumeOffset(qint64 offset)
+{
+    if (offset > 0) {
+        qCDebug(KDECONNECT_CORE) << "Resuming transfer to" << m_destination << "from" << offset;
+    }
+    QJsonObject reply;
+    reply.insert(QStringLiteral("resumeOffset"), offset);
+    m_origin->write(QJsonDocument(reply).toJson(QJsonDocument::Compact) + '\n');
+}
+
+qint64 FileTransferJob::resumeOffset()
+{
+    //Without the sender's modification time another file with the same name and size could be taken for this one
+    if (m_lastModified < 0) {
+        return 0;
+    }
+
+    //The ".resume" file left by an interrupted transfer describes how much of the ".part" file can be kept
+    QFile resumeFile(resumeFileName());
+    if (!resumeFile.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    const QJsonObject state = QJsonDocument::fromJson(resumeFile.readAll()).object();
+    const qint64 offset = static_cast<qint64>(state.value(QStringLiteral("offset")).toDouble());
+    if (offset <= 0 || offset > m_size
+        || static_cast<qint64>(state.value(QStringLiteral("payloadSize")).toDouble()) != m_size
+        || static_cast<qint64>(state.value(QStringLiteral("lastModified")).toDouble()) != m_lastModified) {
+        return 0;
+    }
+
+    //Only trust what is on disk if it still is what we wrote
+    QFile partFile(partFileName());
+    if (!partFile.open(QIODevice::ReadOnly) || partFile.size() < offset) {
+        return 0;
+    }
+    m_hash.reset();
+    qint64 remaining = offset;
+    m_buffer.resize(64 * 1024);
+    while (remaining > 0) {
+        const qint64 bytesRead = partFile.read(m_buffer.data(), qMin<qint64>(remaining, m_buffer.size()));
+        if (bytesRead <= 0) {
+            break;
+        }
+        m_hash.addData(m_buffer.constData(), static_cast<int>(bytesRead));
+        remaining -= bytesRead;
+    }
+    if (remaining > 0 || m_hash.result().toHex() != state.value(QStringLiteral("sha256")).toString().toLatin1()) {
+        qCDebug(KDECONNECT_CORE) << "Partial file" << partFileName() << "changed, starting over";
+        m_hash.reset();
+        return 0;
+    }
+
+    return offset;
+}
+
+void FileTransferJob::readLocalData()
+{
+    if (!m_file)
+        return;
+
+    while (m_origin->bytesAvailable() > 0) {
+        const qint64 bytesRead = m_origin->read(m_buffer.data(), m_buffer.size());
+        if (bytesRead <= 0)
+            break;
+
+        if (m_file->write(m_buffer.constData(), bytesRead) != bytesRead) {
+            localTransferFailed(m_file->errorString());
+            return;
+        }
+        if (m_resumable || m_verifyDigest) {
+            m_hash.addData(m_buffer.constData(), static_cast<int>(bytesRead));
+        }
+        m_written += bytesRead;
+    }
+
+    if (!m_timer.isValid())
+        m_timer.start();
+    setProcessedAmount(Bytes, m_written);
+
+    const auto elapsed = m_timer.elapsed();
+    if (elapsed > 0) {
+        emitSpeed((1000 * m_written) / elapsed);
+    }
+
+    //Sockets tell us they are done through readChannelFinished, other devices are done once read completely
+    if ((m_size >= 0 && m_written >= m_size) || (!m_origin->isSequential() && m_origin->atEnd())) {
+        finishLocalTransfer();
+    }
+}
+
+void FileTransferJob::originFinished()
+{
+    //Whatever is still buffered in the origin is read before finishing
+    readLocalData();
+    if (m_file) {
+        finishLocalTransfer();
+    }
+}
+
+void FileTransferJob::finishLocalTransfer()
+{
+    if (m_awaitingDigest)
+        return;
+
+    disconnect(m_origin.data(), nullptr, this, nullptr);
+
+    if (m_size >= 0 && m_written != m_size) {
+        if (m_resumable && m_lastModified >= 0 && m_written < m_size) {
+            qCDebug(KDECONNECT_CORE) << "Received incomplete file ("<< m_written << "/" << m_size << "bytes ), keeping it to resume later";
+            keepPartialFile();
+        } else {
+            qCDebug(KDECONNECT_CORE) << "Received incomplete file ("<< m_written << "/" << m_size << "bytes ), discarding";
+            discardLocalFile();
+        }
+
+        setError(3);
+        setErrorText(i18n("Received incomplete file from: %1", m_from));
+        emitResult();
+        return;
+    }
+
+    m_file->close();
+    if (m_verifyDigest && m_expectedDigest.isEmpty()) {
+        //The digest comes in a packet of its own, which can arrive after the data
+        m_awaitingDigest = true;
+        QTimer::singleShot(DIGEST_TIMEOUT, this, &FileTransferJob::digestTimeout);
+        return;
+    }
+    commitLocalFile();
+}
+
+void FileTransferJob::setExpectedDigest(const QByteArray& digest)
+{
+    if (!m_verifyDigest)
+        return;
+
+    m_expectedDigest = digest.toLower();
+    if (m_awaitingDigest) {
+        commitLocalFile();
+    }
+}
+
+void FileTransferJob::digestTimeout()
+{
+    if (m_awaitingDigest) {
+        qCWarning(KDECONNECT_CORE) << "No digest received for" << m_destination << ", keeping it unverified";
+        commitLocalFile();
+    }
+}
+
+void FileTransferJob::commitLocalFile()
+{
+    m_awaitingDigest = false;
+
+    if (!m_expectedDigest.isEmpty() && m_hash.result().toHex() != m_expectedDigest) {
+        qCWarning(KDECONNECT_CORE) << "Received file" << m_destination << "doesn't match its digest, discarding";
+        discardLocalFile();
+
+        setError(DigestMismatch);
+        setErrorText(i18n("Received corrupted file from: %1", m_from));
+        emitResult();
+        return;
+    }
+
+    if (!m_file->rename(m_destination.toLocalFile())) {
+        localTransferFailed(m_file->errorString());
+        return;
+    }
+
+    delete m_file;
+    m_file = nullptr;
+
+    qCDebug(KDECONNECT_CORE) << "Finished transfer" << m_destination;
+    emitResult();
+}
+
+void FileTransferJob::localTransferFailed(const QString& errorString)
+{
+    qCDebug(KDECONNECT_CORE) << "Couldn't write" << m_destination << errorString;
+    disconnect(m_origin.data(), nullptr, this, nullptr);
+    discardLocalFile();
+
+    setError(WriteError);
+    setErrorText(i18n("Could not write to %1: %2", m_destination.toLocalFile(), errorString));
+    emitResult();
+}
+
+void FileTransferJob::discardLocalFile()
+{
+    //The destination itself is never touched before the transfer is complete
+    m_file->remove();
+    delete m_file;
+    m_file = nullptr;
+    QFile::remove(resumeFileName());
+}
+
+void FileTransferJob::keepPartialFile()
+{
+    m_file->close();
+    if (!m_file->resize(m_written)) {
+        discardLocalFile();
+        return;
+    }
+    delete m_file;
+    m_file = nullptr;
+
+    QJsonObject state;
+    state.insert(QStringLiteral("offset"), m_written);
+    state.insert(QStringLiteral("payloadSize"), m_size);
+    state.insert(QStringLiteral("lastModified"), m_lastModified);
+    state.insert(QStringLiteral("sha256"), QString::fromLatin1(m_hash.result().toHex()));
+
+    QFile resumeFile(resumeFileName());
+    if (!resumeFile.open(QIODevice::WriteOnly | QIODevice::Truncate)
+        || resumeFile.write(QJsonDocument(state).toJson(QJsonDocument::Compact)) < 0) {
+        qCWarning(KDECONNECT_CORE) << "Couldn't save the state of" << partFileName() << resumeFile.errorString();
+    }
+
+    //Resuming the transfer removes the ".resume" file, so this only finds it if the sender gave up
+    const QString dir = QFileInfo(partFileName()).absolutePath();
+    QTimer::singleShot(PARTIAL_FILE_EXPIRY + 1000, [dir] {
+        removeExpiredPartialFiles(dir);
+    });
+}
+
+void FileTransferJob::removeExpiredPartialFiles(const QString& dir, qint64 maxAge)
+{
+    //A ".part" file without its ".resume" file belongs to a transfer that is still running
+    const QDateTime expiry = QDateTime::currentDateTime().addMSecs(-maxAge);
+    const QFileInfoList resumeFiles = QDir(dir).entryInfoList({QStringLiteral("*.part.resume")}, QDir::Files | QDir::Hidden);
+    for (const QFileInfo& resumeFile : resumeFiles) {
+        if (resumeFile.lastModified() > expiry) {
+            continue;
+        }
+        QString partFile = resumeFile.absoluteFilePath();
+        partFile.chop(QStringLiteral(".resume").size());
+        qCDebug(KDECONNECT_CORE) << "Removing expired partial file" << partFile;
+        QFile::remove(partFile);
+        QFile::remove(resumeFile.absoluteFilePath());
+    }
+}
+
+QString FileTransferJob::partFileName() const
+{
+    return m_destination.toLocalFile() + QStringLiteral(".part");
+}
+
+QString FileTransferJob::resumeFileName() const
+{
+    return partFileName() + QStringLiteral(".resume");
+}
+
 void FileTransferJob::transferFailed(QNetworkReply::NetworkError error)
 {
     qCDebug(KDECONNECT_CORE) << "Couldn't transfer the file successfully" << error << m_reply->errorString();
@@ -116,7 +435,7 @@ void FileTransferJob::transferFailed(QNetworkReply::NetworkError error)
 
 void FileTransferJob::transferFinished()
 {
-    //TODO: MD5-check the file
+    //Remote destinations are not hashed, only local ones are checked against the sender's digest
     if (m_size == m_written) {
         qCDebug(KDECONNECT_CORE) << "Finished transfer" << m_destination;
         emitResult();
@@ -143,11 +462,16 @@ bool FileTransferJob::doKill()
     if (m_reply) {
         m_reply->close();
     }
+    if (m_file) {
+        disconnect(m_origin.data(), nullptr, this, nullptr);
+        discardLocalFile();
+    } else {
+        deleteDestinationFile();
+    }
+
     if (m_origin) {
         m_origin->close();
     }
 
-    deleteDestinationFile();
-
     return true;
 }
@@ -24,6 +24,7 @@
 
 #include <KJob>
 
+#include <QCryptographicHash>
 #include <QElapsedTimer>
 #include <QIODevice>
 #include <QSharedPointer>
@@ -33,11 +34,19 @@
 #include "kdeconnectcore_export.h"
 
 class NetworkPacket;
+class QFile;
 /**
  * @short It will stream a device into a url destination
  *
  * Given a QIODevice, the file transfer job will use the system's QNetworkAccessManager
- * for putting the stream into the requested location.
+ * for putting the stream into the requested location. Local destinations are written
+ * directly instead, to a ".part" file that is renamed to the destination once complete.
+ *
+ * When the sender supports it, an interrupted transfer keeps its ".part" file and the
+ * next transfer of the same file to the same destination continues where it stopped.
+ *
+ * If the sender announces a digest, local destinations are hashed as they are written
+ * and only renamed into place once the digest passed to setExpectedDigest() matches.
  */
 class KDECONNECTCORE_EXPORT FileTransferJob
     : public KJob
@@ -55,21 +64,51 @@ public:
     QUrl destination() const { return m_destination; }
     void setOriginName(const QString& from) { m_from = from; }
     const NetworkPacket* networkPacket() { return m_np;}
+    //Hex encoded SHA-256 of the whole payload, as sent by the other end after the data
+    void setExpectedDigest(const QByteArray& digest);
+    //Removes the partial files of interrupted transfers in @p dir that were left longer than @p maxAge ms ago
+    static void removeExpiredPartialFiles(const QString& dir, qint64 maxAge = PARTIAL_FILE_EXPIRY);
 
 private Q_SLOTS:
     void doStart();
+    void readLocalData();
+    void originFinished();
+    void digestTimeout();
 
 protected:
     bool doKill() override;
 
 private:
+    enum {
+        WriteError = UserDefinedError,
+        DigestMismatch,
+    };
+
     void startTransfer();
+    void startLocalTransfer();
     void transferFailed(QNetworkReply::NetworkError error);
     void transferFinished();
+    void localTransferFailed(const QString& errorString);
+    void finishLocalTransfer();
+    void commitLocalFile();
+    void discardLocalFile();
+    void keepPartialFile();
+    qint64 resumeOffset();
+    void sendResumeOffset(qint64 offset);
+    QString partFileName() const;
+    QString resumeFileName() const;
     void deleteDestinationFile();
 
     QSharedPointer<QIODevice> m_origin;
     QNetworkReply* m_reply;
+    QFile* m_file;
+    QCryptographicHash m_hash;
+    bool m_resumable;
+    qint64 m_lastModified;
+    bool m_verifyDigest;
+    bool m_awaitingDigest;
+    QByteArray m_expectedDigest;
+    QByteArray m_buffer;
     QString m_from;
     QUrl m_destination;
     QElapsedTimer m_timer;
@@ -77,6 +116,11 @@ private:
     qint64 m_written;
     qint64 m_size;
     const NetworkPacket* m_np;
+
+    //How long a complete file waits for its digest before it is kept unverified
+    const static int DIGEST_TIMEOUT = 30 * 1000;
+    //The sender forgets an interrupted transfer 30 seconds after losing the link, its partial file is useless after that
+    const static int PARTIAL_FILE_EXPIRY = 60 * 1000;
 };
 
 #endif
@@ -25,6 +25,8 @@
 #include <QFile>
 #include <QDebug>
 #include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QHash>
 #include <QUuid>
 #include <QDir>
 #include <QStandardPaths>
@@ -34,13 +36,25 @@
 #include <QSslCertificate>
 #include <QtCrypto>
 #include <QThread>
+#include <QTimer>
 
 #include "core_debug.h"
 #include "dbushelper.h"
+#include "filestamp.h"
 #include "daemon.h"
+#include "startupprofiler.h"
 
 const QFile::Permissions strictPermissions = QFile::ReadOwner | QFile::WriteOwner | QFile::ReadUser | QFile::WriteUser;
 
+//The config can be loaded on the daemon's startup thread, errors are reported from the main thread
+static void reportError(const QString& title, const QString& description)
+{
+    Daemon* daemon = Daemon::instance();
+    QTimer::singleShot(0, daemon, [daemon, title, description] {
+        daemon->reportError(title, description);
+    });
+}
+
 struct KdeConnectConfigPrivate {
 
     // The Initializer object sets things up, and also does cleanup when it goes out of scope
@@ -53,6 +67,13 @@ struct KdeConnectConfigPrivate {
     QSettings* m_config;
     QSettings* m_trustedDevices;
 
+    //Properties of every trusted device, so looking them up doesn't go through QSettings
+    QHash<QString, QHash<QString, QString>> m_trustedDeviceIndex;
+    bool m_trustedDeviceIndexLoaded = false;
+    //Only changes made by other processes invalidate the index
+    QFileSystemWatcher m_trustedDevicesWatcher;
+    FileStamp m_trustedDevicesStamp;
+
 #ifdef USE_PRIVATE_DBUS
     QString m_privateDBusAddress;  // Private DBus Address cache
 #endif
@@ -70,7 +91,7 @@ KdeConnectConfig::KdeConnectConfig()
     //qCDebug(KDECONNECT_CORE) << "QCA supported capabilities:" << QCA::supportedFeatures().join(",");
     if(!QCA::isSupported("rsa")) {
         qCritical() << "Could not find support for RSA in your QCA installation";
-        Daemon::instance()->reportError(
+        reportError(
                              i18n("KDE Connect failed to start"),
                              i18n("Could not find support for RSA in your QCA installation. If your "
                                   "distribution provides separate packets for QCA-ossl and QCA-gnupg, "
@@ -84,8 +105,23 @@ KdeConnectConfig::KdeConnectConfig()
     d->m_config = new QSettings(baseConfigDir().absoluteFilePath(QStringLiteral("config")), QSettings::IniFormat);
     d->m_trustedDevices = new QSettings(baseConfigDir().absoluteFilePath(QStringLiteral("trusted_devices")), QSettings::IniFormat);
 
+    syncTrustedDevices();
+    //QSettings replaces the file when saving it, so the directory is watched instead
+    d->m_trustedDevicesWatcher.addPath(baseConfigDir().path());
+    QObject::connect(&d->m_trustedDevicesWatcher, &QFileSystemWatcher::directoryChanged, [this] {
+        trustedDevicesChanged();
+    });
+
     loadPrivateKey();
     loadCertificate();
+
+    //Everything but loading happens on the main thread
+    QThread* mainThread = QCoreApplication::instance() ? QCoreApplication::instance()->thread() : nullptr;
+    if (mainThread && QThread::currentThread() != mainThread) {
+        d->m_config->moveToThread(mainThread);
+        d->m_trustedDevices->moveToThread(mainThread);
+        d->m_trustedDevicesWatcher.moveToThread(mainThread);
+    }
 }
 
 QString KdeConnectConfig::name()
@@ -107,6 +143,17 @@ void KdeConnectConfig::setName(const QString& name)
     d->m_config->sync();
 }
 
+int KdeConnectConfig::parallelUploads()
+{
+    return d->m_config->value(QStringLiteral("parallelUploads"), 4).toInt();
+}
+
+void KdeConnectConfig::setParallelUploads(int parallelUploads)
+{
+    d->m_config->setValue(QStringLiteral("parallelUploads"), parallelUploads);
+    d->m_config->sync();
+}
+
 QString KdeConnectConfig::deviceType()
 {
     return QStringLiteral("desktop"); // TODO
@@ -141,59 +188,122 @@ QDir KdeConnectConfig::baseConfigDir()
 
 QStringList KdeConnectConfig::trustedDevices()
 {
-    const QStringList& list = d->m_trustedDevices->childGroups();
+    loadTrustedDevices();
+    QStringList list = d->m_trustedDeviceIndex.keys();
+    //Same order as QSettings::childGroups()
+    list.sort();
     return list;
 }
 
+bool KdeConnectConfig::isTrustedDevice(const QString& id)
+{
+    loadTrustedDevices();
+    return d->m_trustedDeviceIndex.contains(id);
+}
 
 void KdeConnectConfig::addTrustedDevice(const QString& id, const QString& name, const QString& type)
 {
+    loadTrustedDevices();
     d->m_trustedDevices->beginGroup(id);
     d->m_trustedDevices->setValue(QStringLiteral("name"), name);
     d->m_trustedDevices->setValue(QStringLiteral("type"), type);
     d->m_trustedDevices->endGroup();
-    d->m_trustedDevices->sync();
+    syncTrustedDevices();
+
+    QHash<QString, QString>& properties = d->m_trustedDeviceIndex[id];
+    properties.insert(QStringLiteral("name"), name);
+    properties.insert(QStringLiteral("type"), type);
 
     QDir().mkpath(deviceConfigDir(id).path());
 }
 
 KdeConnectConfig::DeviceInfo KdeConnectConfig::getTrustedDevice(const QString& id)
 {
-    d->m_trustedDevices->beginGroup(id);
+    loadTrustedDevices();
+    const QHash<QString, QString> properties = d->m_trustedDeviceIndex.value(id);
 
     KdeConnectConfig::DeviceInfo info;
-    info.deviceName = d->m_trustedDevices->value(QStringLiteral("name"), QLatin1String("unnamed")).toString();
-    info.deviceType = d->m_trustedDevices->value(QStringLiteral("type"), QLatin1String("unknown")).toString();
-
-    d->m_trustedDevices->endGroup();
+    info.deviceName = properties.value(QStringLiteral("name"), QStringLiteral("unnamed"));
+    info.deviceType = properties.value(QStringLiteral("type"), QStringLiteral("unknown"));
     return info;
 }
 
 void KdeConnectConfig::removeTrustedDevice(const QString& deviceId)
 {
+    loadTrustedDevices();
     d->m_trustedDevices->remove(deviceId);
-    d->m_trustedDevices->sync();
-    //We do not remove the config files.
+    syncTrustedDevices();
+    const bool wasTrusted = d->m_trustedDeviceIndex.remove(deviceId) > 0;
+    //We do not remove the config files, but the data, like messages, must not outlive the pairing.
+    //Ids come from the network, so nothing but a directory of its own is removed
+    const QString dataDirName = deviceDataDir(deviceId).dirName();
+    if (wasTrusted && dataDirName == deviceId && dataDirName != QLatin1String(".") && dataDirName != QLatin1String("..")) {
+        deviceDataDir(deviceId).removeRecursively();
+    }
 }
 
 // Utility functions to set and get a value
 void KdeConnectConfig::setDeviceProperty(const QString& deviceId, const QString& key, const QString& value)
 {
+    loadTrustedDevices();
     d->m_trustedDevices->beginGroup(deviceId);
     d->m_trustedDevices->setValue(key, value);
     d->m_trustedDevices->endGroup();
-    d->m_trustedDevices->sync();
+    syncTrustedDevices();
+    d->m_trustedDeviceIndex[deviceId].insert(key, value);
 }
 
 QString KdeConnectConfig::getDeviceProperty(const QString& deviceId, const QString& key, const QString& defaultValue)
 {
-    QString value;
-    d->m_trustedDevices->beginGroup(deviceId);
-    value = d->m_trustedDevices->value(key, defaultValue).toString();
-    d->m_trustedDevices->endGroup();
-    return value;
+    loadTrustedDevices();
+    const auto device = d->m_trustedDeviceIndex.constFind(deviceId);
+    if (device == d->m_trustedDeviceIndex.constEnd()) {
+        return defaultValue;
+    }
+    return device->value(key, defaultValue);
+}
+
+void KdeConnectConfig::loadTrustedDevices()
+{
+    if (d->m_trustedDeviceIndexLoaded) {
+        return;
+    }
+
+    d->m_trustedDeviceIndex.clear();
+    const QStringList ids = d->m_trustedDevices->childGroups();
+    for (const QString& id : ids) {
+        d->m_trustedDevices->beginGroup(id);
+        QHash<QString, QString>& properties = d->m_trustedDeviceIndex[id];
+        const QStringList keys = d->m_trustedDevices->childKeys();
+        for (const QString& key : keys) {
+            properties.insert(key, d->m_trustedDevices->value(key).toString());
+        }
+        d->m_trustedDevices->endGroup();
+    }
+    d->m_trustedDeviceIndexLoaded = true;
 }
 
+void KdeConnectConfig::syncTrustedDevices()
+{
+    d->m_trustedDevices->sync();
+
+    //Remember what our own write looks like, so it isn't taken for somebody else's
+    d->m_trustedDevicesStamp = FileStamp::of(d->m_trustedDevices->fileName());
+}
+
+void KdeConnectConfig::trustedDevicesChanged()
+{
+    const FileStamp stamp = FileStamp::of(d->m_trustedDevices->fileName());
+    if (stamp == d->m_trustedDevicesStamp) {
+        return;
+    }
+
+    qCDebug(KDECONNECT_CORE) << "Trusted devices were changed by another process, reloading them";
+    d->m_trustedDevicesStamp = stamp;
+    //Makes QSettings read the file again
+    d->m_trustedDevices->sync();
+    d->m_trustedDeviceIndexLoaded = false;
+}
 
 QDir KdeConnectConfig::deviceConfigDir(const QString& deviceId)
 {
@@ -208,8 +318,16 @@ QDir KdeConnectConfig::pluginConfigDir(const QString& deviceId, const QString& p
     return QDir(pluginConfigDir);
 }
 
+QDir KdeConnectConfig::deviceDataDir(const QString& deviceId)
+{
+    QString dataPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QString deviceDataPath = QDir(dataPath).absoluteFilePath(deviceId);
+    return QDir(deviceDataPath);
+}
+
 void KdeConnectConfig::loadPrivateKey()
 {
+    StartupProfiler::Span span("KdeConnectConfig::loadPrivateKey");
     QString keyPath = privateKeyPath();
     QFile privKey(keyPath);
 
@@ -237,6 +355,7 @@ void KdeConnectConfig::loadPrivateKey()
 
 void KdeConnectConfig::loadCertificate()
 {
+    StartupProfiler::Span span("KdeConnectConfig::loadCertificate");
     QString certPath = certificatePath();
     QFile cert(certPath);
 
@@ -283,7 +402,7 @@ void KdeConnectConfig::generatePrivateKey(const QString& keyPath)
     }
 
     if (error) {
-        Daemon::instance()->reportError(QStringLiteral("KDE Connect"), i18n("Could not store private key file: %1", keyPath));
+        reportError(QStringLiteral("KDE Connect"), i18n("Could not store private key file: %1", keyPath));
     }
 
 }
@@ -328,7 +447,7 @@ void KdeConnectConfig::generateCertificate(const QString& certPath)
     }
 
     if (error) {
-        Daemon::instance()->reportError(QStringLiteral("KDE Connect"), i18n("Could not store certificate file: %1", certPath));
+        reportError(QStringLiteral("KDE Connect"), i18n("Could not store certificate file: %1", certPath));
     }
 }
 
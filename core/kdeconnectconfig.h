@@ -51,11 +51,17 @@ public:
 
     void setName(const QString& name);
 
+    //How many files are sent at the same time when sharing several of them, to devices that
+    //announce they can receive them in parallel. Other devices get them one by one.
+    int parallelUploads();
+    void setParallelUploads(int parallelUploads);
+
     /*
      * Trusted devices
      */
 
     QStringList trustedDevices(); //list of ids
+    bool isTrustedDevice(const QString& id);
     void removeTrustedDevice(const QString& id);
     void addTrustedDevice(const QString& id, const QString& name, const QString& type);
     KdeConnectConfig::DeviceInfo getTrustedDevice(const QString& id);
@@ -69,6 +75,7 @@ public:
     QDir baseConfigDir();
     QDir deviceConfigDir(const QString& deviceId);
     QDir pluginConfigDir(const QString& deviceId, const QString& pluginName); //Used by KdeConnectPluginConfig
+    QDir deviceDataDir(const QString& deviceId); //What plugins keep about a device, removed when it is unpaired
 
 #ifdef USE_PRIVATE_DBUS
     /*
@@ -85,6 +92,10 @@ private:
     void loadCertificate();
     void generateCertificate(const QString&  path);
 
+    void loadTrustedDevices();
+    void syncTrustedDevices();
+    void trustedDevicesChanged();
+
     struct KdeConnectConfigPrivate* d;
 };
 
@@ -21,6 +21,7 @@
 #include "kdeconnectplugin.h"
 
 #include "core_debug.h"
+#include "packetmetrics.h"
 
 struct KdeConnectPluginPrivate
 {
@@ -29,6 +30,7 @@ struct KdeConnectPluginPrivate
     QSet<QString> m_outgoingCapabilties;
     KdeConnectPluginConfig* m_config;
     QString iconName;
+    PacketMetrics* m_metrics;
 };
 
 KdeConnectPlugin::KdeConnectPlugin(QObject* parent, const QVariantList& args)
@@ -40,6 +42,7 @@ KdeConnectPlugin::KdeConnectPlugin(QObject* parent, const QVariantList& args)
     d->m_outgoingCapabilties = args.at(2).toStringList().toSet();
     d->m_config = nullptr;
     d->iconName = args.at(3).toString();
+    d->m_metrics = PacketMetrics::plugin(d->m_pluginName);
 }
 
 KdeConnectPluginConfig* KdeConnectPlugin::config() const
@@ -58,6 +61,11 @@ KdeConnectPlugin::~KdeConnectPlugin()
     }
 }
 
+PacketMetrics* KdeConnectPlugin::metrics() const
+{
+    return d->m_metrics;
+}
+
 const Device* KdeConnectPlugin::device()
 {
     return d->m_device;
@@ -78,6 +86,13 @@ bool KdeConnectPlugin::sendPacket(NetworkPacket& np) const
     return d->m_device->sendPacket(np);
 }
 
+void KdeConnectPlugin::receivePackets(const QVector<NetworkPacket>& packets)
+{
+    for (const NetworkPacket& np : packets) {
+        receivePacket(np);
+    }
+}
+
 QString KdeConnectPlugin::dbusPath() const
 {
     return {};
@@ -22,6 +22,7 @@
 #define KDECONNECTPLUGIN_H
 
 #include <QObject>
+#include <QVector>
 #include <QVariantList>
 
 #include "kdeconnectcore_export.h"
@@ -29,6 +30,7 @@
 #include "networkpacket.h"
 #include "device.h"
 
+class PacketMetrics;
 struct KdeConnectPluginPrivate;
 
 class KDECONNECTCORE_EXPORT KdeConnectPlugin
@@ -51,6 +53,16 @@ public:
 
     QString iconName() const;
 
+    //Where Device records how long the plugin takes to handle packets
+    PacketMetrics* metrics() const;
+
+    /**
+     * Called with consecutive packets of the same type that arrived together (eg: a burst of
+     * notifications or SMS). The default implementation calls receivePacket for each of them,
+     * plugins that can handle a batch more efficiently can override it.
+     */
+    virtual void receivePackets(const QVector<NetworkPacket>& packets);
+
 public Q_SLOTS:
     /**
      * Returns true if it has handled the packet in some way
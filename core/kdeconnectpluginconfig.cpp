@@ -21,19 +21,57 @@
 #include "kdeconnectpluginconfig.h"
 
 #include <QDir>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QList>
 #include <QSettings>
 #include <QDBusMessage>
 
 #include "kdeconnectconfig.h"
 #include "dbushelper.h"
+#include "filestamp.h"
 
 struct KdeConnectPluginConfigPrivate
 {
     QDir m_configDir;
     QSettings* m_config;
     QDBusMessage m_signal;
+
+    //What the file had when last read, dropped when it's changed from elsewhere
+    QHash<QString, QVariant> m_values;
+    QHash<QString, QVariantList> m_lists;
+    bool m_valuesLoaded = false;
+
+    //The file as we last read or wrote it, changes we made ourselves don't need a reload
+    FileStamp m_known;
+
+    void sync()
+    {
+        //Something changed the file since we last saw it, what we have may be out of date
+        const bool changedElsewhere = FileStamp::of(m_config->fileName()) != m_known;
+        m_config->sync();
+        m_known = FileStamp::of(m_config->fileName());
+        if (changedElsewhere) {
+            m_valuesLoaded = false;
+            m_lists.clear();
+        }
+    }
 };
 
+//Every plugin of every device has a config, they all share one watcher so they don't use
+//up the inotify instances of the user. Directories are watched while any config uses them.
+static QHash<QString, QList<KdeConnectPluginConfig*>>& watchedConfigDirs()
+{
+    static QHash<QString, QList<KdeConnectPluginConfig*>> s_dirs;
+    return s_dirs;
+}
+
+static QFileSystemWatcher* configDirWatcher()
+{
+    static QFileSystemWatcher* s_watcher = new QFileSystemWatcher();
+    return s_watcher;
+}
+
 KdeConnectPluginConfig::KdeConnectPluginConfig(const QString& deviceId, const QString& pluginName)
     : d(new KdeConnectPluginConfigPrivate())
 {
@@ -44,41 +82,82 @@ KdeConnectPluginConfig::KdeConnectPluginConfig(const QString& deviceId, const QS
 
     d->m_signal = QDBusMessage::createSignal(QStringLiteral("/kdeconnect/") + deviceId + QStringLiteral("/") + pluginName, QStringLiteral("org.kde.kdeconnect.config"), QStringLiteral("configChanged"));
     DbusHelper::sessionBus().connect(QLatin1String(""), QStringLiteral("/kdeconnect/") + deviceId + QStringLiteral("/") + pluginName, QStringLiteral("org.kde.kdeconnect.config"), QStringLiteral("configChanged"), this, SLOT(slotConfigChanged()));
+
+    //Catches edits that aren't announced over D-Bus. QSettings replaces the file when
+    //saving it, so the directory is watched instead
+    static const QMetaObject::Connection s_dirChanged = connect(configDirWatcher(), &QFileSystemWatcher::directoryChanged, &KdeConnectPluginConfig::configDirChanged);
+    Q_UNUSED(s_dirChanged);
+    QList<KdeConnectPluginConfig*>& configs = watchedConfigDirs()[d->m_configDir.path()];
+    if (configs.isEmpty()) {
+        configDirWatcher()->addPath(d->m_configDir.path());
+    }
+    configs.append(this);
 }
 
 KdeConnectPluginConfig::~KdeConnectPluginConfig()
 {
+    const QString dir = d->m_configDir.path();
+    QList<KdeConnectPluginConfig*>& configs = watchedConfigDirs()[dir];
+    configs.removeOne(this);
+    if (configs.isEmpty()) {
+        watchedConfigDirs().remove(dir);
+        configDirWatcher()->removePath(dir);
+    }
     delete d->m_config;
 }
 
+void KdeConnectPluginConfig::configDirChanged(const QString& dir)
+{
+    //Only the configs of that directory need to look at their file
+    const QList<KdeConnectPluginConfig*> configs = watchedConfigDirs().value(dir);
+    for (KdeConnectPluginConfig* config : configs) {
+        config->fileChanged();
+    }
+}
+
 QVariant KdeConnectPluginConfig::get(const QString& key, const QVariant& defaultValue)
 {
-    d->m_config->sync();
-    return d->m_config->value(key, defaultValue);
+    if (!d->m_valuesLoaded) {
+        d->m_config->sync();  // note: need sync() to get recent changes signalled from other process
+        d->m_known = FileStamp::of(d->m_config->fileName());
+        d->m_values.clear();
+        const QStringList keys = d->m_config->allKeys();
+        for (const QString& configKey : keys) {
+            d->m_values.insert(configKey, d->m_config->value(configKey));
+        }
+        d->m_valuesLoaded = true;
+    }
+    return d->m_values.value(key, defaultValue);
 }
 
 QVariantList KdeConnectPluginConfig::getList(const QString& key,
                                              const QVariantList& defaultValue)
 {
-    QVariantList list;
-    d->m_config->sync();  // note: need sync() to get recent changes signalled from other process
-    int size = d->m_config->beginReadArray(key);
-    if (size < 1) {
+    auto cached = d->m_lists.constFind(key);
+    if (cached == d->m_lists.constEnd()) {
+        QVariantList list;
+        if (!d->m_valuesLoaded) {
+            d->m_config->sync();
+            d->m_known = FileStamp::of(d->m_config->fileName());
+        }
+        int size = d->m_config->beginReadArray(key);
+        for (int i = 0; i < size; ++i) {
+            d->m_config->setArrayIndex(i);
+            list << d->m_config->value(QStringLiteral("value"));
+        }
         d->m_config->endArray();
-        return defaultValue;
-    }
-    for (int i = 0; i < size; ++i) {
-        d->m_config->setArrayIndex(i);
-        list << d->m_config->value(QStringLiteral("value"));
+        cached = d->m_lists.insert(key, list);
     }
-    d->m_config->endArray();
-    return list;
+    return cached->isEmpty() ? defaultValue : *cached;
 }
 
 void KdeConnectPluginConfig::set(const QString& key, const QVariant& value)
 {
     d->m_config->setValue(key, value);
-    d->m_config->sync();
+    d->sync();
+    if (d->m_valuesLoaded) {
+        d->m_values.insert(key, value);
+    }
     DbusHelper::sessionBus().send(d->m_signal);
 }
 
@@ -90,11 +169,24 @@ void KdeConnectPluginConfig::setList(const QString& key, const QVariantList& lis
         d->m_config->setValue(QStringLiteral("value"), list.at(i));
     }
     d->m_config->endArray();
-    d->m_config->sync();
+    d->sync();
+    d->m_lists.insert(key, list);
+    //The array's keys are only known to QSettings
+    d->m_valuesLoaded = false;
     DbusHelper::sessionBus().send(d->m_signal);
 }
 
+void KdeConnectPluginConfig::fileChanged()
+{
+    //Our own writes also land here, through the watcher and through our own D-Bus signal
+    if (!(FileStamp::of(d->m_config->fileName()) == d->m_known)) {
+        d->m_valuesLoaded = false;
+        d->m_lists.clear();
+    }
+}
+
 void KdeConnectPluginConfig::slotConfigChanged()
 {
+    fileChanged();
     Q_EMIT configChanged();
 }
@@ -51,7 +51,8 @@ public:
     void setList(const QString& key, const QVariantList& list);
 
     /**
-     * Read a key-value pair from this config object
+     * Read a key-value pair from this config object. Values are read from the file once
+     * and kept until it is changed by another config object or another process.
      */
     QVariant get(const QString& key, const QVariant& defaultValue);
 
@@ -71,6 +72,9 @@ Q_SIGNALS:
     void configChanged();
 
 private:
+    void fileChanged();
+    static void configDirChanged(const QString& dir);
+
     QScopedPointer<KdeConnectPluginConfigPrivate> d;
 };
 
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "multiplexchannel.h"
+#include "connectionmultiplexer.h"
+
+#include <cstring>
+
+MultiplexChannel::MultiplexChannel(ConnectionMultiplexer* multiplexer, const QSharedPointer<MultiplexChannelState>& state, QObject* parent)
+    : QIODevice(parent)
+    , m_multiplexer(multiplexer)
+    , m_state(state)
+{
+    m_state->channel = this;
+    QIODevice::open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+}
+
+MultiplexChannel::~MultiplexChannel()
+{
+    close();
+}
+
+qint64 MultiplexChannel::bytesAvailable() const
+{
+    return m_state->readBuffer.size() + QIODevice::bytesAvailable();
+}
+
+qint64 MultiplexChannel::bytesToWrite() const
+{
+    return m_state->writeBuffer.size();
+}
+
+bool MultiplexChannel::canReadLine() const
+{
+    return m_state->readBuffer.contains('\n') || QIODevice::canReadLine();
+}
+
+void MultiplexChannel::close()
+{
+    if (!isOpen()) {
+        return;
+    }
+
+    QIODevice::close();
+    //Whatever was written is still sent, the other end is told afterwards
+    m_state->localClosed = true;
+    m_state->readBuffer.clear();
+    if (m_multiplexer) {
+        m_multiplexer->scheduleFlush();
+    }
+}
+
+qint64 MultiplexChannel::readData(char* data, qint64 maxSize)
+{
+    const int bytesRead = static_cast<int>(qMin<qint64>(maxSize, m_state->readBuffer.size()));
+    if (bytesRead == 0) {
+        return m_state->remoteClosed ? -1 : 0;
+    }
+
+    memcpy(data, m_state->readBuffer.constData(), bytesRead);
+    m_state->readBuffer.remove(0, bytesRead);
+    if (m_multiplexer) {
+        m_multiplexer->requestData(m_state.data());
+    }
+    return bytesRead;
+}
+
+qint64 MultiplexChannel::writeData(const char* data, qint64 maxSize)
+{
+    if (m_state->remoteClosed || !m_multiplexer) {
+        return -1;
+    }
+
+    m_state->writeBuffer.append(data, static_cast<int>(maxSize));
+    m_multiplexer->scheduleFlush();
+    return maxSize;
+}
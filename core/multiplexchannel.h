@@ -0,0 +1,90 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef MULTIPLEXCHANNEL_H
+#define MULTIPLEXCHANNEL_H
+
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QUuid>
+
+#include "kdeconnectcore_export.h"
+
+class ConnectionMultiplexer;
+class MultiplexChannel;
+
+/**
+ * What ConnectionMultiplexer knows about a channel. It outlives the MultiplexChannel
+ * while written data is still waiting to be sent, and the multiplexer while received
+ * data is still waiting to be read.
+ */
+struct MultiplexChannelState
+{
+    QUuid id;
+    QByteArray readBuffer;
+    QByteArray writeBuffer;
+    qint64 requested = 0; //Data we asked the other end for and didn't get yet
+    qint64 credit = 0; //Data the other end asked us for and didn't get yet
+    bool claimed = false;
+    bool remoteClosed = false;
+    bool localClosed = false;
+    bool closeSent = false;
+    QElapsedTimer openedByRemote; //Started when the other end opens it, for the channels nobody takes
+    QPointer<MultiplexChannel> channel;
+};
+
+/**
+ * @short One of the channels of a ConnectionMultiplexer
+ *
+ * A sequential device that is open for reading and writing from the start. Writes are
+ * queued and sent as the other end asks for data, reads are answered from what arrived.
+ * The channel is finished for reading once the other end closes it.
+ */
+class KDECONNECTCORE_EXPORT MultiplexChannel
+    : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    ~MultiplexChannel() override;
+
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override;
+    qint64 bytesToWrite() const override;
+    bool canReadLine() const override;
+    void close() override;
+
+    QUuid id() const { return m_state->id; }
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override;
+    qint64 writeData(const char* data, qint64 maxSize) override;
+
+private:
+    friend class ConnectionMultiplexer;
+    MultiplexChannel(ConnectionMultiplexer* multiplexer, const QSharedPointer<MultiplexChannelState>& state, QObject* parent = nullptr);
+
+    QPointer<ConnectionMultiplexer> m_multiplexer;
+    QSharedPointer<MultiplexChannelState> m_state;
+};
+
+#endif
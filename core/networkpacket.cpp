@@ -21,18 +21,23 @@
 #include "networkpacket.h"
 #include "core_debug.h"
 
-#include <QMetaObject>
-#include <QMetaProperty>
 #include <QByteArray>
 #include <QDataStream>
 #include <QDateTime>
+#include <QJsonArray>
 #include <QJsonDocument>
+#include <QJsonObject>
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QVector>
 
 #include "dbushelper.h"
 #include "filetransferjob.h"
 #include "pluginloader.h"
 #include "kdeconnectconfig.h"
+#include "packetmetrics.h"
 
 QDebug operator<<(QDebug s, const NetworkPacket& pkg)
 {
@@ -46,9 +51,61 @@ QDebug operator<<(QDebug s, const NetworkPacket& pkg)
 
 const int NetworkPacket::s_protocolVersion = 7;
 
+struct PacketTypeRegistry
+{
+    PacketTypeRegistry()
+    {
+        ids.insert(PACKET_TYPE_IDENTITY, 0);
+        ids.insert(PACKET_TYPE_PAIR, 1);
+        names << PACKET_TYPE_IDENTITY << PACKET_TYPE_PAIR;
+    }
+
+    QReadWriteLock lock;
+    QHash<QString, int> ids;
+    QVector<QString> names;
+};
+Q_GLOBAL_STATIC(PacketTypeRegistry, packetTypeRegistry)
+
+int NetworkPacket::registerType(const QString& type)
+{
+    PacketTypeRegistry* registry = packetTypeRegistry();
+    QWriteLocker locker(&registry->lock);
+    const auto it = registry->ids.constFind(type);
+    if (it != registry->ids.constEnd()) {
+        return *it;
+    }
+    const int id = registry->ids.size();
+    registry->ids.insert(type, id);
+    registry->names.append(type);
+    return id;
+}
+
+int NetworkPacket::typeIdOf(const QString& type)
+{
+    //Types are only registered from what we know, not from what we receive
+    PacketTypeRegistry* registry = packetTypeRegistry();
+    QReadLocker locker(&registry->lock);
+    return registry->ids.value(type, -1);
+}
+
+int NetworkPacket::registeredTypes()
+{
+    PacketTypeRegistry* registry = packetTypeRegistry();
+    QReadLocker locker(&registry->lock);
+    return registry->ids.size();
+}
+
+QString NetworkPacket::typeName(int typeId)
+{
+    PacketTypeRegistry* registry = packetTypeRegistry();
+    QReadLocker locker(&registry->lock);
+    return registry->names.value(typeId);
+}
+
 NetworkPacket::NetworkPacket(const QString& type, const QVariantMap& body)
     : m_id(QString::number(QDateTime::currentMSecsSinceEpoch()))
     , m_type(type)
+    , m_typeId(type.isEmpty() ? -1 : typeIdOf(type))
     , m_body(body)
     , m_payload()
     , m_payloadSize(0)
@@ -58,9 +115,11 @@ NetworkPacket::NetworkPacket(const QString& type, const QVariantMap& body)
 NetworkPacket::NetworkPacket(const NetworkPacket& other)
     : m_id(other.m_id)
     , m_type(other.m_type)
+    , m_typeId(other.m_typeId)
     , m_body(QVariantMap(other.m_body))
     , m_payload(other.m_payload)
     , m_payloadSize(other.m_payloadSize)
+    , m_payloadTransferInfo(other.m_payloadTransferInfo)
 {
 }
 
@@ -69,6 +128,7 @@ void NetworkPacket::createIdentityPacket(NetworkPacket* np)
     KdeConnectConfig* config = KdeConnectConfig::instance();
     np->m_id = QString::number(QDateTime::currentMSecsSinceEpoch());
     np->m_type = PACKET_TYPE_IDENTITY;
+    np->m_typeId = typeIdOf(np->m_type);
     np->m_payload = QSharedPointer<QIODevice>();
     np->m_payloadSize = 0;
     np->set(QStringLiteral("deviceId"), config->deviceId());
@@ -81,86 +141,138 @@ void NetworkPacket::createIdentityPacket(NetworkPacket* np)
     //qCDebug(KDECONNECT_CORE) << "createIdentityPacket" << np->serialize();
 }
 
-template<class T>
-QVariantMap qobject2qvariant(const T* object)
+//Numbers, arrays and strings that need escaping are formatted by Qt itself,
+//so the output stays byte-identical to what QJsonDocument would produce
+static void appendQtJsonValue(QByteArray& out, const QJsonValue& value)
 {
-    QVariantMap map;
-    auto metaObject = T::staticMetaObject;
-    for(int i = metaObject.propertyOffset(); i < metaObject.propertyCount(); ++i) {
-        QMetaProperty prop = metaObject.property(i);
-        map.insert(QString::fromLatin1(prop.name()), prop.readOnGadget(object));
-    }
+    const QByteArray json = QJsonDocument(QJsonArray{value}).toJson(QJsonDocument::Compact);
+    out.append(json.constData() + 1, json.size() - 2); //Strip the enclosing [ ]
+}
 
-    return map;
+static void appendJsonString(QByteArray& out, const QString& string)
+{
+    //Printable ascii without quotes or backslashes can be copied as is
+    const int start = out.size();
+    out.resize(start + string.size() + 2);
+    char* data = out.data() + start;
+    *data++ = '"';
+    for (const QChar c : string) {
+        const ushort u = c.unicode();
+        if (u < 0x20 || u > 0x7e || u == '"' || u == '\\') {
+            out.resize(start);
+            appendQtJsonValue(out, QJsonValue(string));
+            return;
+        }
+        *data++ = static_cast<char>(u);
+    }
+    *data = '"';
 }
 
-QByteArray NetworkPacket::serialize() const
+static void appendJsonObject(QByteArray& out, const QVariantMap& map);
+
+static void appendJsonVariant(QByteArray& out, const QVariant& value)
 {
-    //Object -> QVariant
-    //QVariantMap variant;
-    //variant["id"] = mId;
-    //variant["type"] = mType;
-    //variant["body"] = mBody;
-    QVariantMap variant = qobject2qvariant(this);
-
-    if (hasPayload()) {
-        //qCDebug(KDECONNECT_CORE) << "Serializing payloadTransferInfo";
-        variant[QStringLiteral("payloadSize")] = payloadSize();
-        variant[QStringLiteral("payloadTransferInfo")] = m_payloadTransferInfo;
+    switch (value.userType()) {
+        case QMetaType::QString:
+            appendJsonString(out, value.toString());
+            break;
+        case QMetaType::Bool:
+            out.append(value.toBool() ? "true" : "false");
+            break;
+        case QMetaType::QVariantMap:
+            appendJsonObject(out, value.toMap());
+            break;
+        default:
+            appendQtJsonValue(out, QJsonValue::fromVariant(value));
+            break;
     }
+}
 
-    //QVariant -> json
-    auto jsonDocument = QJsonDocument::fromVariant(variant);
-    QByteArray json = jsonDocument.toJson(QJsonDocument::Compact);
-    if (json.isEmpty()) {
-        qCDebug(KDECONNECT_CORE) << "Serialization error:";
-    } else {
-        /*if (!isEncrypted()) {
-            //qCDebug(KDECONNECT_CORE) << "Serialized packet:" << json;
-        }*/
-        json.append('\n');
+static void appendJsonObject(QByteArray& out, const QVariantMap& map)
+{
+    out.append('{');
+    for (auto iter = map.constBegin(); iter != map.constEnd(); ++iter) {
+        if (iter != map.constBegin()) {
+            out.append(',');
+        }
+        appendJsonString(out, iter.key());
+        out.append(':');
+        appendJsonVariant(out, iter.value());
     }
+    out.append('}');
+}
 
+QByteArray NetworkPacket::serialize() const
+{
+    QByteArray json;
+    serialize(&json);
     return json;
 }
 
-template <class T>
-void qvariant2qobject(const QVariantMap& variant, T* object)
+void NetworkPacket::serialize(QByteArray* buffer) const
 {
-    for ( QVariantMap::const_iterator iter = variant.begin(); iter != variant.end(); ++iter )
-    {
-        const int propertyIndex = T::staticMetaObject.indexOfProperty(iter.key().toLatin1());
-        if (propertyIndex < 0) {
-            qCWarning(KDECONNECT_CORE) << "missing property" << object << iter.key();
-            continue;
-        }
-
-        QMetaProperty property = T::staticMetaObject.property(propertyIndex);
-        bool ret = property.writeOnGadget(object, *iter);
-        if (!ret) {
-            qCWarning(KDECONNECT_CORE) << "couldn't set" << object << "->" << property.name() << '=' << *iter;
-        }
+    //Object -> json, written straight into the buffer with the keys in the
+    //same (sorted) order QJsonDocument uses
+    buffer->resize(0);
+    buffer->append("{\"body\":");
+    appendJsonObject(*buffer, m_body);
+    buffer->append(",\"id\":");
+    appendJsonString(*buffer, m_id);
+    buffer->append(",\"payloadSize\":");
+    if (m_payloadSize == 0) {
+        buffer->append('0');
+    } else {
+        appendQtJsonValue(*buffer, QJsonValue::fromVariant(QVariant(m_payloadSize)));
     }
+    buffer->append(",\"payloadTransferInfo\":");
+    appendJsonObject(*buffer, m_payloadTransferInfo);
+    buffer->append(",\"type\":");
+    appendJsonString(*buffer, m_type);
+    buffer->append("}\n");
 }
 
-bool NetworkPacket::unserialize(const QByteArray& a, NetworkPacket* np)
+bool NetworkPacket::unserialize(const QByteArray& a, NetworkPacket* np, PacketMetrics* metrics)
 {
-    //Json -> QVariant
+    QElapsedTimer decodeTimer;
+    if (metrics) {
+        decodeTimer.start();
+    }
+
+    //Json -> NetworkPacket, without going through QVariantMap and QMetaProperty
     QJsonParseError parseError;
-    auto parser = QJsonDocument::fromJson(a, &parseError);
+    const auto parser = QJsonDocument::fromJson(a, &parseError);
     if (parser.isNull()) {
         qCDebug(KDECONNECT_CORE) << "Unserialization error:" << parseError.errorString();
         return false;
     }
 
-    auto variant = parser.toVariant().toMap();
-    qvariant2qobject(variant, np);
+    np->m_payloadSize = 0; //Stays 0 if not present, which is ok
+    np->m_payloadTransferInfo.clear(); //Stays empty if not present, which is ok
+
+    const QJsonObject object = parser.object();
+    for (auto iter = object.constBegin(); iter != object.constEnd(); ++iter) {
+        const QString& key = iter.key();
+        const QJsonValue value = iter.value();
+        if (key == QLatin1String("body")) {
+            np->m_body = value.toObject().toVariantMap();
+        } else if (key == QLatin1String("type")) {
+            np->m_type = value.toString();
+            np->m_typeId = typeIdOf(np->m_type);
+        } else if (key == QLatin1String("id")) {
+            //Some clients send the id as a number
+            np->m_id = value.isString() ? value.toString() : value.toVariant().toString();
+        } else if (key == QLatin1String("payloadSize")) {
+            np->m_payloadSize = static_cast<qint64>(value.toDouble());
+        } else if (key == QLatin1String("payloadTransferInfo")) {
+            np->m_payloadTransferInfo = value.toObject().toVariantMap();
+        } else {
+            qCWarning(KDECONNECT_CORE) << "missing property" << key;
+        }
+    }
 
-    np->m_payloadSize = variant[QStringLiteral("payloadSize")].toInt(); //Will return 0 if was not present, which is ok
     if (np->m_payloadSize == -1) {
         np->m_payloadSize = np->get<int>(QStringLiteral("size"), -1);
     }
-    np->m_payloadTransferInfo = variant[QStringLiteral("payloadTransferInfo")].toMap(); //Will return an empty qvariantmap if was not present, which is ok
 
     //Ids containing characters that are not allowed as dbus paths would make app crash
     if (np->m_body.contains(QStringLiteral("deviceId")))
@@ -170,6 +282,10 @@ bool NetworkPacket::unserialize(const QByteArray& a, NetworkPacket* np)
         np->set(QStringLiteral("deviceId"), deviceId);
     }
 
+    if (metrics) {
+        metrics->packetDecoded(np->m_typeId, decodeTimer.nsecsElapsed());
+    }
+
     return true;
 
 }
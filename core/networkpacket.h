@@ -33,6 +33,7 @@
 #include "kdeconnectcore_export.h"
 
 class FileTransferJob;
+class PacketMetrics;
 
 class KDECONNECTCORE_EXPORT NetworkPacket
 {
@@ -53,10 +54,19 @@ public:
     static void createIdentityPacket(NetworkPacket*);
 
     QByteArray serialize() const;
-    static bool unserialize(const QByteArray& json, NetworkPacket* out);
+    void serialize(QByteArray* buffer) const; //Reuses the buffer's capacity, see DeviceLink::serializePacket
+    static bool unserialize(const QByteArray& json, NetworkPacket* out, PacketMetrics* metrics = nullptr); //Records the decode time in metrics
 
     const QString& id() const { return m_id; }
     const QString& type() const { return m_type; }
+    //Small number standing for the type, or -1 if the type wasn't registered
+    int typeId() const { return m_typeId; }
+
+    //Packet types are registered by PluginLoader, so looking up what handles them is cheap
+    static int registerType(const QString& type);
+    static int typeIdOf(const QString& type);
+    static int registeredTypes();
+    static QString typeName(int typeId); //Empty if nothing was registered with that id
     QVariantMap& body() { return m_body; }
     const QVariantMap& body() const { return m_body; }
 
@@ -81,12 +91,13 @@ public:
 private:
 
     void setId(const QString& id) { m_id = id; }
-    void setType(const QString& t) { m_type = t; }
+    void setType(const QString& t) { m_type = t; m_typeId = typeIdOf(t); }
     void setBody(const QVariantMap& b) { m_body = b; }
     void setPayloadSize(qint64 s) { m_payloadSize = s; }
 
     QString m_id;
     QString m_type;
+    int m_typeId;
     QVariantMap m_body;
 	
     QSharedPointer<QIODevice> m_payload;
@@ -0,0 +1,211 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "packetmetrics.h"
+#include "networkpacket.h"
+
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QtAlgorithms>
+
+namespace {
+
+struct MetricsRegistry
+{
+    QMutex mutex;
+    QHash<QString, PacketMetrics*> devices;
+    QHash<QString, PacketMetrics*> plugins;
+    PacketMetrics* untrustedDevices = nullptr;
+};
+
+//Never destroyed, links and plugins may still record while the daemon exits
+MetricsRegistry* registry()
+{
+    static MetricsRegistry* registry = new MetricsRegistry();
+    return registry;
+}
+
+}
+
+PacketMetrics* PacketMetrics::device(const QString& deviceId)
+{
+    MetricsRegistry* r = registry();
+    QMutexLocker locker(&r->mutex);
+    PacketMetrics*& metrics = r->devices[deviceId];
+    if (!metrics) {
+        metrics = new PacketMetrics();
+    }
+    return metrics;
+}
+
+PacketMetrics* PacketMetrics::untrustedDevices()
+{
+    MetricsRegistry* r = registry();
+    QMutexLocker locker(&r->mutex);
+    if (!r->untrustedDevices) {
+        r->untrustedDevices = new PacketMetrics();
+    }
+    return r->untrustedDevices;
+}
+
+PacketMetrics* PacketMetrics::plugin(const QString& pluginName)
+{
+    MetricsRegistry* r = registry();
+    QMutexLocker locker(&r->mutex);
+    PacketMetrics*& metrics = r->plugins[pluginName];
+    if (!metrics) {
+        metrics = new PacketMetrics();
+    }
+    return metrics;
+}
+
+PacketMetrics::TypeCounters* PacketMetrics::counters(int typeId)
+{
+    const int slot = (typeId < 0 || typeId >= MaxTypes) ? MaxTypes : typeId;
+    TypeCounters* counters = m_types[slot].loadAcquire();
+    if (!counters) {
+        //Whoever loses the race uses the winner's counters
+        TypeCounters* created = new TypeCounters();
+        if (m_types[slot].testAndSetOrdered(nullptr, created)) {
+            counters = created;
+        } else {
+            delete created;
+            counters = m_types[slot].loadAcquire();
+        }
+    }
+    return counters;
+}
+
+void PacketMetrics::packetReceived(int typeId, qint64 bytes)
+{
+    TypeCounters* c = counters(typeId);
+    c->received.fetchAndAddRelaxed(1);
+    c->receivedBytes.fetchAndAddRelaxed(static_cast<quint64>(bytes));
+}
+
+void PacketMetrics::packetSent(int typeId, qint64 bytes)
+{
+    TypeCounters* c = counters(typeId);
+    c->sent.fetchAndAddRelaxed(1);
+    c->sentBytes.fetchAndAddRelaxed(static_cast<quint64>(bytes));
+}
+
+void PacketMetrics::packetDecoded(int typeId, qint64 ns)
+{
+    counters(typeId)->decode.record(ns);
+}
+
+void PacketMetrics::packetDispatched(int typeId, qint64 ns)
+{
+    counters(typeId)->dispatch.record(ns);
+}
+
+void PacketMetrics::Histogram::record(qint64 ns)
+{
+    const quint64 value = ns > 0 ? static_cast<quint64>(ns) : 1;
+    const int bucket = qMin(63 - static_cast<int>(qCountLeadingZeroBits(value)), HistogramBuckets - 1);
+    buckets[bucket].fetchAndAddRelaxed(1);
+    totalNs.fetchAndAddRelaxed(value);
+}
+
+quint64 PacketMetrics::Histogram::count() const
+{
+    quint64 count = 0;
+    for (int i = 0; i < HistogramBuckets; ++i) {
+        count += buckets[i].load();
+    }
+    return count;
+}
+
+quint64 PacketMetrics::Histogram::percentileNs(double fraction) const
+{
+    const quint64 total = count();
+    if (total == 0) {
+        return 0;
+    }
+    const quint64 wanted = qMax<quint64>(1, static_cast<quint64>(total * fraction));
+    quint64 seen = 0;
+    for (int i = 0; i < HistogramBuckets; ++i) {
+        seen += buckets[i].load();
+        if (seen >= wanted) {
+            return Q_UINT64_C(2) << i;
+        }
+    }
+    return Q_UINT64_C(2) << (HistogramBuckets - 1);
+}
+
+void PacketMetrics::appendReport(QString& report, const QString& kind, const QString& name) const
+{
+    //Averages and the 99th percentile in microseconds
+    const auto histogram = [](const Histogram& h) {
+        const quint64 count = h.count();
+        if (count == 0) {
+            return QStringLiteral("-");
+        }
+        return QStringLiteral("%1/%2").arg(h.totalNs.load() / count / 1000.0, 0, 'f', 1).arg(h.percentileNs(0.99) / 1000.0, 0, 'f', 1);
+    };
+
+    for (int slot = 0; slot <= MaxTypes; ++slot) {
+        const TypeCounters* c = m_types[slot].loadAcquire();
+        if (!c) {
+            continue;
+        }
+        const QString type = slot == MaxTypes ? QStringLiteral("(unregistered)") : NetworkPacket::typeName(slot);
+        report += QStringLiteral("%1\t%2\t%3\t%4\t%5\t%6\t%7\t%8\t%9\n")
+            .arg(kind, name, type)
+            .arg(c->received.load())
+            .arg(c->receivedBytes.load())
+            .arg(c->sent.load())
+            .arg(c->sentBytes.load())
+            .arg(histogram(c->decode), histogram(c->dispatch));
+    }
+}
+
+QString PacketMetrics::report()
+{
+    //Sorted, so the output is stable between calls
+    QMap<QString, const PacketMetrics*> devices;
+    QMap<QString, const PacketMetrics*> plugins;
+    const PacketMetrics* untrusted;
+    {
+        MetricsRegistry* r = registry();
+        QMutexLocker locker(&r->mutex);
+        for (auto it = r->devices.constBegin(); it != r->devices.constEnd(); ++it) {
+            devices.insert(it.key(), it.value());
+        }
+        for (auto it = r->plugins.constBegin(); it != r->plugins.constEnd(); ++it) {
+            plugins.insert(it.key(), it.value());
+        }
+        untrusted = r->untrustedDevices;
+    }
+
+    QString report = QStringLiteral("#kind\tname\ttype\treceived\treceivedBytes\tsent\tsentBytes\tdecodeUs(avg/p99)\tdispatchUs(avg/p99)\n");
+    for (auto it = devices.constBegin(); it != devices.constEnd(); ++it) {
+        it.value()->appendReport(report, QStringLiteral("device"), it.key());
+    }
+    if (untrusted) {
+        untrusted->appendReport(report, QStringLiteral("device"), QStringLiteral("(untrusted)"));
+    }
+    for (auto it = plugins.constBegin(); it != plugins.constEnd(); ++it) {
+        it.value()->appendReport(report, QStringLiteral("plugin"), it.key());
+    }
+    return report;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PACKETMETRICS_H
+#define PACKETMETRICS_H
+
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QString>
+
+#include "kdeconnectcore_export.h"
+
+/**
+ * @short Counts the packets a device or a plugin handles, by packet type
+ *
+ * DeviceLink counts what is sent and received, NetworkPacket::unserialize how
+ * long decoding takes and Device how long the plugins take to handle it. The
+ * counters are atomics, so recording never takes a lock. The totals can be read
+ * with Daemon::packetStats() over D-Bus or with kdeconnect-cli --stats.
+ */
+class KDECONNECTCORE_EXPORT PacketMetrics
+{
+public:
+    //Created on first use and kept until exit, so the pointer can be stored.
+    //Only ask for trusted devices, the others share untrustedDevices().
+    static PacketMetrics* device(const QString& deviceId);
+    static PacketMetrics* untrustedDevices();
+    static PacketMetrics* plugin(const QString& pluginName);
+
+    void packetReceived(int typeId, qint64 bytes);
+    void packetSent(int typeId, qint64 bytes);
+    void packetDecoded(int typeId, qint64 ns);
+    void packetDispatched(int typeId, qint64 ns);
+
+    //One line per device or plugin and packet type
+    static QString report();
+
+    //Durations go in power of two buckets of nanoseconds, the last one takes everything longer
+    static const int HistogramBuckets = 36;
+
+    struct Histogram {
+        QAtomicInteger<quint64> buckets[HistogramBuckets];
+        QAtomicInteger<quint64> totalNs;
+
+        void record(qint64 ns);
+        quint64 count() const;
+        //Upper bound of the bucket the given fraction of the samples falls in
+        quint64 percentileNs(double fraction) const;
+    };
+
+    struct TypeCounters {
+        QAtomicInteger<quint64> received;
+        QAtomicInteger<quint64> receivedBytes;
+        QAtomicInteger<quint64> sent;
+        QAtomicInteger<quint64> sentBytes;
+        Histogram decode;
+        Histogram dispatch;
+    };
+
+private:
+    PacketMetrics() = default;
+    Q_DISABLE_COPY(PacketMetrics)
+
+    //Types without an id, or past the last slot, are counted together in the last slot
+    static const int MaxTypes = 256;
+
+    TypeCounters* counters(int typeId);
+    void appendReport(QString& report, const QString& kind, const QString& name) const;
+
+    QAtomicPointer<TypeCounters> m_types[MaxTypes + 1];
+};
+
+#endif
@@ -24,9 +24,15 @@
 #include <KPluginLoader>
 #include <KPluginFactory>
 
+#include <QFile>
+#include <QLibrary>
+#include <QMutex>
+
 #include "core_debug.h"
 #include "device.h"
 #include "kdeconnectplugin.h"
+#include "networkpacket.h"
+#include "startupprofiler.h"
 
 //In older Qt released, qAsConst isnt available
 #include "qtcompat_p.h"
@@ -39,10 +45,50 @@ PluginLoader* PluginLoader::instance()
 
 PluginLoader::PluginLoader()
 {
+    StartupProfiler::Span span("PluginLoader");
     const QVector<KPluginMetaData> data = KPluginLoader::findPlugins(QStringLiteral("kdeconnect/"));
     for (const KPluginMetaData& metadata : data) {
         plugins[metadata.pluginId()] = metadata;
     }
+
+    QSet<QString> incoming, outgoing;
+    for (const KPluginMetaData& service : qAsConst(plugins)) {
+        PluginCapabilities& capabilities = m_pluginCapabilities[service.pluginId()];
+        capabilities.incomingList = KPluginMetaData::readStringList(service.rawData(), QStringLiteral("X-KdeConnect-SupportedPacketType"));
+        capabilities.outgoingList = KPluginMetaData::readStringList(service.rawData(), QStringLiteral("X-KdeConnect-OutgoingPacketType"));
+        capabilities.loadOnDemand = service.rawData().value(QStringLiteral("X-KdeConnect-LoadOnDemand")).toBool();
+        for (const QString& capability : qAsConst(capabilities.incomingList)) {
+            incoming.insert(capability);
+            NetworkPacket::registerType(capability);
+        }
+        for (const QString& capability : qAsConst(capabilities.outgoingList)) {
+            outgoing.insert(capability);
+            NetworkPacket::registerType(capability);
+        }
+    }
+    m_capabilityBits = NetworkPacket::registeredTypes();
+    for (PluginCapabilities& capabilities : m_pluginCapabilities) {
+        capabilities.incoming = capabilityBits(capabilities.incomingList.toSet());
+        capabilities.outgoing = capabilityBits(capabilities.outgoingList.toSet());
+    }
+
+    m_incomingCapabilities = incoming.toList();
+    m_incomingCapabilities.sort();
+    m_outgoingCapabilities = outgoing.toList();
+    m_outgoingCapabilities.sort();
+}
+
+QBitArray PluginLoader::capabilityBits(const QSet<QString>& capabilities) const
+{
+    //Capabilities no plugin knows about can't match any plugin, they get no bit
+    QBitArray bits(m_capabilityBits);
+    for (const QString& capability : capabilities) {
+        const int bit = NetworkPacket::typeIdOf(capability);
+        if (bit >= 0 && bit < m_capabilityBits) {
+            bits.setBit(bit);
+        }
+    }
+    return bits;
 }
 
 QStringList PluginLoader::getPluginList() const
@@ -72,7 +118,7 @@ KdeConnectPlugin* PluginLoader::instantiatePluginForDevice(const QString& plugin
         return ret;
     }
 
-    const QStringList outgoingInterfaces = KPluginMetaData::readStringList(service.rawData(), QStringLiteral("X-KdeConnect-OutgoingPacketType"));
+    const QStringList outgoingInterfaces = outgoingCapabilities(pluginName);
 
     QVariant deviceVariant = QVariant::fromValue<Device*>(device);
 
@@ -86,49 +132,62 @@ KdeConnectPlugin* PluginLoader::instantiatePluginForDevice(const QString& plugin
     return ret;
 }
 
-QStringList PluginLoader::incomingCapabilities() const
+QSet<QString> PluginLoader::pluginsForCapabilities(const QSet<QString>& incoming, const QSet<QString>& outgoing)
 {
     QSet<QString> ret;
-    for (const KPluginMetaData& service : qAsConst(plugins)) {
-        ret += KPluginMetaData::readStringList(service.rawData(), QStringLiteral("X-KdeConnect-SupportedPacketType")).toSet();
-    }
-    return ret.toList();
-}
 
-QStringList PluginLoader::outgoingCapabilities() const
-{
-    QSet<QString> ret;
-    for (const KPluginMetaData& service : qAsConst(plugins)) {
-        ret += KPluginMetaData::readStringList(service.rawData(), QStringLiteral("X-KdeConnect-OutgoingPacketType")).toSet();
-    }
-    return ret.toList();
-}
+    const QBitArray incomingBits = capabilityBits(incoming);
+    const QBitArray outgoingBits = capabilityBits(outgoing);
 
-QSet<QString> PluginLoader::pluginsForCapabilities(const QSet<QString>& incoming, const QSet<QString>& outgoing)
-{
-    QSet<QString> ret;
+    for (auto it = m_pluginCapabilities.constBegin(); it != m_pluginCapabilities.constEnd(); ++it) {
+        const PluginCapabilities& capabilities = it.value();
 
-    for (const KPluginMetaData& service : qAsConst(plugins)) {
-        const QSet<QString> pluginIncomingCapabilities = KPluginMetaData::readStringList(service.rawData(), QStringLiteral("X-KdeConnect-SupportedPacketType")).toSet();
-        const QSet<QString> pluginOutgoingCapabilities = KPluginMetaData::readStringList(service.rawData(), QStringLiteral("X-KdeConnect-OutgoingPacketType")).toSet();
-
-        bool capabilitiesEmpty = (pluginIncomingCapabilities.isEmpty() && pluginOutgoingCapabilities.isEmpty());
-#if (QT_VERSION >= QT_VERSION_CHECK(5, 6, 0))
-        bool capabilitiesIntersect = (outgoing.intersects(pluginIncomingCapabilities) || incoming.intersects(pluginOutgoingCapabilities));
-#else
-        QSet<QString> commonIncoming = incoming;
-        commonIncoming.intersect(pluginOutgoingCapabilities);
-        QSet<QString> commonOutgoing = outgoing;
-        commonOutgoing.intersect(pluginIncomingCapabilities);
-        bool capabilitiesIntersect = (!commonIncoming.isEmpty() || !commonOutgoing.isEmpty());
-#endif
+        bool capabilitiesEmpty = (capabilities.incomingList.isEmpty() && capabilities.outgoingList.isEmpty());
+        bool capabilitiesIntersect = (outgoingBits & capabilities.incoming).count(true) > 0
+                                  || (incomingBits & capabilities.outgoing).count(true) > 0;
 
         if (capabilitiesIntersect || capabilitiesEmpty) {
-            ret += service.pluginId();
+            ret += it.key();
         } else {
-            qCDebug(KDECONNECT_CORE) << "Not loading plugin" << service.pluginId() <<  "because device doesn't support it";
+            qCDebug(KDECONNECT_CORE) << "Not loading plugin" << it.key() <<  "because device doesn't support it";
         }
     }
 
     return ret;
 }
+
+QString PluginLoader::dbusIntrospection(const QString& pluginName, const QString& libraryPath)
+{
+    static QMutex s_mutex;
+    static QHash<QString, QString> s_introspection;
+
+    QMutexLocker locker(&s_mutex);
+    auto it = s_introspection.constFind(pluginName);
+    if (it != s_introspection.constEnd()) {
+        return *it;
+    }
+
+    //Loading the library registers its resources, nothing in it runs otherwise
+    QLibrary library(libraryPath);
+    if (!library.load()) {
+        qCWarning(KDECONNECT_CORE) << "Could not load" << pluginName << "to read its D-Bus interfaces:" << library.errorString();
+    }
+
+    QString introspection;
+    QFile xmlFile(QStringLiteral(":/kdeconnect/dbus/") + pluginName + QStringLiteral(".xml"));
+    if (xmlFile.open(QIODevice::ReadOnly)) {
+        //The file is a whole <node>, D-Bus only wants the interfaces in it
+        const QString xml = QString::fromUtf8(xmlFile.readAll());
+        const QLatin1String endTag("</interface>");
+        const int begin = xml.indexOf(QLatin1String("<interface"));
+        const int end = xml.lastIndexOf(endTag);
+        if (begin >= 0 && end > begin) {
+            introspection = xml.mid(begin, end + endTag.size() - begin);
+        }
+    } else {
+        qCWarning(KDECONNECT_CORE) << pluginName << "loads on demand but doesn't embed its D-Bus interfaces";
+    }
+
+    s_introspection.insert(pluginName, introspection);
+    return introspection;
+}
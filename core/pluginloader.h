@@ -22,8 +22,10 @@
 #define PLUGINLOADER_H
 
 #include <QObject>
+#include <QBitArray>
 #include <QHash>
 #include <QString>
+#include <QStringList>
 
 #include <KPluginMetaData>
 
@@ -40,14 +42,40 @@ public:
     KPluginMetaData getPluginInfo(const QString& name) const;
     KdeConnectPlugin* instantiatePluginForDevice(const QString& name, Device* device) const;
 
-    QStringList incomingCapabilities() const;
-    QStringList outgoingCapabilities() const;
+    QStringList incomingCapabilities() const { return m_incomingCapabilities; }
+    QStringList outgoingCapabilities() const { return m_outgoingCapabilities; }
     QSet<QString> pluginsForCapabilities(const QSet<QString>& incoming, const QSet<QString>& outgoing);
 
+    //The packet types a single plugin receives and sends
+    QStringList incomingCapabilities(const QString& pluginName) const { return m_pluginCapabilities.value(pluginName).incomingList; }
+    QStringList outgoingCapabilities(const QString& pluginName) const { return m_pluginCapabilities.value(pluginName).outgoingList; }
+
+    //Whether the plugin is only created once a packet or D-Bus call needs it, see X-KdeConnect-LoadOnDemand
+    bool loadsOnDemand(const QString& pluginName) const { return m_pluginCapabilities.value(pluginName).loadOnDemand; }
+
+    //The D-Bus interfaces of a plugin as <interface> elements, read from its library without creating
+    //the plugin. Plugins that load on demand embed them, see kdeconnect_add_dbus_introspection.
+    //Can be called from any thread.
+    static QString dbusIntrospection(const QString& pluginName, const QString& libraryPath);
+
 private:
     PluginLoader();
+    QBitArray capabilityBits(const QSet<QString>& capabilities) const;
+
     QHash<QString, KPluginMetaData> plugins;
 
+    //Capabilities are read from the metadata once, each of them gets the bit of its packet type id
+    struct PluginCapabilities {
+        QStringList incomingList;
+        QStringList outgoingList;
+        QBitArray incoming;
+        QBitArray outgoing;
+        bool loadOnDemand = false;
+    };
+    int m_capabilityBits;
+    QHash<QString, PluginCapabilities> m_pluginCapabilities;
+    QStringList m_incomingCapabilities;
+    QStringList m_outgoingCapabilities;
 
 };
 
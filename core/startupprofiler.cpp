@@ -0,0 +1,87 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "startupprofiler.h"
+#include "core_debug.h"
+
+#include <QCoreApplication>
+#include <QThread>
+
+#include <algorithm>
+
+StartupProfiler* StartupProfiler::instance()
+{
+    static StartupProfiler* instance = new StartupProfiler();
+    return instance;
+}
+
+StartupProfiler::StartupProfiler()
+{
+    m_timer.start();
+}
+
+StartupProfiler::Span::Span(const char* name)
+    : m_name(name)
+    , m_start(StartupProfiler::instance()->elapsedNs())
+{
+}
+
+StartupProfiler::Span::~Span()
+{
+    StartupProfiler* profiler = StartupProfiler::instance();
+    profiler->addSpan(m_name, m_start, profiler->elapsedNs());
+}
+
+void StartupProfiler::addSpan(const char* name, qint64 startNs, qint64 endNs)
+{
+    const bool mainThread = !QCoreApplication::instance() || QThread::currentThread() == QCoreApplication::instance()->thread();
+    QMutexLocker locker(&m_mutex);
+    m_spans.append({name, startNs, endNs, mainThread});
+}
+
+QString StartupProfiler::report() const
+{
+    QVector<Record> spans;
+    {
+        QMutexLocker locker(&m_mutex);
+        spans = m_spans;
+    }
+    std::sort(spans.begin(), spans.end(), [](const Record& a, const Record& b) {
+        return a.start < b.start;
+    });
+
+    //Start and duration in milliseconds, and the thread it ran on
+    QString report;
+    for (auto span = spans.cbegin(); span != spans.cend(); ++span) {
+        report += QStringLiteral("%1 ms +%2 ms %3 %4\n")
+            .arg(span->start / 1000000.0, 9, 'f', 3)
+            .arg((span->end - span->start) / 1000000.0, 9, 'f', 3)
+            .arg(span->mainThread ? QStringLiteral("[main]  ") : QStringLiteral("[worker]"))
+            .arg(QLatin1String(span->name));
+    }
+    return report;
+}
+
+void StartupProfiler::dump() const
+{
+    if (qEnvironmentVariableIsSet("KDECONNECT_STARTUP_PROFILE")) {
+        qCInfo(KDECONNECT_CORE).noquote() << "Startup profile:\n" + report();
+    }
+}
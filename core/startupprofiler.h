@@ -0,0 +1,78 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STARTUPPROFILER_H
+#define STARTUPPROFILER_H
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+#include "kdeconnectcore_export.h"
+
+/**
+ * @short Records how long each step of the daemon's startup takes
+ *
+ * Steps are recorded with a Span on the stack, from any thread. The result can be
+ * read with Daemon::startupProfile() over D-Bus, and is logged when the
+ * KDECONNECT_STARTUP_PROFILE environment variable is set.
+ */
+class KDECONNECTCORE_EXPORT StartupProfiler
+{
+public:
+    static StartupProfiler* instance();
+
+    class Span
+    {
+    public:
+        explicit Span(const char* name);
+        ~Span();
+
+    private:
+        Q_DISABLE_COPY(Span)
+        const char* m_name;
+        qint64 m_start;
+    };
+
+    //Time since the profiler was created, which the daemon does first
+    qint64 elapsedNs() const { return m_timer.nsecsElapsed(); }
+
+    void addSpan(const char* name, qint64 startNs, qint64 endNs);
+    QString report() const;
+    //Logs the report if KDECONNECT_STARTUP_PROFILE is set
+    void dump() const;
+
+private:
+    StartupProfiler();
+
+    struct Record {
+        const char* name;
+        qint64 start;
+        qint64 end;
+        bool mainThread;
+    };
+
+    QElapsedTimer m_timer;
+    mutable QMutex m_mutex;
+    QVector<Record> m_spans;
+};
+
+#endif
@@ -28,6 +28,7 @@
 #include <QDBusConnection>
 #include <QTemporaryFile>
 #include <QDateTime>
+#include <QFileInfo>
 
 #include <KLocalizedString>
 #include <KJobTrackerInterface>
@@ -45,9 +46,14 @@ SharePlugin::SharePlugin(QObject* parent, const QVariantList& args)
     : KdeConnectPlugin(parent, args)
     , m_compositeJob()
 {
+    //Transfers interrupted before a previous run ended won't be resumed anymore
+    const QUrl dir = incomingDir();
+    if (dir.isLocalFile()) {
+        FileTransferJob::removeExpiredPartialFiles(dir.toLocalFile());
+    }
 }
 
-QUrl SharePlugin::destinationDir() const
+QUrl SharePlugin::incomingDir() const
 {
     const QString defaultDownloadPath = QStandardPaths::writableLocation(QStandardPaths::DownloadLocation);
     QUrl dir = QUrl::fromLocalFile(config()->get<QString>(QStringLiteral("incoming_path"), defaultDownloadPath));
@@ -56,6 +62,12 @@ QUrl SharePlugin::destinationDir() const
         dir.setPath(dir.path().arg(device()->name()));
     }
 
+    return dir;
+}
+
+QUrl SharePlugin::destinationDir() const
+{
+    const QUrl dir = incomingDir();
     KJob* job = KIO::mkpath(dir);
     bool ret = job->exec();
     if (!ret) {
@@ -114,6 +126,19 @@ bool SharePlugin::receivePacket(const NetworkPacket& np)
 
     qCDebug(KDECONNECT_PLUGIN_SHARE) << "File transfer";
 
+    if (np.type() == PACKET_TYPE_SHARE_REQUEST_UPDATE && np.has(QStringLiteral("sha256"))) {
+        //A digest is sent after each file, before the next file that uses the same port is announced
+        QQueue<QPointer<FileTransferJob>>& pendingDigests = m_pendingDigests[np.get<int>(QStringLiteral("port"))];
+        //Jobs killed without emitting their result are only noticed here
+        pendingDigests.removeAll(QPointer<FileTransferJob>());
+        if (pendingDigests.isEmpty()) {
+            qCWarning(KDECONNECT_PLUGIN_SHARE) << "Received a digest for no file";
+            return true;
+        }
+        pendingDigests.dequeue()->setExpectedDigest(np.get<QByteArray>(QStringLiteral("sha256")));
+        return true;
+    }
+
     if (np.hasPayload() || np.has(QStringLiteral("filename"))) {
 //         qCDebug(KDECONNECT_PLUGIN_SHARE) << "receiving file" << filename << "in" << dir << "into" << destination;
         const QString filename = cleanFilename(np.get<QString>(QStringLiteral("filename"), QString::number(QDateTime::currentMSecsSinceEpoch())));
@@ -129,6 +154,9 @@ bool SharePlugin::receivePacket(const NetworkPacket& np)
 
             FileTransferJob* job = np.createPayloadTransferJob(destination);
             job->setOriginName(device()->name() + QStringLiteral(": ") + filename);
+            if (np.payloadTransferInfo().contains(QStringLiteral("digest"))) {
+                m_pendingDigests[np.payloadTransferInfo().value(QStringLiteral("port")).toInt()].enqueue(job);
+            }
             connect(job, &KJob::result, this, [this, dateModified] (KJob* job) -> void { finished(job, dateModified); });
             m_compositeJob->addSubjob(job);
 
@@ -178,6 +206,16 @@ bool SharePlugin::receivePacket(const NetworkPacket& np)
 void SharePlugin::finished(KJob* job, const qint64 dateModified)
 {
     FileTransferJob* ftjob = qobject_cast<FileTransferJob*>(job);
+    //A job that is done doesn't wait for a digest anymore, which would otherwise go to the next file on its port
+    for (auto it = m_pendingDigests.begin(); it != m_pendingDigests.end(); ) {
+        it->removeAll(ftjob);
+        if (it->isEmpty()) {
+            it = m_pendingDigests.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
     if (ftjob && !job->error()) {
         Q_EMIT shareReceived(ftjob->destination().toString());
         setDateModified(ftjob->destination(), dateModified);
@@ -199,6 +237,8 @@ void SharePlugin::shareUrl(const QUrl& url, bool open)
         QSharedPointer<QIODevice> ioFile(new QFile(url.toLocalFile()));
         packet.setPayload(ioFile, ioFile->size());
         packet.set<QString>(QStringLiteral("filename"), QUrl(url).fileName());
+        //Lets the receiver tell an interrupted transfer of this file apart from another one with the same name and size
+        packet.set<qint64>(QStringLiteral("lastModified"), QFileInfo(url.toLocalFile()).lastModified().toMSecsSinceEpoch());
         packet.set<bool>(QStringLiteral("open"), open);
     } else {
         packet.set<QString>(QStringLiteral("url"), url.toString());
@@ -21,7 +21,9 @@
 #ifndef SHAREPLUGIN_H
 #define SHAREPLUGIN_H
 
+#include <QHash>
 #include <QPointer>
+#include <QQueue>
 
 #include <KIO/Job>
 
@@ -59,10 +61,13 @@ Q_SIGNALS:
 private:
     void finished(KJob* job, const qint64 dateModified);
     void shareUrl(const QUrl& url, bool open);
+    QUrl incomingDir() const;
     QUrl destinationDir() const;
     QUrl getFileDestination(const QString filename) const;
     void setDateModified(const QUrl& destination, const qint64 timestamp);
 
     QPointer<CompositeFileTransferJob> m_compositeJob;
+    //Transfers whose digest hasn't arrived yet by the port they come from, in the order they were announced
+    QHash<int, QQueue<QPointer<FileTransferJob>>> m_pendingDigests;
 };
 #endif
@@ -25,23 +25,71 @@
 #include "requestconversationworker.h"
 
 #include <QDBusConnection>
+#include <QElapsedTimer>
+#include <QThreadPool>
+
+#include <limits>
 
 #include <core/device.h>
+#include <core/kdeconnectconfig.h>
 #include <core/kdeconnectplugin.h>
 
+#include <dbushelper.h>
+#include "qtcompat_p.h"
+
 Q_LOGGING_CATEGORY(KDECONNECT_CONVERSATIONS, "kdeconnect.conversations")
 
 QMap<QString, ConversationsDbusInterface*> ConversationsDbusInterface::liveConversationInterfaces;
 
+namespace {
+    // Workers mostly wait for the remote, so a few of them are enough
+    const int s_maxRequestThreads = 4;
+    // How long a worker waits for the remote before answering with what it has
+    const qint64 s_remoteTimeoutMs = 30000;
+    // Number of messages asked for at once when syncing a conversation
+    const qint64 s_syncPageSize = 50;
+
+    void mergeRange(QHash<qint64, QPair<int, int>>& ranges, const qint64& conversationID, int start, int end)
+    {
+        const auto range = ranges.find(conversationID);
+        if (range == ranges.end()) {
+            ranges.insert(conversationID, qMakePair(start, end));
+        } else {
+            range->first = qMin(range->first, start);
+            range->second = qMax(range->second, end);
+        }
+    }
+}
+
 ConversationsDbusInterface::ConversationsDbusInterface(KdeConnectPlugin* plugin)
     : QDBusAbstractAdaptor(const_cast<Device*>(plugin->device()))
     , m_device(plugin->device()->id())
     , m_plugin(plugin)
+    , m_store(KdeConnectConfig::instance()->deviceDataDir(m_device).absoluteFilePath(QStringLiteral("kdeconnect_sms/messages.log")))
     , m_lastId(0)
     , m_smsInterface(m_device)
+    , m_messageWaits(new MessageWaits)
+    , m_requesterWatcher(QString(), DbusHelper::sessionBus(), QDBusServiceWatcher::WatchForUnregistration)
 {
     ConversationMessage::registerDbusType();
 
+    connect(&m_requesterWatcher, &QDBusServiceWatcher::serviceUnregistered,
+            this, &ConversationsDbusInterface::requesterGone);
+
+    m_syncTimeout.setSingleShot(true);
+    m_syncTimeout.setInterval(static_cast<int>(s_remoteTimeoutMs));
+    connect(&m_syncTimeout, &QTimer::timeout, this, &ConversationsDbusInterface::syncTimedOut);
+
+    // Start with the newest message of every conversation we know, so activeConversations
+    // can answer before the remote does
+    const auto threadIds = m_store.threadIds();
+    for (const qint64& threadId : threadIds) {
+        const ConversationMessage message = m_store.latestMessage(threadId);
+        m_conversations[threadId].insert(message.date(), message);
+        m_known_messages[threadId].insert(message.uID());
+        m_unsynced.insert(threadId);
+    }
+
     // Check for an existing interface for the same device
     // If there is already an interface for this device, we can safely delete is since we have just replaced it
     const auto& oldInterfaceItr = ConversationsDbusInterface::liveConversationInterfaces.find(m_device);
@@ -56,12 +104,17 @@ ConversationsDbusInterface::ConversationsDbusInterface(KdeConnectPlugin* plugin)
 
 ConversationsDbusInterface::~ConversationsDbusInterface()
 {
-    // Wake all threads which were waiting for a reply from this interface
-    // This might result in some noise on dbus, but it's better than leaking a bunch of resources!
-    waitingForMessagesLock.lock();
-    conversationsWaitingForMessages.clear();
-    waitingForMessages.wakeAll();
-    waitingForMessagesLock.unlock();
+    // Workers still running must not come back to this interface
+    for (RequestConversationWorker* worker : qAsConst(m_activeRequests)) {
+        worker->cancel();
+    }
+
+    // Wake all threads which were waiting for a reply from this interface, they only hold on to
+    // m_messageWaits and not to the interface
+    QMutexLocker locker(&m_messageWaits->lock);
+    m_messageWaits->conversations.clear();
+    m_messageWaits->arrived.wakeAll();
+    locker.unlock();
 
     // Erase this interface from the list of known interfaces
     const auto myIterator = ConversationsDbusInterface::liveConversationInterfaces.find(m_device);
@@ -101,16 +154,197 @@ void ConversationsDbusInterface::requestConversation(const qint64& conversationI
         return;
     }
 
-    RequestConversationWorker* worker = new RequestConversationWorker(conversationID, start, end, this);
-    connect(worker, &RequestConversationWorker::conversationMessageRead,
-            this, &ConversationsDbusInterface::conversationUpdated,
+    loadConversation(conversationID, end);
+
+    const bool synced = !m_unsynced.contains(conversationID);
+    if (synced) {
+        // Whatever is cached is answered right away, only the rest waits for the remote
+        start += replyFromCache(conversationID, start, end);
+        if (isCovered(conversationID, end)) {
+            return;
+        }
+    } else {
+        // The stored messages are shown meanwhile, the range is answered again after the sync
+        replyFromCache(conversationID, start, end);
+    }
+
+    const QString requester = calledFromDBus() ? message().service() : QString();
+    m_requesters[conversationID].insert(requester);
+    if (!requester.isEmpty()) {
+        m_requesterWatcher.addWatchedService(requester);
+    }
+
+    if (!synced) {
+        mergeRange(m_rangesWaitingForSync, conversationID, start, end);
+        if (!m_syncing.contains(conversationID)) {
+            // The previous sync timed out, or the remote never mentioned this conversation
+            m_syncing.insert(conversationID, { m_store.latestDate(conversationID), std::numeric_limits<qint64>::max() });
+            m_smsInterface.requestConversation(conversationID, -1, s_syncPageSize);
+            m_syncTimeout.start();
+        }
+        return;
+    }
+
+    waitForRemote(conversationID, start, end);
+}
+
+void ConversationsDbusInterface::waitForRemote(const qint64& conversationID, int start, int end)
+{
+    if (m_activeRequests.contains(conversationID)) {
+        // Answered together once the current request is done, so scrolling quickly doesn't
+        // keep a thread busy for every step
+        mergeRange(m_queuedRequests, conversationID, start, end);
+        return;
+    }
+
+    startRequest(conversationID, start, end);
+}
+
+int ConversationsDbusInterface::replyFromCache(const qint64& conversationID, int start, int end)
+{
+    // Messages are sorted in ascending order of keys, meaning the front of the map has the oldest
+    // messages (smallest timestamp number)
+    // Therefore, return the end of the map first (most recent messages)
+    const auto conversation = m_conversations.constFind(conversationID);
+    if (conversation == m_conversations.constEnd()) {
+        return 0;
+    }
+
+    int index = 0;
+    int replied = 0;
+    for (auto it = conversation->constEnd(); it != conversation->constBegin() && index < end; ++index) {
+        --it;
+        if (index >= start) {
+            Q_EMIT conversationUpdated(it->toVariant());
+            replied++;
+        }
+    }
+    return replied;
+}
+
+void ConversationsDbusInterface::startRequest(const qint64& conversationID, int start, int end)
+{
+    // If we don't have enough messages in cache, go get the page before the oldest one we have.
+    // Remotes which don't know about ranges send the whole conversation instead
+    const QMap<qint64, ConversationMessage> conversation = m_conversations.value(conversationID);
+    if (conversation.isEmpty()) {
+        // Since there are no messages in the conversation, it's likely that it is a junk ID, but go ahead anyway
+        qCWarning(KDECONNECT_CONVERSATIONS) << "Got a conversationID for a conversation with no messages!" << conversationID;
+    }
+    // The page starts with the oldest message we have, so it is asked for once more
+    const qint64 rangeStartTimestamp = conversation.isEmpty() ? -1 : conversation.firstKey();
+    const qint64 numberToRequest = qint64(end) - conversation.size() + (conversation.isEmpty() ? 0 : 1);
+    m_requestedPages.insert(conversationID, qMakePair(rangeStartTimestamp, numberToRequest));
+
+    // Asked for here rather than by the worker, which must not use the interface
+    qCDebug(KDECONNECT_CONVERSATIONS) << "Requesting conversation with ID" << conversationID << "from remote"
+                                      << "starting at" << rangeStartTimestamp << "count" << numberToRequest;
+    m_messageWaits->lock.lock();
+    m_messageWaits->conversations.insert(conversationID);
+    m_messageWaits->lock.unlock();
+    m_smsInterface.requestConversation(conversationID, rangeStartTimestamp, numberToRequest);
+
+    RequestConversationWorker* worker = new RequestConversationWorker(conversationID, m_messageWaits);
+    connect(worker, &RequestConversationWorker::finished,
+            this, [this, conversationID] { requestFinished(conversationID); },
             Qt::QueuedConnection);
-    worker->work();
+    m_activeRequests.insert(conversationID, worker);
+    m_waitingRanges.insert(conversationID, qMakePair(start, end));
+    requestPool()->start(worker);
+}
+
+void ConversationsDbusInterface::requestFinished(const qint64& conversationID)
+{
+    m_activeRequests.remove(conversationID);
+    m_requestedPages.remove(conversationID);
+
+    // Not there if the request was cancelled
+    const auto waiting = m_waitingRanges.find(conversationID);
+    if (waiting != m_waitingRanges.end()) {
+        replyFromCache(conversationID, waiting->first, waiting->second);
+        m_waitingRanges.erase(waiting);
+    }
+
+    const auto queued = m_queuedRequests.find(conversationID);
+    if (queued != m_queuedRequests.end()) {
+        const QPair<int, int> range = *queued;
+        m_queuedRequests.erase(queued);
+        const int start = range.first + replyFromCache(conversationID, range.first, range.second);
+        if (!isCovered(conversationID, range.second)) {
+            startRequest(conversationID, start, range.second);
+            return;
+        }
+    }
+
+    m_requesters.remove(conversationID);
+}
+
+void ConversationsDbusInterface::requesterGone(const QString& service)
+{
+    m_requesterWatcher.removeWatchedService(service);
+
+    for (auto it = m_requesters.begin(); it != m_requesters.end();) {
+        if (!it->remove(service) || !it->isEmpty()) {
+            ++it;
+            continue;
+        }
+
+        const qint64 conversationID = it.key();
+        it = m_requesters.erase(it);
+        m_queuedRequests.remove(conversationID);
+        m_waitingRanges.remove(conversationID);
+        m_rangesWaitingForSync.remove(conversationID);
+
+        RequestConversationWorker* worker = m_activeRequests.value(conversationID);
+        if (worker) {
+            qCDebug(KDECONNECT_CONVERSATIONS) << "Cancelling request for conversation" << conversationID << "since" << service << "went away";
+            worker->cancel();
+
+            // Wake the worker in case it waits for the remote
+            m_messageWaits->done({conversationID});
+        }
+    }
+}
+
+QThreadPool* ConversationsDbusInterface::requestPool()
+{
+    // Never destroyed, so exiting doesn't wait for workers blocked on the remote
+    static QThreadPool* pool = [] {
+        QThreadPool* pool = new QThreadPool();
+        pool->setMaxThreadCount(s_maxRequestThreads);
+        return pool;
+    }();
+    return pool;
+}
+
+void ConversationsDbusInterface::loadConversation(const qint64& conversationID, int end)
+{
+    // Read backwards from the newest stored message, so only what was asked for is read
+    auto loadedBefore = m_loadedBefore.find(conversationID);
+    if (loadedBefore == m_loadedBefore.end()) {
+        loadedBefore = m_loadedBefore.insert(conversationID, std::numeric_limits<qint64>::max());
+    }
+
+    while (*loadedBefore != std::numeric_limits<qint64>::min()) {
+        const int missing = end - m_conversations.value(conversationID).size();
+        if (missing <= 0) {
+            break;
+        }
+        const auto messages = m_store.conversation(conversationID, *loadedBefore, missing);
+        *loadedBefore = messages.size() < missing ? std::numeric_limits<qint64>::min() : messages.first().date();
+        for (const auto& message : messages) {
+            if (!m_known_messages[conversationID].contains(message.uID())) {
+                m_conversations[conversationID].insert(message.date(), message);
+                m_known_messages[conversationID].insert(message.uID());
+            }
+        }
+    }
 }
 
 void ConversationsDbusInterface::addMessages(const QList<ConversationMessage> &messages)
 {
     QSet<qint64> updatedConversationIDs;
+    QList<ConversationMessage> newMessages;
 
     for (const auto& message : messages) {
         const qint32& threadId = message.threadID();
@@ -123,7 +357,14 @@ void ConversationsDbusInterface::addMessages(const QList<ConversationMessage> &m
         updatedConversationIDs.insert(message.threadID());
 
         if (m_known_messages[threadId].contains(message.uID())) {
-            // This message has already been processed. Don't do anything.
+            // This message has already been processed, only its read flag can have changed
+            auto known = m_conversations[threadId].find(message.date());
+            if (known != m_conversations[threadId].end() && known->uID() == message.uID()) {
+                *known = message;
+            }
+            if (!m_store.contains(message)) {
+                newMessages.append(message);
+            }
             continue;
         }
 
@@ -132,6 +373,10 @@ void ConversationsDbusInterface::addMessages(const QList<ConversationMessage> &m
         const auto& threadPosition = m_conversations[threadId].insert(message.date(), message);
         m_known_messages[threadId].insert(message.uID());
 
+        if (!m_store.contains(message)) {
+            newMessages.append(message);
+        }
+
         // If this message was inserted at the end of the list, it is the latest message in the conversation
         bool latestMessage = threadPosition == m_conversations[threadId].end() - 1;
 
@@ -143,11 +388,12 @@ void ConversationsDbusInterface::addMessages(const QList<ConversationMessage> &m
         }
     }
 
-    waitingForMessagesLock.lock();
+    m_store.append(newMessages);
+    syncProgress(messages);
+    pageProgress(messages);
+
     // Remove the waiting flag for all conversations which we just processed
-    conversationsWaitingForMessages.subtract(updatedConversationIDs);
-    waitingForMessages.wakeAll();
-    waitingForMessagesLock.unlock();
+    m_messageWaits->done(updatedConversationIDs);
 }
 
 void ConversationsDbusInterface::removeMessage(const QString& internalId)
@@ -161,22 +407,170 @@ QList<ConversationMessage> ConversationsDbusInterface::getConversation(const qin
     return m_conversations.value(conversationID).values();
 }
 
-void ConversationsDbusInterface::updateConversation(const qint64& conversationID)
+void MessageWaits::waitFor(const qint64& conversationID)
+{
+    QMutexLocker locker(&lock);
+
+    // Don't hold a thread of the pool forever if the remote never answers
+    QElapsedTimer waiting;
+    waiting.start();
+    while (conversations.contains(conversationID)) {
+        const qint64 remaining = s_remoteTimeoutMs - waiting.elapsed();
+        if (remaining <= 0 || !arrived.wait(&lock, static_cast<unsigned long>(remaining))) {
+            if (conversations.remove(conversationID)) {
+                qCWarning(KDECONNECT_CONVERSATIONS) << "Timed out waiting for conversation" << conversationID << "from remote";
+            }
+            break;
+        }
+    }
+}
+
+void MessageWaits::done(const QSet<qint64>& conversationIDs)
+{
+    QMutexLocker locker(&lock);
+    conversations.subtract(conversationIDs);
+    arrived.wakeAll();
+}
+
+void ConversationsDbusInterface::syncWithRemote()
+{
+    bool requestAll = false;
+    for (const qint64& conversationID : qAsConst(m_unsynced)) {
+        if (!m_syncing.contains(conversationID)) {
+            m_syncing.insert(conversationID, { m_store.latestDate(conversationID), -1 });
+            requestAll = true;
+        }
+    }
+
+    // The newest message of every conversation tells which ones got messages since
+    if (requestAll) {
+        m_smsInterface.requestAllConversations();
+        m_syncTimeout.start();
+    }
+}
+
+void ConversationsDbusInterface::syncProgress(const QList<ConversationMessage>& messages)
+{
+    if (m_syncing.isEmpty()) {
+        return;
+    }
+
+    struct Page {
+        qint64 newest = std::numeric_limits<qint64>::min();
+        qint64 oldest = std::numeric_limits<qint64>::max();
+        qint64 count = 0;
+        bool reachedStored = false;
+    };
+    QHash<qint64, Page> pages;
+    for (const auto& message : messages) {
+        const auto sync = m_syncing.constFind(message.threadID());
+        if (sync == m_syncing.constEnd()) {
+            continue;
+        }
+        // Newer messages were just received, they don't answer the request
+        if (sync->requestedBefore >= 0 && message.date() > sync->requestedBefore) {
+            continue;
+        }
+        Page& page = pages[message.threadID()];
+        page.newest = qMax(page.newest, message.date());
+        page.oldest = qMin(page.oldest, message.date());
+        page.count++;
+        page.reachedStored |= message.date() <= sync->storedDate;
+    }
+
+    for (auto it = pages.constBegin(); it != pages.constEnd(); ++it) {
+        const qint64 conversationID = it.key();
+        SyncState& sync = m_syncing[conversationID];
+        // A short page means the remote has nothing older, remotes which don't know about
+        // ranges send the whole conversation, which reaches the stored date
+        if (it->reachedStored || (sync.requestedBefore >= 0 && it->count < s_syncPageSize)) {
+            syncFinished(conversationID);
+            continue;
+        }
+        sync.requestedBefore = sync.requestedBefore < 0 ? it->newest : it->oldest;
+        m_smsInterface.requestConversation(conversationID, sync.requestedBefore, s_syncPageSize);
+    }
+
+    if (m_syncing.isEmpty()) {
+        m_syncTimeout.stop();
+    } else if (!pages.isEmpty()) {
+        m_syncTimeout.start();
+    }
+}
+
+void ConversationsDbusInterface::syncFinished(const qint64& conversationID)
 {
-    waitingForMessagesLock.lock();
-    if (conversationsWaitingForMessages.contains(conversationID)) {
-        // This conversation is already being waited on, don't allow more than one thread to wait at a time
-        qCDebug(KDECONNECT_CONVERSATIONS) << "Not allowing two threads to wait for conversationID" << conversationID;
-        waitingForMessagesLock.unlock();
+    m_syncing.remove(conversationID);
+    m_unsynced.remove(conversationID);
+
+    const auto waiting = m_rangesWaitingForSync.find(conversationID);
+    if (waiting == m_rangesWaitingForSync.end()) {
         return;
     }
-    qCDebug(KDECONNECT_CONVERSATIONS) << "Requesting conversation with ID" << conversationID << "from remote";
-    conversationsWaitingForMessages.insert(conversationID);
-    m_smsInterface.requestConversation(conversationID);
-    while (conversationsWaitingForMessages.contains(conversationID)) {
-        waitingForMessages.wait(&waitingForMessagesLock);
+    const QPair<int, int> range = *waiting;
+    m_rangesWaitingForSync.erase(waiting);
+
+    const int start = range.first + replyFromCache(conversationID, range.first, range.second);
+    if (!isCovered(conversationID, range.second)) {
+        waitForRemote(conversationID, start, range.second);
+    } else if (!m_activeRequests.contains(conversationID)) {
+        m_requesters.remove(conversationID);
+    }
+}
+
+void ConversationsDbusInterface::syncTimedOut()
+{
+    qCWarning(KDECONNECT_CONVERSATIONS) << "Timed out syncing conversations" << m_syncing.keys() << "with remote";
+
+    // They stay unsynced, so they are synced again on the next connection. The requests
+    // waiting for them already got the stored messages
+    const auto timedOut = m_syncing.keys();
+    m_syncing.clear();
+    for (const qint64& conversationID : timedOut) {
+        if (m_rangesWaitingForSync.remove(conversationID)) {
+            m_requesters.remove(conversationID);
+        }
+    }
+}
+
+void ConversationsDbusInterface::pageProgress(const QList<ConversationMessage>& messages)
+{
+    if (m_requestedPages.isEmpty()) {
+        return;
+    }
+
+    QHash<qint64, qint64> counts;
+    for (const auto& message : messages) {
+        const auto page = m_requestedPages.constFind(message.threadID());
+        if (page == m_requestedPages.constEnd()) {
+            continue;
+        }
+        // Newer messages were just received, they don't answer the request
+        if (page->first >= 0 && message.date() > page->first) {
+            continue;
+        }
+        counts[message.threadID()]++;
+    }
+
+    for (auto it = counts.constBegin(); it != counts.constEnd(); ++it) {
+        const QPair<qint64, qint64> page = m_requestedPages.take(it.key());
+        // The remote sends fewer messages than asked for once it has no older ones
+        if (it.value() < page.second) {
+            m_oldestReached.insert(it.key());
+        }
+    }
+}
+
+bool ConversationsDbusInterface::isCovered(const qint64& conversationID, int end) const
+{
+    if (m_unsynced.contains(conversationID)) {
+        return false;
+    }
+    if (m_oldestReached.contains(conversationID)) {
+        return true;
     }
-    waitingForMessagesLock.unlock();
+    const auto conversation = m_conversations.constFind(conversationID);
+    return conversation != m_conversations.constEnd() && conversation->size() >= end;
 }
 
 void ConversationsDbusInterface::replyToConversation(const qint64& conversationID, const QString& message)
@@ -23,6 +23,8 @@
 #define CONVERSATIONSDBUSINTERFACE_H
 
 #include <QDBusAbstractAdaptor>
+#include <QDBusContext>
+#include <QDBusServiceWatcher>
 #include <QHash>
 #include <QList>
 #include <QMap>
@@ -30,17 +32,50 @@
 #include <QStringList>
 #include <QDir>
 #include <QPointer>
+#include <QSet>
+#include <QSharedPointer>
+#include <QMutex>
+#include <QTimer>
+#include <QWaitCondition>
 
 #include "interfaces/conversationmessage.h"
 #include "interfaces/dbusinterfaces.h"
+#include "smsstore.h"
 
 class KdeConnectPlugin;
 class Device;
+class QThreadPool;
+class RequestConversationWorker;
 
 Q_DECLARE_LOGGING_CATEGORY(KDECONNECT_CONVERSATIONS)
 
+/**
+ * Conversations whose messages were asked for from the remote and not received yet
+ *
+ * Shared by the interface and its workers, so workers still waiting when the interface is
+ * deleted don't use it
+ */
+struct MessageWaits
+{
+    QSet<qint64> conversations;
+    QMutex lock;
+    QWaitCondition arrived;
+
+    /**
+     * Block until the messages of the conversation arrived, the wait was cancelled or the remote
+     * took too long to answer
+     */
+    void waitFor(const qint64& conversationID);
+
+    /**
+     * Wake the workers waiting for any of the conversations
+     */
+    void done(const QSet<qint64>& conversationIDs);
+};
+
 class ConversationsDbusInterface
     : public QDBusAbstractAdaptor
+    , protected QDBusContext
 {
     Q_OBJECT
     Q_CLASSINFO("D-Bus Interface", "org.kde.kdeconnect.device.conversations")
@@ -58,10 +93,10 @@ public:
     QList<ConversationMessage> getConversation(const qint64& conversationID) const;
 
     /**
-     * Get all of the messages in the requested conversation from the remote device
-     * TODO: Make interface capable of requesting smaller window of messages
+     * Ask the remote for the messages it got while we were not connected to it, newer than the
+     * newest one stored of every conversation read from disk
      */
-    void updateConversation(const qint64& conversationID);
+    void syncWithRemote();
 
 public Q_SLOTS:
     /**
@@ -113,6 +148,59 @@ Q_SIGNALS:
 private /*methods*/:
     QString newId(); //Generates successive identifitiers to use as public ids
 
+    /**
+     * Read stored messages of the conversation, newest first, until m_conversations has at least
+     * @p end of them or every stored message was read
+     */
+    void loadConversation(const qint64& conversationID, int end);
+
+    /**
+     * Hand [start, end) to the worker of the conversation, or queue it if a worker is busy already
+     */
+    void waitForRemote(const qint64& conversationID, int start, int end);
+
+    /**
+     * Go on with the sync of the conversations the messages belong to, see m_syncing
+     */
+    void syncProgress(const QList<ConversationMessage>& messages);
+    void syncFinished(const qint64& conversationID);
+    void syncTimedOut();
+
+    /**
+     * Note the conversations whose remote sent fewer older messages than a worker asked for
+     */
+    void pageProgress(const QList<ConversationMessage>& messages);
+
+    /**
+     * Whether the cached messages are all the messages in [0, end) of the conversation: it is
+     * synced, and either enough messages are cached or the remote has no older ones
+     */
+    bool isCovered(const qint64& conversationID, int end) const;
+
+    /**
+     * Emit conversationUpdated for the cached messages in [start, end), counted from the newest one
+     *
+     * @return Number of messages emitted
+     */
+    int replyFromCache(const qint64& conversationID, int start, int end);
+
+    /**
+     * Hand the wait for the remote to a worker of the pool, which becomes the active request of
+     * the conversation. [start, end) is replied from the cache once it finishes
+     */
+    void startRequest(const qint64& conversationID, int start, int end);
+    void requestFinished(const qint64& conversationID);
+
+    /**
+     * Drop the requests of a D-Bus client which went away, unless someone else waits for them too
+     */
+    void requesterGone(const QString& service);
+
+    /**
+     * Shared by the interfaces of every device, so a burst of requests can't start a thread each
+     */
+    static QThreadPool* requestPool();
+
 private /*attributes*/:
     const QString m_device;
     KdeConnectPlugin* m_plugin;
@@ -130,6 +218,46 @@ private /*attributes*/:
      */
     QHash<qint64, QSet<qint32>> m_known_messages;
 
+    /**
+     * Messages received from the device in previous sessions
+     *
+     * Only the newest message of every conversation is read when starting, the rest of a
+     * conversation is read as far back as it is requested
+     */
+    SmsStore m_store;
+    /**
+     * Mapping of threadID to the date of the oldest message read from m_store, the stored messages
+     * older than it are not read yet
+     */
+    QHash<qint64, qint64> m_loadedBefore;
+
+    /**
+     * Conversations read from disk which may miss the messages the remote got while we were not
+     * connected. Their stored messages are shown, but don't count as covering a requested range
+     * until the messages newer than the newest stored one were fetched
+     */
+    QSet<qint64> m_unsynced;
+
+    /**
+     * The newest stored date of every conversation being synced, and the date of the page asked
+     * for, or -1 while waiting for the newest message of the conversation. Pages are asked for
+     * backwards from the newest message, until one reaches the stored date
+     */
+    struct SyncState {
+        qint64 storedDate;
+        qint64 requestedBefore;
+    };
+    QHash<qint64, SyncState> m_syncing;
+    QHash<qint64, QPair<int, int>> m_rangesWaitingForSync;
+    QTimer m_syncTimeout;
+
+    /**
+     * The rangeStartTimestamp and numberToRequest of the page a worker asked for, and the
+     * conversations whose oldest message is cached already
+     */
+    QHash<qint64, QPair<qint64, qint64>> m_requestedPages;
+    QSet<qint64> m_oldestReached;
+
     /*
      * Keep a map of all interfaces ever constructed
      * Because of how Qt's Dbus is designed, we are unable to immediately delete the interface once
@@ -143,9 +271,22 @@ private /*attributes*/:
 
     SmsDbusInterface m_smsInterface;
 
-    QSet<qint64> conversationsWaitingForMessages;
-    QMutex waitingForMessagesLock;
-    QWaitCondition waitingForMessages;
+    QSharedPointer<MessageWaits> m_messageWaits;
+
+    /**
+     * Only one worker at a time waits for the remote for each conversation, for the part of the
+     * range the cache did not answer. Ranges requested while the worker is busy are merged, and
+     * waited for by a single worker once it finishes
+     */
+    QHash<qint64, RequestConversationWorker*> m_activeRequests;
+    QHash<qint64, QPair<int, int>> m_waitingRanges;
+    QHash<qint64, QPair<int, int>> m_queuedRequests;
+
+    /**
+     * D-Bus clients waiting for each conversation, an empty name stands for calls not made over D-Bus
+     */
+    QHash<qint64, QSet<QString>> m_requesters;
+    QDBusServiceWatcher m_requesterWatcher;
 };
 
 #endif // CONVERSATIONSDBUSINTERFACE_H
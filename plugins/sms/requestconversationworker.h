@@ -23,58 +23,50 @@
 
 #include "conversationsdbusinterface.h"
 
+#include <QAtomicInt>
 #include <QObject>
-#include <QThread>
+#include <QRunnable>
+#include <QSharedPointer>
 
 /**
  * In case we need to wait for more messages to be downloaded from Android,
- * Do the actual work of a requestConversation call in a separate thread
+ * wait for them in ConversationsDbusInterface's worker pool
  *
- * This class is the worker for that thread
+ * The interface asks the remote for the messages and replies with the cached messages itself,
+ * before starting the worker and once it emits finished. The worker only shares the
+ * MessageWaits of the interface, which may be deleted while it waits. The worker is deleted
+ * once it emits finished
  */
-class RequestConversationWorker : public QObject
+class RequestConversationWorker : public QObject, public QRunnable
 {
     Q_OBJECT
 
 public:
-    RequestConversationWorker(const qint64& conversationID, int start, int end, ConversationsDbusInterface* interface);
+    RequestConversationWorker(const qint64& conversationID, const QSharedPointer<MessageWaits>& waits);
 
-
-public Q_SLOTS:
     /**
      * Main body of this worker
      *
-     * Reply to a request for messages and, if needed, wait for the remote to reply with more
+     * Wait until the remote replied or timed out
+     */
+    void run() override;
+
+    /**
+     * Stop replying as soon as possible, because nobody is waiting for the messages anymore
      *
-     * Emits conversationMessageRead for every message handled
+     * Called from the thread of the interface, the worker still emits finished
      */
-    void handleRequestConversation();
-    void work();
+    void cancel() { m_cancelled.storeRelease(1); }
+    bool isCancelled() const { return m_cancelled.loadAcquire(); }
 
 Q_SIGNALS:
-    void conversationMessageRead(const QVariantMap& msg);
     void finished();
 
 private:
     qint64 conversationID;
-    int start; // Start of range to request messages
-    size_t howMany; // Number of messages being requested
-    ConversationsDbusInterface* parent;
-
-    QThread* m_thread;
+    QSharedPointer<MessageWaits> m_waits;
 
-    /**
-     * Reply with all messages we currently have available in the requested range
-     *
-     * If the range specified by start and howMany is not in the range of messages in the conversation,
-     * reply with only as many messages as we have available in that range
-     *
-     * @param conversation Conversation to send messages from
-     * @param start Start of requested range, 0-indexed, inclusive
-     * @param howMany Maximum number of messages to return
-     * $return Number of messages processed
-     */
-    size_t replyForConversation(const QList<ConversationMessage>& conversation, int start, size_t howMany);
+    QAtomicInt m_cancelled;
 };
 
 #endif // REQUESTCONVERSATIONWORKER_H
@@ -58,6 +58,12 @@ bool SmsPlugin::receivePacket(const NetworkPacket& np)
     return true;
 }
 
+void SmsPlugin::connected()
+{
+    // Fetch what the remote got while we were not connected to it
+    m_conversationInterface->syncWithRemote();
+}
+
 void SmsPlugin::sendSms(const QString& phoneNumber, const QString& messageBody)
 {
     NetworkPacket np(PACKET_TYPE_SMS_REQUEST, {
@@ -76,10 +82,16 @@ void SmsPlugin::requestAllConversations()
     sendPacket(np);
 }
 
-void SmsPlugin::requestConversation (const qint64& conversationID) const
+void SmsPlugin::requestConversation (const qint64& conversationID, const qint64& rangeStartTimestamp, const qint64& numberToRequest) const
 {
     NetworkPacket np(PACKET_TYPE_SMS_REQUEST_CONVERSATION);
     np.set(QStringLiteral("threadID"), conversationID);
+    if (rangeStartTimestamp >= 0) {
+        np.set(QStringLiteral("rangeStartTimestamp"), rangeStartTimestamp);
+    }
+    if (numberToRequest >= 0) {
+        np.set(QStringLiteral("numberToRequest"), numberToRequest);
+    }
 
     sendPacket(np);
 }
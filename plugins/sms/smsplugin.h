@@ -77,11 +77,22 @@
 #define PACKET_TYPE_SMS_REQUEST_CONVERSATIONS QStringLiteral("kdeconnect.sms.request_conversations")
 
 /**
- * Packet sent to request all the messages in a particular conversation
+ * Packet sent to request the messages in a particular conversation
  *
- * The body should contain the key "threadID" mapping to the threadID being requested
+ * The following fields are available:
+ * "threadID": <long>            // (Required) ThreadID to request
+ * "rangeStartTimestamp": <long> // (Optional) Millisecond epoch timestamp of the newest message to return,
+ *                               // the messages older than it are returned
+ * "numberToRequest": <long>     // (Optional) Number of messages to return, starting from rangeStartTimestamp.
+ *                               // May return fewer than expected if there are not enough or more than expected if many
+ *                               // messages have the same timestamp.
+ *
+ * Without the optional fields, or with a remote which does not know them, every message is returned
  * For example:
- * { "threadID": 203 }
+ * { "threadID": 203,
+ *   "rangeStartTimestamp": 1518846484880,
+ *   "numberToRequest": 50
+ * }
  */
 #define PACKET_TYPE_SMS_REQUEST_CONVERSATION QStringLiteral("kdeconnect.sms.request_conversation")
 
@@ -98,7 +109,7 @@ public:
     ~SmsPlugin() override;
 
     bool receivePacket(const NetworkPacket& np) override;
-    void connected() override {}
+    void connected() override;
 
     QString dbusPath() const override;
 
@@ -113,9 +124,10 @@ public Q_SLOTS:
     /**
      * Send a request to the remote for a particular conversation
      *
-     * TODO: Make interface capable of requesting limited window of messages
+     * @param rangeStartTimestamp Date of the newest message wanted, or -1 to start from the newest one
+     * @param numberToRequest Number of messages wanted, or -1 for all of them
      */
-    Q_SCRIPTABLE void requestConversation(const qint64& conversationID) const;
+    Q_SCRIPTABLE void requestConversation(const qint64& conversationID, const qint64& rangeStartTimestamp = -1, const qint64& numberToRequest = -1) const;
 
 private:
 
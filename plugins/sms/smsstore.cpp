@@ -0,0 +1,257 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "smsstore.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+
+namespace {
+    const quint32 s_magic = 0x4b534d53; // "KSMS"
+    const quint32 s_version = 2;
+    const int s_headerSize = 2 * sizeof(quint32);
+    // Below this, rewriting the log isn't worth it
+    const int s_compactMinRecords = 1000;
+}
+
+SmsStore::SmsStore(const QString& path)
+    : m_file(path)
+{
+    const QString dir = QFileInfo(path).absolutePath();
+    QDir().mkpath(dir);
+    QFile::setPermissions(dir, QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        qWarning() << "Could not open the message store" << path << m_file.errorString();
+        return;
+    }
+    // Before anything is written, messages are private
+    m_file.setPermissions(QFile::ReadOwner | QFile::WriteOwner);
+    load();
+}
+
+void SmsStore::load()
+{
+    QDataStream stream(&m_file);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic = 0, version = 0;
+    stream >> magic >> version;
+    if (magic != s_magic || version != s_version) {
+        if (m_file.size() > 0) {
+            qWarning() << "Discarding message store" << m_file.fileName() << "with unknown format" << version;
+        }
+        m_file.resize(0);
+        m_file.seek(0);
+        stream.resetStatus();
+        stream << s_magic << s_version;
+        m_file.flush();
+        return;
+    }
+
+    //Only the start of every record is read, the messages are read when asked for
+    const qint64 size = m_file.size();
+    qint64 pos = s_headerSize;
+    int records = 0;
+    while (pos < size) {
+        quint32 length = 0;
+        qint64 threadId = 0, date = 0;
+        qint32 uID = 0, read = 0;
+        stream >> length >> threadId >> date >> uID >> read;
+        if (stream.status() != QDataStream::Ok || pos + qint64(sizeof(quint32)) + length > size) {
+            //The daemon stopped while writing, the messages will be requested again
+            qWarning() << "Truncating incomplete record in message store" << m_file.fileName();
+            m_file.resize(pos);
+            break;
+        }
+        m_index[threadId].insert(date, pos);
+        m_known_messages[threadId].insert(uID, read);
+        records++;
+        pos += sizeof(quint32) + length;
+        m_file.seek(pos);
+    }
+
+    //Every change of a read flag leaves the previous record of the message behind
+    int liveRecords = 0;
+    for (const QMap<qint64, qint64>& thread : qAsConst(m_index)) {
+        liveRecords += thread.size();
+    }
+    if (records >= s_compactMinRecords && liveRecords * 2 < records) {
+        compact();
+    }
+}
+
+void SmsStore::compact()
+{
+    //Written next to the log and renamed over it, so stopping halfway keeps the old log
+    QSaveFile compacted(m_file.fileName());
+    if (!compacted.open(QIODevice::WriteOnly)) {
+        qWarning() << "Could not compact message store" << m_file.fileName() << compacted.errorString();
+        return;
+    }
+    compacted.setPermissions(QFile::ReadOwner | QFile::WriteOwner);
+
+    QDataStream out(&compacted);
+    out.setVersion(QDataStream::Qt_5_6);
+    out << s_magic << s_version;
+
+    QDataStream in(&m_file);
+    in.setVersion(QDataStream::Qt_5_6);
+    for (const QMap<qint64, qint64>& thread : qAsConst(m_index)) {
+        for (qint64 offset : thread) {
+            m_file.seek(offset);
+            quint32 length = 0;
+            in >> length;
+            const QByteArray record = m_file.read(length);
+            out << length;
+            out.writeRawData(record.constData(), record.size());
+        }
+    }
+    if (in.status() != QDataStream::Ok) {
+        qWarning() << "Could not compact message store" << m_file.fileName() << "which could not be read";
+        compacted.cancelWriting();
+        return;
+    }
+
+    //Some platforms can't replace a file which is still open
+    m_file.close();
+    const bool replaced = compacted.commit();
+    if (!replaced) {
+        qWarning() << "Could not compact message store" << m_file.fileName() << compacted.errorString();
+    }
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        qWarning() << "Could not open the message store" << m_file.fileName() << m_file.errorString();
+        return;
+    }
+    if (replaced) {
+        m_index.clear();
+        m_known_messages.clear();
+        load();
+    }
+}
+
+bool SmsStore::contains(qint64 threadId, qint32 uID) const
+{
+    return m_known_messages.value(threadId).contains(uID);
+}
+
+bool SmsStore::contains(const ConversationMessage& message) const
+{
+    const auto thread = m_known_messages.constFind(message.threadID());
+    if (thread == m_known_messages.constEnd()) {
+        return false;
+    }
+    const auto stored = thread->constFind(message.uID());
+    return stored != thread->constEnd() && *stored == message.read();
+}
+
+void SmsStore::append(const QList<ConversationMessage>& messages)
+{
+    if (messages.isEmpty() || !m_file.isOpen()) {
+        return;
+    }
+
+    //Written in one go, so a batch costs a single write
+    QByteArray buffer;
+    QDataStream stream(&buffer, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    qint64 pos = m_file.size();
+    for (const ConversationMessage& message : messages) {
+        QByteArray record;
+        QDataStream recordStream(&record, QIODevice::WriteOnly);
+        recordStream.setVersion(QDataStream::Qt_5_6);
+        recordStream << message.threadID() << message.date() << message.uID() << message.read()
+                     << message.eventField() << message.body() << message.address()
+                     << message.type();
+
+        stream << quint32(record.size());
+        stream.writeRawData(record.constData(), record.size());
+
+        m_index[message.threadID()].insert(message.date(), pos);
+        m_known_messages[message.threadID()].insert(message.uID(), message.read());
+        pos += sizeof(quint32) + record.size();
+    }
+
+    m_file.seek(m_file.size());
+    if (m_file.write(buffer) != buffer.size()) {
+        qWarning() << "Could not write to message store" << m_file.fileName() << m_file.errorString();
+    }
+    m_file.flush();
+}
+
+ConversationMessage SmsStore::readAt(qint64 offset) const
+{
+    m_file.seek(offset);
+    QDataStream stream(&m_file);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    quint32 length;
+    qint64 threadId, date;
+    qint32 uID, eventField, type, read;
+    QString body, address;
+    stream >> length >> threadId >> date >> uID >> read >> eventField >> body >> address >> type;
+    return ConversationMessage(eventField, body, address, date, type, read, threadId, uID);
+}
+
+ConversationMessage SmsStore::latestMessage(qint64 threadId) const
+{
+    const auto thread = m_index.constFind(threadId);
+    if (thread == m_index.constEnd() || thread->isEmpty()) {
+        return ConversationMessage();
+    }
+    return readAt(thread->last());
+}
+
+qint64 SmsStore::latestDate(qint64 threadId) const
+{
+    const auto thread = m_index.constFind(threadId);
+    if (thread == m_index.constEnd() || thread->isEmpty()) {
+        return -1;
+    }
+    return thread->lastKey();
+}
+
+QList<ConversationMessage> SmsStore::conversation(qint64 threadId) const
+{
+    QList<ConversationMessage> messages;
+    const QMap<qint64, qint64> thread = m_index.value(threadId);
+    messages.reserve(thread.size());
+    for (qint64 offset : thread) {
+        messages.append(readAt(offset));
+    }
+    return messages;
+}
+
+QList<ConversationMessage> SmsStore::conversation(qint64 threadId, qint64 before, int count) const
+{
+    QList<ConversationMessage> messages;
+    const auto thread = m_index.constFind(threadId);
+    if (thread == m_index.constEnd() || count <= 0) {
+        return messages;
+    }
+    for (auto it = thread->lowerBound(before); it != thread->constBegin() && messages.size() < count;) {
+        --it;
+        messages.prepend(readAt(*it));
+    }
+    return messages;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SMSSTORE_H
+#define SMSSTORE_H
+
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QString>
+
+#include "interfaces/conversationmessage.h"
+
+/**
+ * Keeps the messages of a device on disk, so they don't have to be pulled from the phone again
+ * after a restart
+ *
+ * Messages are appended to a log file, which only its owner can read. Opening the store only
+ * reads the thread, date, uID and read flag of every record to build the index, the messages
+ * themselves are read when asked for. A message whose read flag changed is appended again, the
+ * newest record of a message is the one which counts. When opening finds more outdated records
+ * than current ones, the log is rewritten with only the current ones.
+ */
+class SmsStore
+{
+public:
+    explicit SmsStore(const QString& path);
+
+    bool contains(qint64 threadId, qint32 uID) const;
+
+    /**
+     * Whether the message is stored with the same read flag
+     */
+    bool contains(const ConversationMessage& message) const;
+
+    /**
+     * Write the messages at the end of the log, the caller checks they are not stored as they are yet
+     */
+    void append(const QList<ConversationMessage>& messages);
+
+    QList<qint64> threadIds() const { return m_index.keys(); }
+    int messageCount(qint64 threadId) const { return m_index.value(threadId).size(); }
+
+    /**
+     * The newest message of the thread, or a default constructed one if there is none
+     */
+    ConversationMessage latestMessage(qint64 threadId) const;
+
+    /**
+     * Date of the newest message of the thread, or -1 if there is none
+     */
+    qint64 latestDate(qint64 threadId) const;
+
+    /**
+     * Every stored message of the thread, oldest first
+     */
+    QList<ConversationMessage> conversation(qint64 threadId) const;
+
+    /**
+     * The newest @p count messages of the thread which are older than @p before, oldest first
+     */
+    QList<ConversationMessage> conversation(qint64 threadId, qint64 before, int count) const;
+
+private:
+    void load();
+    void compact();
+    ConversationMessage readAt(qint64 offset) const;
+
+    mutable QFile m_file;
+
+    /**
+     * Mapping of threadID to the position in the log of each message, by date
+     * Like ConversationsDbusInterface, a message replaces one of the same thread and date
+     */
+    QHash<qint64, QMap<qint64, qint64>> m_index;
+    /**
+     * Mapping of threadID to the read flag of every stored message, by uID
+     */
+    QHash<qint64, QHash<qint32, qint32>> m_known_messages;
+};
+
+#endif // SMSSTORE_H
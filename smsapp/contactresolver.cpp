@@ -0,0 +1,123 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "contactresolver.h"
+
+#include <KPeople/kpeople/persondata.h>
+
+ContactResolver* ContactResolver::instance()
+{
+    static ContactResolver* instance = new ContactResolver();
+    return instance;
+}
+
+ContactResolver::ContactResolver()
+{
+    // The model is filled asynchronously, so everything is indexed as it comes in
+    connect(&m_people, &QAbstractItemModel::rowsInserted, this, [this](const QModelIndex& parent, int first, int last) {
+        if (!parent.isValid()) {
+            addPeople(first, last);
+            Q_EMIT contactsChanged();
+        }
+    });
+    connect(&m_people, &QAbstractItemModel::rowsAboutToBeRemoved, this, [this](const QModelIndex& parent, int first, int last) {
+        if (!parent.isValid()) {
+            removePeople(first, last);
+        }
+    });
+    connect(&m_people, &QAbstractItemModel::rowsRemoved, this, &ContactResolver::contactsChanged);
+    connect(&m_people, &QAbstractItemModel::dataChanged, this, [this](const QModelIndex& topLeft, const QModelIndex& bottomRight) {
+        if (topLeft.parent().isValid()) {
+            return;
+        }
+        removePeople(topLeft.row(), bottomRight.row());
+        addPeople(topLeft.row(), bottomRight.row());
+        Q_EMIT contactsChanged();
+    });
+    connect(&m_people, &QAbstractItemModel::modelReset, this, [this] {
+        rebuild();
+        Q_EMIT contactsChanged();
+    });
+
+    rebuild();
+}
+
+void ContactResolver::rebuild()
+{
+    m_phoneNumbers.clear();
+    m_emails.clear();
+    m_emailsByPerson.clear();
+    addPeople(0, m_people.rowCount() - 1);
+}
+
+void ContactResolver::addPeople(int first, int last)
+{
+    for (int row = first; row <= last; ++row) {
+        addPerson(m_people.get(row, KPeople::PersonsModel::PersonUriRole).toString());
+    }
+}
+
+void ContactResolver::removePeople(int first, int last)
+{
+    for (int row = first; row <= last; ++row) {
+        removePerson(m_people.get(row, KPeople::PersonsModel::PersonUriRole).toString());
+    }
+}
+
+void ContactResolver::addPerson(const QString& personUri)
+{
+    if (personUri.isEmpty()) {
+        return;
+    }
+
+    const KPeople::PersonData person(personUri);
+
+    const QStringList emails = person.allEmails();
+    for (const QString& email : emails) {
+        m_emails.insert(email, personUri);
+    }
+    m_emailsByPerson.insert(personUri, emails);
+
+    // TODO: Either upgrade KPeople with an allPhoneNumbers method
+    const QVariantList allPhoneNumbers = person.contactCustomProperty(QStringLiteral("all-phoneNumber")).toList();
+    for (const QVariant& rawPhoneNumber : allPhoneNumbers) {
+        m_phoneNumbers.insert(rawPhoneNumber.toString(), personUri);
+    }
+}
+
+void ContactResolver::removePerson(const QString& personUri)
+{
+    const QStringList emails = m_emailsByPerson.take(personUri);
+    for (const QString& email : emails) {
+        if (m_emails.value(email) == personUri) {
+            m_emails.remove(email);
+        }
+    }
+    m_phoneNumbers.remove(personUri);
+}
+
+QString ContactResolver::personUriForAddress(const QString& address) const
+{
+    const auto email = m_emails.constFind(address);
+    if (email != m_emails.constEnd()) {
+        return *email;
+    }
+    return m_phoneNumbers.lookup(address);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONTACTRESOLVER_H
+#define CONTACTRESOLVER_H
+
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+
+#include <KPeople/kpeople/personsmodel.h>
+
+#include "phonenumberindex.h"
+
+/**
+ * Finds the contact of a phone number or email address
+ *
+ * The numbers and addresses of every contact are indexed once, and the index follows the
+ * changes of the contact book. There is a single instance, shared by everything which shows contacts.
+ */
+class ContactResolver
+    : public QObject
+{
+    Q_OBJECT
+
+public:
+    static ContactResolver* instance();
+
+    /**
+     * The URI of the person the address belongs to, or an empty string if it is not in the contact book
+     */
+    QString personUriForAddress(const QString& address) const;
+
+Q_SIGNALS:
+    /**
+     * Emitted when contacts are added, changed or removed, addresses might resolve differently now
+     */
+    void contactsChanged();
+
+private:
+    ContactResolver();
+
+    void addPeople(int first, int last);
+    void removePeople(int first, int last);
+    void addPerson(const QString& personUri);
+    void removePerson(const QString& personUri);
+    void rebuild();
+
+    KPeople::PersonsModel m_people;
+    PhoneNumberIndex m_phoneNumbers;
+
+    // Although we are nominally an SMS messaging app, it is possible to send messages to phone numbers using email -> sms bridges
+    QHash<QString, QString> m_emails;
+    QHash<QString, QStringList> m_emailsByPerson;
+};
+
+#endif // CONTACTRESOLVER_H
@@ -23,9 +23,12 @@
 
 #include <QString>
 #include <QLoggingCategory>
+
+#include <algorithm>
+
 #include "interfaces/conversationmessage.h"
 #include "interfaces/dbusinterfaces.h"
-#include "smshelper.h"
+#include "contactresolver.h"
 
 Q_LOGGING_CATEGORY(KDECONNECT_SMS_CONVERSATIONS_LIST_MODEL, "kdeconnect.sms.conversations_list")
 
@@ -33,23 +36,63 @@ OurSortFilterProxyModel::OurSortFilterProxyModel(){}
 OurSortFilterProxyModel::~OurSortFilterProxyModel(){}
 
 ConversationListModel::ConversationListModel(QObject* parent)
-    : QStandardItemModel(parent)
+    : QAbstractListModel(parent)
     , m_conversationsInterface(nullptr)
 {
     //qCDebug(KDECONNECT_SMS_CONVERSATIONS_LIST_MODEL) << "Constructing" << this;
-    auto roles = roleNames();
+    ConversationMessage::registerDbusType();
+
+    // The contact book is loaded asynchronously, so it can arrive after the conversations
+    connect(ContactResolver::instance(), &ContactResolver::contactsChanged,
+            this, &ConversationListModel::refreshContacts);
+}
+
+ConversationListModel::~ConversationListModel()
+{
+}
+
+QHash<int, QByteArray> ConversationListModel::roleNames() const
+{
+    auto roles = QAbstractListModel::roleNames();
     roles.insert(FromMeRole, "fromMe");
     roles.insert(AddressRole, "address");
     roles.insert(PersonUriRole, "personUri");
     roles.insert(ConversationIdRole, "conversationId");
     roles.insert(DateRole, "date");
-    setItemRoleNames(roles);
+    return roles;
+}
 
-    ConversationMessage::registerDbusType();
+int ConversationListModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : m_conversations.size();
 }
 
-ConversationListModel::~ConversationListModel()
+QVariant ConversationListModel::data(const QModelIndex& index, int role) const
 {
+    if (!index.isValid() || index.row() >= m_conversations.size()) {
+        return QVariant();
+    }
+
+    const Conversation& conversation = m_conversations[index.row()];
+    switch (role) {
+        case Qt::DisplayRole:
+            return conversation.name;
+        case Qt::DecorationRole:
+            return conversation.icon;
+        case Qt::ToolTipRole:
+            return conversation.body;
+        case FromMeRole:
+            return conversation.fromMe;
+        case PersonUriRole:
+            return conversation.personUri;
+        case AddressRole:
+            return conversation.address;
+        case ConversationIdRole:
+            return conversation.threadId;
+        case DateRole:
+            return conversation.date;
+    }
+    return QVariant();
 }
 
 void ConversationListModel::setDeviceId(const QString& deviceId)
@@ -98,16 +141,59 @@ void ConversationListModel::prepareConversationsList()
     QDBusPendingReply<QVariantList> validThreadIDsReply = m_conversationsInterface->activeConversations();
 
     setWhenAvailable(validThreadIDsReply, [this](const QVariantList& convs) {
-        clear(); // If we clear before we receive the reply, there might be a (several second) visual gap!
+        QList<ConversationMessage> messages;
+        messages.reserve(convs.size());
         for (const QVariant& headMessage : convs) {
             QDBusArgument data = headMessage.value<QDBusArgument>();
-            QVariantMap message;
-            data >> message;
-            handleCreatedConversation(message);
+            QVariantMap msg;
+            data >> msg;
+            messages.append(ConversationMessage(msg));
         }
+        setConversations(messages);
     }, this);
 }
 
+void ConversationListModel::setConversations(const QList<ConversationMessage>& messages)
+{
+    // Build every row first and insert them together, instead of one row (and one round of
+    // model signals) at a time
+    QVector<Conversation> conversations;
+    QHash<qint64, int> rowsByThreadId;
+    conversations.reserve(messages.size());
+    for (const ConversationMessage& message : messages) {
+        if (message.type() == -1) {
+            continue;
+        }
+
+        const auto existing = rowsByThreadId.constFind(message.threadID());
+        if (existing != rowsByThreadId.constEnd()) {
+            if (message.date() >= conversations[*existing].date) {
+                updateFromMessage(conversations[*existing], message);
+            }
+            continue;
+        }
+        rowsByThreadId.insert(message.threadID(), conversations.size());
+        conversations.append(conversationFromMessage(message));
+    }
+    std::stable_sort(conversations.begin(), conversations.end(), [](const Conversation& a, const Conversation& b) {
+        return a.date > b.date;
+    });
+
+    // If we clear before we receive the reply, there might be a (several second) visual gap!
+    if (!m_conversations.isEmpty()) {
+        beginRemoveRows(QModelIndex(), 0, m_conversations.size() - 1);
+        m_conversations.clear();
+        m_rowsByThreadId.clear();
+        endRemoveRows();
+    }
+    if (!conversations.isEmpty()) {
+        beginInsertRows(QModelIndex(), 0, conversations.size() - 1);
+        m_conversations = conversations;
+        reindexRows(0, m_conversations.size() - 1);
+        endInsertRows();
+    }
+}
+
 void ConversationListModel::handleCreatedConversation(const QVariantMap& msg)
 {
     createRowFromMessage(msg);
@@ -123,14 +209,52 @@ void ConversationListModel::printDBusError(const QDBusError& error)
     qCWarning(KDECONNECT_SMS_CONVERSATIONS_LIST_MODEL) << error;
 }
 
-QStandardItem * ConversationListModel::conversationForThreadId(qint32 threadId)
+ConversationListModel::Conversation ConversationListModel::conversationFromMessage(const ConversationMessage& message)
+{
+    Conversation conversation;
+    conversation.threadId = message.threadID();
+    setPerson(conversation, message.address());
+    updateFromMessage(conversation, message);
+    return conversation;
+}
+
+void ConversationListModel::setPerson(Conversation& conversation, const QString& address)
+{
+    QScopedPointer<KPeople::PersonData> personData(lookupPersonByAddress(address));
+    if (personData) {
+        conversation.name = personData->name();
+        conversation.icon = QIcon(personData->photo());
+        conversation.personUri = personData->personUri();
+    } else {
+        conversation.name = address;
+        conversation.icon = QIcon();
+        conversation.personUri = QString();
+    }
+}
+
+void ConversationListModel::updateFromMessage(Conversation& conversation, const ConversationMessage& message)
+{
+    conversation.address = message.address();
+    conversation.fromMe = message.type() == ConversationMessage::MessageTypeSent;
+    conversation.body = message.body();
+    conversation.date = message.date();
+}
+
+int ConversationListModel::insertPosition(qint64 date, int end) const
+{
+    // Rows with the same date stay before the new one
+    const auto it = std::upper_bound(m_conversations.cbegin(), m_conversations.cbegin() + end, date,
+                                     [](qint64 newDate, const Conversation& conversation) {
+        return newDate > conversation.date;
+    });
+    return it - m_conversations.cbegin();
+}
+
+void ConversationListModel::reindexRows(int first, int last)
 {
-    for(int i=0, c=rowCount(); i<c; ++i) {
-        auto it = item(i, 0);
-        if (it->data(ConversationIdRole) == threadId)
-            return it;
+    for (int row = first; row <= last; ++row) {
+        m_rowsByThreadId.insert(m_conversations[row].threadId, row);
     }
-    return nullptr;
 }
 
 void ConversationListModel::createRowFromMessage(const QVariantMap& msg)
@@ -142,70 +266,59 @@ void ConversationListModel::createRowFromMessage(const QVariantMap& msg)
         return;
     }
 
-    bool toadd = false;
-    QStandardItem* item = conversationForThreadId(message.threadID());
-    if (!item) {
-        toadd = true;
-        item = new QStandardItem();
-        QScopedPointer<KPeople::PersonData> personData(lookupPersonByAddress(message.address()));
-        if (personData) {
-            item->setText(personData->name());
-            item->setIcon(QIcon(personData->photo()));
-            item->setData(personData->personUri(), PersonUriRole);
-        } else {
-            item->setData(QString(), PersonUriRole);
-            item->setText(message.address());
-        }
-        item->setData(message.threadID(), ConversationIdRole);
+    const auto existing = m_rowsByThreadId.constFind(message.threadID());
+    if (existing == m_rowsByThreadId.constEnd()) {
+        const Conversation conversation = conversationFromMessage(message);
+        const int row = insertPosition(conversation.date, m_conversations.size());
+        beginInsertRows(QModelIndex(), row, row);
+        m_conversations.insert(row, conversation);
+        reindexRows(row, m_conversations.size() - 1);
+        endInsertRows();
+        return;
     }
 
     // Update the message if the data is newer
     // This will be true if a conversation receives a new message, but false when the user
     // does something to trigger past conversation history loading
-    bool oldDateExists;
-    qint64 oldDate = item->data(DateRole).toLongLong(&oldDateExists);
-    if (!oldDateExists || message.date() >= oldDate) {
-        // If there was no old data or incoming data is newer, update the record
-        item->setData(message.address(), AddressRole);
-        item->setData(message.type() == ConversationMessage::MessageTypeSent, FromMeRole);
-        item->setData(message.body(), Qt::ToolTipRole);
-        item->setData(message.date(), DateRole);
+    int row = *existing;
+    if (message.date() < m_conversations[row].date) {
+        return;
     }
+    updateFromMessage(m_conversations[row], message);
 
-    if (toadd)
-        appendRow(item);
+    // Dates only grow, so the conversation can only move up
+    const int newRow = insertPosition(message.date(), row);
+    if (newRow != row) {
+        beginMoveRows(QModelIndex(), row, row, QModelIndex(), newRow);
+        const Conversation conversation = m_conversations.takeAt(row);
+        m_conversations.insert(newRow, conversation);
+        reindexRows(newRow, row);
+        endMoveRows();
+        row = newRow;
+    }
+
+    const QModelIndex changed = index(row);
+    Q_EMIT dataChanged(changed, changed, {AddressRole, FromMeRole, Qt::ToolTipRole, DateRole});
 }
 
 KPeople::PersonData* ConversationListModel::lookupPersonByAddress(const QString& address)
 {
-    const QString& canonicalAddress = SmsHelper::canonicalizePhoneNumber(address);
-    int rowIndex = 0;
-    for (rowIndex = 0; rowIndex < m_people.rowCount(); rowIndex++) {
-        const QString& uri = m_people.get(rowIndex, KPeople::PersonsModel::PersonUriRole).toString();
-        KPeople::PersonData* person = new KPeople::PersonData(uri);
-
-        const QStringList& allEmails = person->allEmails();
-        for (const QString& email : allEmails) {
-            // Although we are nominally an SMS messaging app, it is possible to send messages to phone numbers using email -> sms bridges
-            if (address == email) {
-                return person;
-            }
-        }
-
-        // TODO: Either upgrade KPeople with an allPhoneNumbers method
-        const QVariantList allPhoneNumbers = person->contactCustomProperty(QStringLiteral("all-phoneNumber")).toList();
-        for (const QVariant& rawPhoneNumber : allPhoneNumbers) {
-            const QString& phoneNumber = SmsHelper::canonicalizePhoneNumber(rawPhoneNumber.toString());
-            bool matchingPhoneNumber = SmsHelper::isPhoneNumberMatchCanonicalized(canonicalAddress, phoneNumber);
+    const QString personUri = ContactResolver::instance()->personUriForAddress(address);
+    if (personUri.isEmpty()) {
+        return nullptr;
+    }
+    return new KPeople::PersonData(personUri);
+}
 
-            if (matchingPhoneNumber) {
-                //qCDebug(KDECONNECT_SMS_CONVERSATIONS_LIST_MODEL) << "Matched" << address << "to" << person->name();
-                return person;
-            }
+void ConversationListModel::refreshContacts()
+{
+    for (int row = 0; row < m_conversations.size(); ++row) {
+        Conversation& conversation = m_conversations[row];
+        if (ContactResolver::instance()->personUriForAddress(conversation.address) == conversation.personUri) {
+            continue;
         }
-
-        delete person;
+        setPerson(conversation, conversation.address);
+        const QModelIndex changed = index(row);
+        Q_EMIT dataChanged(changed, changed, {Qt::DisplayRole, Qt::DecorationRole, PersonUriRole});
     }
-
-    return nullptr;
 }
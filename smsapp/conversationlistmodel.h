@@ -22,10 +22,13 @@
 #ifndef CONVERSATIONLISTMODEL_H
 #define CONVERSATIONLISTMODEL_H
 
-#include <QStandardItemModel>
+#include <QAbstractListModel>
+#include <QHash>
+#include <QIcon>
 #include <QLoggingCategory>
+#include <QSortFilterProxyModel>
+#include <QVector>
 #include <QQmlParserStatus>
-#include <KPeople/kpeople/personsmodel.h>
 #include <KPeople/kpeople/persondata.h>
 
 #include "interfaces/conversationmessage.h"
@@ -67,8 +70,11 @@ private:
     Qt::SortOrder m_sortOrder = Qt::AscendingOrder;
 };
 
+/**
+ * The newest message of every conversation, newest conversation first
+ */
 class ConversationListModel
-    : public QStandardItemModel
+    : public QAbstractListModel
 {
     Q_OBJECT
     Q_PROPERTY(QString deviceId READ deviceId WRITE setDeviceId NOTIFY deviceIdChanged)
@@ -89,6 +95,16 @@ public:
     QString deviceId() const { return m_deviceId; }
     void setDeviceId(const QString &/*deviceId*/);
 
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    /**
+     * Replace every row with the conversations of these messages, keeping the newest message of
+     * each conversation
+     */
+    void setConversations(const QList<ConversationMessage>& messages);
+
 public Q_SLOTS:
     void handleCreatedConversation(const QVariantMap& msg);
     void handleConversationUpdated(const QVariantMap& msg);
@@ -109,11 +125,47 @@ private:
      */
     KPeople::PersonData* lookupPersonByAddress(const QString& address);
 
-    QStandardItem* conversationForThreadId(qint32 threadId);
+    /**
+     * Look up the contact of every conversation again, after the contact book changed
+     */
+    void refreshContacts();
+
+    struct Conversation {
+        qint64 threadId;
+        QString name;
+        QIcon icon;
+        QString personUri;
+        QString address;
+        bool fromMe;
+        QString body;
+        qint64 date;
+    };
+
+    /**
+     * Start a row for the conversation of the message, looking up the contact of its address
+     */
+    Conversation conversationFromMessage(const ConversationMessage& message);
+    static void updateFromMessage(Conversation& conversation, const ConversationMessage& message);
+    void setPerson(Conversation& conversation, const QString& address);
+
+    /**
+     * Row before which a conversation with this date goes, looking only at the rows before end
+     */
+    int insertPosition(qint64 date, int end) const;
+
+    /**
+     * Point m_rowsByThreadId at the current position of the rows from first to last
+     */
+    void reindexRows(int first, int last);
+
+    /**
+     * Kept sorted by date, newest first, so a new message only moves its conversation up
+     */
+    QVector<Conversation> m_conversations;
+    QHash<qint64, int> m_rowsByThreadId;
 
     DeviceConversationsDbusInterface* m_conversationsInterface;
     QString m_deviceId;
-    KPeople::PersonsModel m_people;
 };
 
 #endif // CONVERSATIONLISTMODEL_H
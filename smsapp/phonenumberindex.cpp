@@ -0,0 +1,174 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "phonenumberindex.h"
+#include "smshelper.h"
+
+#include <limits>
+
+namespace {
+    // Short codes only match other short codes, and those are at most this long (see SmsHelper::isShortCode)
+    const int s_shortCodeLength = 6;
+    const int s_longestShortCodeLength = 9;
+    // Below this, removed entries aren't worth rebuilding the index for
+    const int s_minDeadEntries = 64;
+}
+
+PhoneNumberIndex::PhoneNumberIndex()
+    : m_nodes(1)
+    , m_count(0)
+{
+}
+
+int PhoneNumberIndex::child(int node, QChar c) const
+{
+    for (const auto& edge : m_nodes[node].children) {
+        if (edge.first == c) {
+            return edge.second;
+        }
+    }
+    return -1;
+}
+
+void PhoneNumberIndex::insert(const QString& phoneNumber, const QString& value)
+{
+    const QString number = SmsHelper::canonicalizePhoneNumber(phoneNumber);
+    if (number.isEmpty()) {
+        return;
+    }
+    insertCanonicalized(number, value);
+}
+
+void PhoneNumberIndex::insertCanonicalized(const QString& number, const QString& value)
+{
+    int node = 0;
+    for (int i = number.size() - 1; i >= 0; --i) {
+        int next = child(node, number[i]);
+        if (next < 0) {
+            next = m_nodes.size();
+            m_nodes[node].children.append(qMakePair(number[i], next));
+            m_nodes.append(Node());
+        }
+        node = next;
+    }
+
+    const int entry = m_entries.size();
+    m_entries.append({number, value, node});
+    m_nodes[node].entries.append(entry);
+    m_entriesByValue[value].append(entry);
+    ++m_count;
+}
+
+void PhoneNumberIndex::remove(const QString& value)
+{
+    // Entries and nodes are left in place, until they outnumber the live ones
+    const QVector<int> entries = m_entriesByValue.take(value);
+    for (int entry : entries) {
+        m_nodes[m_entries[entry].node].entries.removeOne(entry);
+        m_entries[entry].value.clear();
+        --m_count;
+    }
+
+    if (m_entries.size() - m_count > qMax(m_count, s_minDeadEntries)) {
+        rebuild();
+    }
+}
+
+void PhoneNumberIndex::rebuild()
+{
+    const QVector<Entry> entries = m_entries;
+    clear();
+    for (const Entry& entry : entries) {
+        if (!entry.value.isEmpty()) {
+            insertCanonicalized(entry.number, entry.value);
+        }
+    }
+}
+
+void PhoneNumberIndex::clear()
+{
+    m_nodes.clear();
+    m_nodes.resize(1);
+    m_entries.clear();
+    m_entriesByValue.clear();
+    m_count = 0;
+}
+
+QString PhoneNumberIndex::lookup(const QString& phoneNumber) const
+{
+    const QString address = SmsHelper::canonicalizePhoneNumber(phoneNumber);
+    if (address.isEmpty()) {
+        return QString();
+    }
+
+    // Numbers the address ends with are on its path, longest last
+    QVector<int> path;
+    int node = 0;
+    int i = address.size() - 1;
+    for (; i >= 0; --i) {
+        node = child(node, address[i]);
+        if (node < 0) {
+            break;
+        }
+        path.append(node);
+    }
+    const bool addressFound = i < 0;
+
+    const auto matchIn = [this, &address](int node) -> QString {
+        for (int entry : m_nodes[node].entries) {
+            if (SmsHelper::isPhoneNumberMatchCanonicalized(address, m_entries[entry].number)) {
+                return m_entries[entry].value;
+            }
+        }
+        return QString();
+    };
+
+    for (auto it = path.crbegin(); it != path.crend(); ++it) {
+        const QString value = matchIn(*it);
+        if (!value.isEmpty()) {
+            return value;
+        }
+    }
+
+    if (!addressFound) {
+        return QString();
+    }
+
+    // Numbers ending with the address are below it, shortest first
+    const int maxDepth = address.size() <= s_shortCodeLength
+        ? s_longestShortCodeLength - address.size()
+        : std::numeric_limits<int>::max();
+    QVector<int> level{path.last()};
+    for (int depth = 1; depth <= maxDepth && !level.isEmpty(); ++depth) {
+        QVector<int> nextLevel;
+        for (int parent : level) {
+            for (const auto& edge : m_nodes[parent].children) {
+                const QString value = matchIn(edge.second);
+                if (!value.isEmpty()) {
+                    return value;
+                }
+                nextLevel.append(edge.second);
+            }
+        }
+        level = nextLevel;
+    }
+
+    return QString();
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PHONENUMBERINDEX_H
+#define PHONENUMBERINDEX_H
+
+#include <QHash>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+#include "kdeconnectsms_export.h"
+
+/**
+ * Finds which of many phone numbers matches an address, the way SmsHelper::isPhoneNumberMatch does
+ *
+ * Numbers are kept canonicalized in a trie of their digits, last digit first. Since two numbers
+ * match when one ends with the other, only the numbers along the path of the address and the
+ * ones below its end need to be compared, instead of every number. Removed numbers are dropped
+ * from the trie once they outnumber the remaining ones.
+ */
+class KDECONNECTSMSAPPLIB_EXPORT PhoneNumberIndex
+{
+public:
+    PhoneNumberIndex();
+
+    /**
+     * Add a phone number standing for value (eg: the URI of a contact), a value can have several numbers
+     */
+    void insert(const QString& phoneNumber, const QString& value);
+
+    /**
+     * Forget every number of the value
+     */
+    void remove(const QString& value);
+
+    void clear();
+
+    /**
+     * The value of a number matching the phone number, or an empty string if there is none
+     *
+     * An exact match is preferred, then the longest number the phone number ends with,
+     * then the shortest number ending with the phone number
+     */
+    QString lookup(const QString& phoneNumber) const;
+
+    int count() const { return m_count; }
+
+private:
+    struct Node {
+        QVector<QPair<QChar, int>> children;
+        QVector<int> entries;
+    };
+
+    struct Entry {
+        QString number;
+        QString value;
+        int node;
+    };
+
+    int child(int node, QChar c) const;
+    void insertCanonicalized(const QString& number, const QString& value);
+
+    /**
+     * Insert the live entries again, dropping the removed entries and the nodes only they used
+     */
+    void rebuild();
+
+    QVector<Node> m_nodes;
+    QVector<Entry> m_entries;
+    QHash<QString, QVector<int>> m_entriesByValue;
+    int m_count;
+};
+
+#endif // PHONENUMBERINDEX_H
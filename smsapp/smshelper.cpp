@@ -21,7 +21,6 @@
 #include "smshelper.h"
 
 #include <QString>
-#include <QRegularExpression>
 #include <QLoggingCategory>
 
 Q_LOGGING_CATEGORY(KDECONNECT_SMS_SMSHELPER, "kdeconnect.sms.smshelper")
@@ -100,13 +99,19 @@ SmsHelper::CountryCode SmsHelper::determineCountryCode(const QString& canonicalN
 
 QString SmsHelper::canonicalizePhoneNumber(const QString& phoneNumber)
 {
-    QString toReturn(phoneNumber);
-    toReturn = toReturn.remove(QStringLiteral(" "));
-    toReturn = toReturn.remove(QStringLiteral("-"));
-    toReturn = toReturn.remove(QStringLiteral("("));
-    toReturn = toReturn.remove(QStringLiteral(")"));
-    toReturn = toReturn.remove(QStringLiteral("+"));
-    toReturn = toReturn.remove(QRegularExpression(QStringLiteral("^0*"))); // Strip leading zeroes
+    // Done in a single pass, since this runs for every number of every contact
+    QString toReturn;
+    toReturn.reserve(phoneNumber.size());
+    for (const QChar c : phoneNumber) {
+        if (c == QLatin1Char(' ') || c == QLatin1Char('-') || c == QLatin1Char('(') || c == QLatin1Char(')') || c == QLatin1Char('+')) {
+            continue;
+        }
+        if (toReturn.isEmpty() && c == QLatin1Char('0')) {
+            // Strip leading zeroes
+            continue;
+        }
+        toReturn.append(c);
+    }
 
     if (toReturn.length() == 0) {
         // If we have stripped away everything, assume this is a special number (and already canonicalized)
@@ -20,9 +20,16 @@
 
 #include "../core/device.h"
 #include "../core/backends/lan/lanlinkprovider.h"
+#include "../core/backends/lan/server.h"
 #include "../core/kdeconnectconfig.h"
+#include "../core/kdeconnectplugin.h"
+#include "../core/pluginloader.h"
 
 #include <QtTest>
+#include <QEventLoop>
+#include <QLoggingCategory>
+#include <QSslSocket>
+#include <QTimer>
 
 /**
  * This class tests the working of device class
@@ -36,6 +43,9 @@ private Q_SLOTS:
     void initTestCase();
     void testUnpairedDevice();
     void testPairedDevice();
+    void testPluginLoadOnDemand();
+    void benchmarkReceivePackets();
+    void cleanup();
     void cleanupTestCase();
 
 private:
@@ -46,6 +56,19 @@ private:
 
 };
 
+// How many instances of a plugin the device has created
+static int pluginInstances(const Device& device, const char* className)
+{
+    int instances = 0;
+    const QList<KdeConnectPlugin*> plugins = device.findChildren<KdeConnectPlugin*>();
+    for (const KdeConnectPlugin* plugin : plugins) {
+        if (qstrcmp(plugin->metaObject()->className(), className) == 0) {
+            instances++;
+        }
+    }
+    return instances;
+}
+
 void DeviceTest::initTestCase()
 {
     deviceId = QStringLiteral("testdevice");
@@ -92,6 +115,52 @@ void DeviceTest::testPairedDevice()
 
 }
 
+void DeviceTest::testPluginLoadOnDemand()
+{
+    const QString pluginName = QStringLiteral("kdeconnect_ping");
+    if (!PluginLoader::instance()->getPluginList().contains(pluginName)) {
+        QSKIP("kdeconnect_ping is required for this test");
+    }
+    QVERIFY(PluginLoader::instance()->loadsOnDemand(pluginName));
+
+    KdeConnectConfig* kcc = KdeConnectConfig::instance();
+    kcc->addTrustedDevice(deviceId, deviceName, deviceType);
+    kcc->setDeviceProperty(deviceId, QStringLiteral("certificate"), QString::fromLatin1(kcc->certificate().toPem()));
+
+    Device device(this, deviceId);
+    LanLinkProvider linkProvider;
+    QSslSocket socket;
+
+    // It's advertised as soon as the device is reachable, but only created by its first packet
+    LanDeviceLink* link = new LanDeviceLink(deviceId, &linkProvider, &socket, LanDeviceLink::Locally);
+    device.addLink(*identityPacket, link);
+    QVERIFY(device.hasPlugin(pluginName));
+    QVERIFY(device.loadedPlugins().contains(pluginName));
+    QCOMPARE(pluginInstances(device, "PingPlugin"), 0);
+
+    Q_EMIT link->receivedPacket(NetworkPacket(QStringLiteral("kdeconnect.ping")));
+    QCOMPARE(pluginInstances(device, "PingPlugin"), 1);
+    Q_EMIT link->receivedPacket(NetworkPacket(QStringLiteral("kdeconnect.ping")));
+    QCOMPARE(pluginInstances(device, "PingPlugin"), 1);
+    QVERIFY(device.hasPlugin(pluginName));
+
+    // Losing the device drops it, and the next time it's reachable asking for it creates it
+    device.removeLink(link);
+    QCOMPARE(pluginInstances(device, "PingPlugin"), 0);
+
+    link = new LanDeviceLink(deviceId, &linkProvider, &socket, LanDeviceLink::Locally);
+    device.addLink(*identityPacket, link);
+    QVERIFY(device.hasPlugin(pluginName));
+    QCOMPARE(pluginInstances(device, "PingPlugin"), 0);
+
+    KdeConnectPlugin* plugin = device.plugin(pluginName);
+    QVERIFY(plugin);
+    QCOMPARE(pluginInstances(device, "PingPlugin"), 1);
+    QCOMPARE(device.plugin(pluginName), plugin);
+
+    device.removeLink(link);
+}
+
 void DeviceTest::testUnpairedDevice()
 {
     KdeConnectConfig* kcc = KdeConnectConfig::instance();
@@ -119,6 +188,71 @@ void DeviceTest::testUnpairedDevice()
     QCOMPARE(device.availableLinks().contains(linkProvider.name()), false);
 }
 
+void DeviceTest::benchmarkReceivePackets()
+{
+    KdeConnectConfig* kcc = KdeConnectConfig::instance();
+    kcc->addTrustedDevice(deviceId, deviceName, deviceType);
+    kcc->setDeviceProperty(deviceId, QStringLiteral("certificate"), QString::fromLatin1(kcc->certificate().toPem()));
+
+    // Plain tcp connection over loopback, the phone side writes to clientSocket
+    Server server;
+    QVERIFY2(server.listen(QHostAddress::LocalHost), "Failed to create local tcp server");
+    QSslSocket clientSocket;
+    clientSocket.connectToHost(QHostAddress::LocalHost, server.serverPort());
+    QVERIFY(clientSocket.waitForConnected());
+    QTRY_VERIFY(server.hasPendingConnections());
+
+    Device device(this, deviceId);
+    LanLinkProvider linkProvider;
+    LanDeviceLink* link = new LanDeviceLink(deviceId, &linkProvider, server.nextPendingConnection(), LanDeviceLink::Remotely);
+    device.addLink(*identityPacket, link);
+
+    // A burst like the one a phone sends when syncing its notifications or messages
+    const int burstSize = 500;
+
+    // The loop runs until the last packet of the burst is delivered, so the measurement
+    // doesn't include the polling interval of QTRY_COMPARE
+    QEventLoop loop;
+    QTimer timeout;
+    timeout.setSingleShot(true);
+    connect(&timeout, &QTimer::timeout, &loop, &QEventLoop::quit);
+    int receivedPackets = 0;
+    connect(link, &DeviceLink::receivedPackets, this, [&receivedPackets, &loop](const QVector<NetworkPacket>& packets) {
+        receivedPackets += packets.size();
+        if (receivedPackets >= burstSize) {
+            loop.quit();
+        }
+    });
+
+    const NetworkPacket np(QStringLiteral("kdeconnect.benchmark"), {{QStringLiteral("text"), QStringLiteral("Lorem ipsum dolor sit amet")}});
+    const QByteArray serializedPacket = np.serialize();
+    QByteArray burst;
+    for (int i = 0; i < burstSize; ++i) {
+        burst += serializedPacket;
+    }
+
+    // No plugin handles the benchmark packets, don't flood the output warning about each of them
+    QLoggingCategory::setFilterRules(QStringLiteral("default.warning=false"));
+    QBENCHMARK {
+        receivedPackets = 0;
+        clientSocket.write(burst);
+        clientSocket.flush();
+        timeout.start(5000);
+        loop.exec();
+        timeout.stop();
+        QCOMPARE(receivedPackets, burstSize);
+    }
+
+    device.removeLink(link);
+}
+
+void DeviceTest::cleanup()
+{
+    // Also runs when a test fails halfway, so the trusted device doesn't leak into the global config
+    QLoggingCategory::setFilterRules(QString());
+    KdeConnectConfig::instance()->removeTrustedDevice(deviceId);
+}
+
 void DeviceTest::cleanupTestCase()
 {
     delete identityPacket;
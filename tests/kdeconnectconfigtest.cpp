@@ -23,6 +23,7 @@
 #include "../core/kdeconnectconfig.h"
 
 #include <QtTest>
+#include <QSettings>
 
 /*
  * This class tests the working of kdeconnect config that certificate and key is generated and saved properly
@@ -38,6 +39,8 @@ private Q_SLOTS:
     void remoteCertificateTest();
 */
     void removeTrustedDevice();
+    void parallelUploads();
+    void externalChanges();
 
 private:
     KdeConnectConfig* kcc;
@@ -54,6 +57,12 @@ void KdeConnectConfigTest::addTrustedDevice()
     KdeConnectConfig::DeviceInfo devInfo = kcc->getTrustedDevice(QStringLiteral("testdevice"));
     QCOMPARE(devInfo.deviceName, QStringLiteral("Test Device"));
     QCOMPARE(devInfo.deviceType, QStringLiteral("phone"));
+    QVERIFY(kcc->isTrustedDevice(QStringLiteral("testdevice")));
+    QVERIFY(kcc->trustedDevices().contains(QStringLiteral("testdevice")));
+
+    kcc->setDeviceProperty(QStringLiteral("testdevice"), QStringLiteral("certificate"), QStringLiteral("pem"));
+    QCOMPARE(kcc->getDeviceProperty(QStringLiteral("testdevice"), QStringLiteral("certificate")), QStringLiteral("pem"));
+    QCOMPARE(kcc->getDeviceProperty(QStringLiteral("testdevice"), QStringLiteral("missing"), QStringLiteral("default")), QStringLiteral("default"));
 }
 
 /*
@@ -87,6 +96,35 @@ void KdeConnectConfigTest::removeTrustedDevice()
     KdeConnectConfig::DeviceInfo devInfo = kcc->getTrustedDevice(QStringLiteral("testdevice"));
     QCOMPARE(devInfo.deviceName, QStringLiteral("unnamed"));
     QCOMPARE(devInfo.deviceType, QStringLiteral("unknown"));
+    QVERIFY(!kcc->isTrustedDevice(QStringLiteral("testdevice")));
+    QCOMPARE(kcc->getDeviceProperty(QStringLiteral("testdevice"), QStringLiteral("certificate")), QString());
+}
+
+void KdeConnectConfigTest::parallelUploads()
+{
+    const int parallelUploads = kcc->parallelUploads();
+    QVERIFY(parallelUploads >= 1);
+
+    kcc->setParallelUploads(2);
+    QCOMPARE(kcc->parallelUploads(), 2);
+    kcc->setParallelUploads(parallelUploads);
+}
+
+void KdeConnectConfigTest::externalChanges()
+{
+    QVERIFY(!kcc->isTrustedDevice(QStringLiteral("externaldevice")));
+
+    //Another process pairing a device is noticed
+    {
+        QSettings settings(kcc->baseConfigDir().absoluteFilePath(QStringLiteral("trusted_devices")), QSettings::IniFormat);
+        settings.setValue(QStringLiteral("externaldevice/name"), QStringLiteral("External Device"));
+        settings.sync();
+    }
+    QTRY_VERIFY(kcc->isTrustedDevice(QStringLiteral("externaldevice")));
+    QCOMPARE(kcc->getTrustedDevice(QStringLiteral("externaldevice")).deviceName, QStringLiteral("External Device"));
+
+    kcc->removeTrustedDevice(QStringLiteral("externaldevice"));
+    QVERIFY(!kcc->isTrustedDevice(QStringLiteral("externaldevice")));
 }
 
 QTEST_GUILESS_MAIN(KdeConnectConfigTest)
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../core/kdeconnectconfig.h"
+#include "../core/kdeconnectpluginconfig.h"
+
+#include <QSettings>
+#include <QStandardPaths>
+#include <QtTest>
+
+/*
+ * This class tests that plugin config values are kept in memory and still see changes
+ */
+class KdeConnectPluginConfigTest : public QObject
+{
+Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void setAndGet();
+    void lists();
+    void externalChanges();
+    void ownChanges();
+    void benchmarkGet();
+
+private:
+    QScopedPointer<KdeConnectPluginConfig> m_config;
+};
+
+void KdeConnectPluginConfigTest::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    QDir pluginConfigDir = KdeConnectConfig::instance()->pluginConfigDir(QStringLiteral("testdevice"), QStringLiteral("testplugin"));
+    QFile::remove(pluginConfigDir.absoluteFilePath(QStringLiteral("config")));
+    m_config.reset(new KdeConnectPluginConfig(QStringLiteral("testdevice"), QStringLiteral("testplugin")));
+}
+
+void KdeConnectPluginConfigTest::setAndGet()
+{
+    QCOMPARE(m_config->get<bool>(QStringLiteral("generalPersistent"), false), false);
+    m_config->set(QStringLiteral("generalPersistent"), true);
+    QCOMPARE(m_config->get<bool>(QStringLiteral("generalPersistent"), false), true);
+
+    m_config->set(QStringLiteral("generalUrgency"), 2);
+    QCOMPARE(m_config->get<int>(QStringLiteral("generalUrgency"), 0), 2);
+    QCOMPARE(m_config->get<QString>(QStringLiteral("missing"), QStringLiteral("default")), QStringLiteral("default"));
+}
+
+void KdeConnectPluginConfigTest::lists()
+{
+    const QVariantList defaultList{QStringLiteral("default")};
+    QCOMPARE(m_config->getList(QStringLiteral("commands"), defaultList), defaultList);
+
+    const QVariantList list{QStringLiteral("one"), QStringLiteral("two")};
+    m_config->setList(QStringLiteral("commands"), list);
+    QCOMPARE(m_config->getList(QStringLiteral("commands")), list);
+    QCOMPARE(m_config->get<bool>(QStringLiteral("generalPersistent"), false), true);
+}
+
+void KdeConnectPluginConfigTest::externalChanges()
+{
+    //Another config object, as the one of the plugin's settings dialog
+    KdeConnectPluginConfig other(QStringLiteral("testdevice"), QStringLiteral("testplugin"));
+    QCOMPARE(other.get<int>(QStringLiteral("generalUrgency"), 0), 2);
+
+    //Another process writing the file
+    const QDir pluginConfigDir = KdeConnectConfig::instance()->pluginConfigDir(QStringLiteral("testdevice"), QStringLiteral("testplugin"));
+    {
+        QSettings settings(pluginConfigDir.absoluteFilePath(QStringLiteral("config")), QSettings::IniFormat);
+        settings.setValue(QStringLiteral("generalUrgency"), 1);
+        settings.sync();
+    }
+    QTRY_COMPARE(m_config->get<int>(QStringLiteral("generalUrgency"), 0), 1);
+    QTRY_COMPARE(other.get<int>(QStringLiteral("generalUrgency"), 0), 1);
+}
+
+void KdeConnectPluginConfigTest::ownChanges()
+{
+    QCOMPARE(m_config->get<int>(QStringLiteral("generalUrgency"), 0), 1);
+
+    //Nothing else touches the file, so writing it doesn't make the object read it again
+    m_config->set(QStringLiteral("generalUrgency"), 0);
+    QTest::qWait(200);
+    const QDir pluginConfigDir = KdeConnectConfig::instance()->pluginConfigDir(QStringLiteral("testdevice"), QStringLiteral("testplugin"));
+    QVERIFY(QFile::remove(pluginConfigDir.absoluteFilePath(QStringLiteral("config"))));
+    QCOMPARE(m_config->get<int>(QStringLiteral("generalUrgency"), 3), 0);
+    QCOMPARE(m_config->get<bool>(QStringLiteral("generalPersistent"), false), true);
+
+    //but anything else that changes it afterwards is still seen
+    QTRY_COMPARE(m_config->get<int>(QStringLiteral("generalUrgency"), 3), 3);
+    m_config->set(QStringLiteral("generalPersistent"), true);
+    m_config->set(QStringLiteral("generalUrgency"), 2);
+}
+
+void KdeConnectPluginConfigTest::benchmarkGet()
+{
+    //The reads a plugin does for every notification it forwards
+    QBENCHMARK {
+        m_config->get<bool>(QStringLiteral("generalPersistent"), false);
+        m_config->get<int>(QStringLiteral("generalUrgency"), 0);
+        m_config->get<bool>(QStringLiteral("generalIncludeBody"), true);
+        m_config->get<bool>(QStringLiteral("generalSynchronizeIcons"), true);
+    }
+}
+
+QTEST_GUILESS_MAIN(KdeConnectPluginConfigTest)
+
+#include "kdeconnectpluginconfigtest.moc"
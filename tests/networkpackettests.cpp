@@ -21,11 +21,41 @@
 #include "networkpackettests.h"
 
 #include "core/networkpacket.h"
+#include "core/packetmetrics.h"
 
 #include <QtTest>
+#include <QBuffer>
+#include <QJsonDocument>
+#include <QMetaProperty>
 
 QTEST_GUILESS_MAIN(NetworkPacketTests);
 
+//A typical high-rate packet (mousepad) to benchmark decoding with
+static const QByteArray s_mousepadPacket("{\"id\":1559149580212,\"type\":\"kdeconnect.mousepad.request\",\"body\":{\"dx\":-3.5,\"dy\":1.25,\"singleclick\":false}}\n");
+
+//The decoding path NetworkPacket::unserialize used before it decoded the json object directly
+static void legacyUnserialize(const QByteArray& json, NetworkPacket* np)
+{
+    const QVariantMap variant = QJsonDocument::fromJson(json).toVariant().toMap();
+    for (auto iter = variant.constBegin(); iter != variant.constEnd(); ++iter) {
+        const int propertyIndex = NetworkPacket::staticMetaObject.indexOfProperty(iter.key().toLatin1().constData());
+        if (propertyIndex >= 0) {
+            NetworkPacket::staticMetaObject.property(propertyIndex).writeOnGadget(np, *iter);
+        }
+    }
+}
+
+//The encoding path NetworkPacket::serialize used before it wrote the json directly
+static QByteArray legacySerialize(const NetworkPacket& np)
+{
+    QVariantMap variant;
+    for (int i = 0; i < NetworkPacket::staticMetaObject.propertyCount(); ++i) {
+        const QMetaProperty prop = NetworkPacket::staticMetaObject.property(i);
+        variant.insert(QString::fromLatin1(prop.name()), prop.readOnGadget(&np));
+    }
+    return QJsonDocument::fromVariant(variant).toJson(QJsonDocument::Compact) + '\n';
+}
+
 void NetworkPacketTests::initTestCase()
 {
     // Called before the first testfunction is executed
@@ -78,6 +108,178 @@ void NetworkPacketTests::networkPacketIdentityTest()
 
 }
 
+void NetworkPacketTests::networkPacketPayloadTransferInfoTest()
+{
+    QByteArray json("{\"id\":1559149580212,\"type\":\"kdeconnect.share.request\",\"body\":{\"filename\":\"a.mkv\"},"
+                    "\"payloadSize\":5368709120,\"payloadTransferInfo\":{\"port\":1739}}");
+    NetworkPacket np(QLatin1String(""));
+    QVERIFY(NetworkPacket::unserialize(json, &np));
+
+    QCOMPARE( np.id(), QStringLiteral("1559149580212") );
+    QCOMPARE( np.type(), QStringLiteral("kdeconnect.share.request") );
+    QCOMPARE( np.get<QString>(QStringLiteral("filename")), QStringLiteral("a.mkv") );
+    QCOMPARE( np.payloadSize(), Q_INT64_C(5368709120) );
+    QCOMPARE( np.payloadTransferInfo().value(QStringLiteral("port")).toInt(), 1739 );
+
+    //Packets without payload must not keep the transfer info of a previously decoded one
+    QVERIFY(NetworkPacket::unserialize(s_mousepadPacket, &np));
+    QCOMPARE( np.payloadSize(), Q_INT64_C(0) );
+    QVERIFY( !np.hasPayloadTransferInfo() );
+
+    NetworkPacket legacy(QLatin1String(""));
+    legacyUnserialize(s_mousepadPacket, &legacy);
+    QCOMPARE( np.id(), legacy.id() );
+    QCOMPARE( np.type(), legacy.type() );
+    QCOMPARE( np.body(), legacy.body() );
+}
+
+void NetworkPacketTests::networkPacketTypeIdTest()
+{
+    QCOMPARE( NetworkPacket(PACKET_TYPE_PAIR).typeId(), NetworkPacket::typeIdOf(PACKET_TYPE_PAIR) );
+    QVERIFY( NetworkPacket(PACKET_TYPE_IDENTITY).typeId() >= 0 );
+
+    //Types nobody registered are not interned when received
+    NetworkPacket np(QLatin1String(""));
+    QVERIFY(NetworkPacket::unserialize(s_mousepadPacket, &np));
+    QCOMPARE( np.typeId(), -1 );
+
+    const int typeId = NetworkPacket::registerType(QStringLiteral("kdeconnect.mousepad.request"));
+    QVERIFY( typeId >= 0 );
+    QCOMPARE( NetworkPacket::registerType(QStringLiteral("kdeconnect.mousepad.request")), typeId );
+    QVERIFY( NetworkPacket::registeredTypes() > typeId );
+
+    QVERIFY(NetworkPacket::unserialize(s_mousepadPacket, &np));
+    QCOMPARE( np.typeId(), typeId );
+    QCOMPARE( NetworkPacket(np).typeId(), typeId );
+    QCOMPARE( NetworkPacket::typeName(typeId), QStringLiteral("kdeconnect.mousepad.request") );
+    QVERIFY( NetworkPacket::typeName(-1).isEmpty() );
+}
+
+void NetworkPacketTests::networkPacketMetricsTest()
+{
+    PacketMetrics* metrics = PacketMetrics::device(QStringLiteral("metricstest"));
+    QCOMPARE( PacketMetrics::device(QStringLiteral("metricstest")), metrics );
+    QVERIFY( PacketMetrics::plugin(QStringLiteral("metricstest")) != metrics );
+    QCOMPARE( PacketMetrics::untrustedDevices(), PacketMetrics::untrustedDevices() );
+    QVERIFY( PacketMetrics::untrustedDevices() != metrics );
+
+    NetworkPacket::registerType(QStringLiteral("kdeconnect.mousepad.request"));
+    NetworkPacket np(QLatin1String(""));
+    QVERIFY(NetworkPacket::unserialize(s_mousepadPacket, &np, metrics));
+    metrics->packetReceived(np.typeId(), s_mousepadPacket.size());
+    metrics->packetDispatched(np.typeId(), 3000);
+    metrics->packetSent(-1, 10);
+
+    const QStringList lines = PacketMetrics::report().split(QLatin1Char('\n'));
+    const QString mousepadPrefix = QStringLiteral("device\tmetricstest\tkdeconnect.mousepad.request\t1\t%1\t0\t0\t").arg(s_mousepadPacket.size());
+    const QString unregisteredPrefix = QStringLiteral("device\tmetricstest\t(unregistered)\t0\t0\t1\t10\t-\t-");
+    bool foundMousepad = false, foundUnregistered = false;
+    for (const QString& line : lines) {
+        if (line.startsWith(mousepadPrefix)) {
+            foundMousepad = true;
+            //3000 ns falls in the 2048-4096 ns bucket
+            QVERIFY(line.endsWith(QStringLiteral("\t3.0/4.1")));
+        }
+        foundUnregistered |= (line == unregisteredPrefix);
+    }
+    QVERIFY(foundMousepad);
+    QVERIFY(foundUnregistered);
+
+    PacketMetrics::Histogram histogram;
+    QCOMPARE( histogram.percentileNs(0.5), Q_UINT64_C(0) );
+    for (int i = 0; i < 99; ++i) {
+        histogram.record(100);
+    }
+    histogram.record(1000000);
+    QCOMPARE( histogram.count(), Q_UINT64_C(100) );
+    QCOMPARE( histogram.percentileNs(0.5), Q_UINT64_C(128) );
+    QCOMPARE( histogram.percentileNs(1.0), Q_UINT64_C(1048576) );
+}
+
+void NetworkPacketTests::networkPacketUnserializeBenchmark()
+{
+    NetworkPacket np(QLatin1String(""));
+    QBENCHMARK {
+        NetworkPacket::unserialize(s_mousepadPacket, &np);
+    }
+}
+
+void NetworkPacketTests::networkPacketUnserializeLegacyBenchmark()
+{
+    NetworkPacket np(QLatin1String(""));
+    QBENCHMARK {
+        legacyUnserialize(s_mousepadPacket, &np);
+    }
+}
+
+void NetworkPacketTests::networkPacketSerializeTest_data()
+{
+    QTest::addColumn<QString>("type");
+    QTest::addColumn<QVariantMap>("body");
+    QTest::addColumn<qint64>("payloadSize");
+
+    QTest::newRow("empty") << QStringLiteral("kdeconnect.ping") << QVariantMap() << Q_INT64_C(0);
+    QTest::newRow("mousepad") << QStringLiteral("kdeconnect.mousepad.request")
+        << QVariantMap{{QStringLiteral("dx"), -3.5}, {QStringLiteral("dy"), 1}, {QStringLiteral("singleclick"), false}}
+        << Q_INT64_C(0);
+    QTest::newRow("escaping") << QStringLiteral("kdeconnect.notification")
+        << QVariantMap{{QStringLiteral("title"), QStringLiteral("\"Quoted\" \\ back\tslash\n")},
+                       {QStringLiteral("text"), QStringLiteral("H\u00e9llo \u4e16\u754c \U0001F600")},
+                       {QStringLiteral("k\u00ebys"), QVariant()}}
+        << Q_INT64_C(0);
+    QTest::newRow("nested") << QStringLiteral("kdeconnect.sms.messages")
+        << QVariantMap{{QStringLiteral("messages"), QVariantList{QVariantMap{{QStringLiteral("date"), Q_INT64_C(1559149580212)}, {QStringLiteral("read"), 1}}}},
+                       {QStringLiteral("addresses"), QStringList{QStringLiteral("+1 555"), QStringLiteral("555")}},
+                       {QStringLiteral("ratio"), 0.1}}
+        << Q_INT64_C(0);
+    QTest::newRow("payload") << QStringLiteral("kdeconnect.share.request")
+        << QVariantMap{{QStringLiteral("filename"), QStringLiteral("video.mkv")}}
+        << Q_INT64_C(5368709120);
+    QTest::newRow("stream") << QStringLiteral("kdeconnect.share.request")
+        << QVariantMap{{QStringLiteral("filename"), QStringLiteral("stream")}}
+        << Q_INT64_C(-1);
+}
+
+void NetworkPacketTests::networkPacketSerializeTest()
+{
+    QFETCH(QString, type);
+    QFETCH(QVariantMap, body);
+    QFETCH(qint64, payloadSize);
+
+    NetworkPacket np(type, body);
+    if (payloadSize != 0) {
+        np.setPayload(QSharedPointer<QIODevice>(new QBuffer()), payloadSize);
+        np.setPayloadTransferInfo({{QStringLiteral("port"), 1739}});
+    }
+
+    QCOMPARE(np.serialize(), legacySerialize(np));
+
+    //The buffer is reused, so serializing into a dirty one must give the same result
+    QByteArray buffer("garbage left over from a previous packet");
+    np.serialize(&buffer);
+    QCOMPARE(buffer, legacySerialize(np));
+}
+
+void NetworkPacketTests::networkPacketSerializeBenchmark()
+{
+    NetworkPacket np(QLatin1String(""));
+    NetworkPacket::unserialize(s_mousepadPacket, &np);
+    QByteArray buffer;
+    buffer.reserve(4096);
+    QBENCHMARK {
+        np.serialize(&buffer);
+    }
+}
+
+void NetworkPacketTests::networkPacketSerializeLegacyBenchmark()
+{
+    NetworkPacket np(QLatin1String(""));
+    NetworkPacket::unserialize(s_mousepadPacket, &np);
+    QBENCHMARK {
+        legacySerialize(np);
+    }
+}
+
 void NetworkPacketTests::cleanupTestCase()
 {
     // Called after the last testfunction was executed
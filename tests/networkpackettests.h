@@ -32,6 +32,15 @@ private Q_SLOTS:
 
     void networkPacketTest();
     void networkPacketIdentityTest();
+    void networkPacketPayloadTransferInfoTest();
+    void networkPacketTypeIdTest();
+    void networkPacketMetricsTest();
+    void networkPacketUnserializeBenchmark();
+    void networkPacketUnserializeLegacyBenchmark();
+    void networkPacketSerializeTest_data();
+    void networkPacketSerializeTest();
+    void networkPacketSerializeBenchmark();
+    void networkPacketSerializeLegacyBenchmark();
     //void networkPacketEncryptionTest();
 
     void cleanupTestCase();
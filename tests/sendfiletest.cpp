@@ -26,8 +26,14 @@
 #include <QNetworkAccessManager>
 #include <QTest>
 #include <QTemporaryFile>
+#include <QTemporaryDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QCryptographicHash>
 #include <QSignalSpy>
 #include <QStandardPaths>
+#include <QSet>
+#include <QSslSocket>
 
 #include <KIO/AccessManager>
 
@@ -39,6 +45,64 @@
 #include "testdaemon.h"
 #include <plugins/share/shareplugin.h>
 #include <backends/lan/compositeuploadjob.h>
+#include <backends/lan/lanlinkprovider.h>
+
+//Payload that hands out data as a resumable sender would, starting from the offset it is told
+class ResumableSource : public QIODevice
+{
+public:
+    ResumableSource(const QByteArray& data, qint64 available)
+        : m_data(data)
+        , m_available(available)
+        , m_readPos(0)
+        , resumeOffset(-1)
+    {
+        open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+    }
+
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override { return m_available - m_readPos + QIODevice::bytesAvailable(); }
+
+    const QByteArray m_data;
+    const qint64 m_available;
+    qint64 m_readPos;
+    qint64 resumeOffset;
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override
+    {
+        const qint64 bytesRead = qMin(maxSize, m_available - m_readPos);
+        memcpy(data, m_data.constData() + m_readPos, bytesRead);
+        m_readPos += bytesRead;
+        return bytesRead;
+    }
+
+    qint64 writeData(const char* data, qint64 maxSize) override
+    {
+        const QJsonObject reply = QJsonDocument::fromJson(QByteArray(data, maxSize)).object();
+        resumeOffset = reply.value(QStringLiteral("resumeOffset")).toInt();
+        m_readPos = resumeOffset;
+        return maxSize;
+    }
+};
+
+//Device that keeps the packets sent to it, instead of needing a link to send them through
+class CapturingDevice : public Device
+{
+public:
+    CapturingDevice(QObject* parent, const QString& id)
+        : Device(parent, id)
+    {
+    }
+
+    bool sendPacket(NetworkPacket& np) override
+    {
+        sentPackets.append(np);
+        return true;
+    }
+
+    QList<NetworkPacket> sentPackets;
+};
 
 class TestSendFile : public QObject
 {
@@ -151,6 +215,260 @@ class TestSendFile : public QObject
             QCOMPARE(resultFile.readAll(), originFile.readAll());
         }
 
+        void testParallelUploads()
+        {
+            const QString deviceId = KdeConnectConfig::instance()->deviceId();
+            KdeConnectConfig* kcc = KdeConnectConfig::instance();
+            kcc->addTrustedDevice(deviceId, QStringLiteral("testdevice"), kcc->deviceType());
+            kcc->setDeviceProperty(deviceId, QStringLiteral("certificate"), QString::fromLatin1(kcc->certificate().toPem()));
+
+            CapturingDevice* device = new CapturingDevice(this, deviceId);
+            m_daemon->addDevice(device);
+
+            const int numberOfFiles = 3;
+            QList<QByteArray> contents;
+            QList<QSharedPointer<QTemporaryFile>> files;
+            CompositeUploadJob* job = new CompositeUploadJob(deviceId, false);
+            job->setParallelUploads(numberOfFiles);
+            for (int i = 0; i < numberOfFiles; i++) {
+                contents.append(QByteArray(200000 * (i + 1), static_cast<char>('a' + i)));
+                QSharedPointer<QTemporaryFile> file(new QTemporaryFile);
+                QVERIFY(file->open());
+                file->write(contents.last());
+                file->close();
+                files.append(file);
+
+                NetworkPacket np(PACKET_TYPE_SHARE_REQUEST);
+                np.set<QString>(QStringLiteral("filename"), QString::number(i));
+                np.setPayload(QSharedPointer<QIODevice>(new QFile(file->fileName())), contents.last().size());
+                job->addSubjob(new UploadJob(np));
+            }
+
+            QSignalSpy spyUpload(job, &KJob::result);
+            job->start();
+
+            //Every file is announced on a port of its own before any of them is received
+            QTRY_COMPARE(device->sentPackets.size(), numberOfFiles);
+            QSet<int> ports;
+            for (const NetworkPacket& np : qAsConst(device->sentPackets)) {
+                QCOMPARE(np.type(), PACKET_TYPE_SHARE_REQUEST);
+                ports.insert(np.payloadTransferInfo().value(QStringLiteral("port")).toInt());
+            }
+            QCOMPARE(ports.size(), numberOfFiles);
+
+            //and they all go through at the same time
+            QList<QByteArray> received;
+            QList<QSharedPointer<QSslSocket>> sockets;
+            for (const NetworkPacket& np : qAsConst(device->sentPackets)) {
+                QSharedPointer<QSslSocket> socket(new QSslSocket);
+                LanLinkProvider::configureSslSocket(socket.data(), deviceId, true);
+                socket->connectToHostEncrypted(QStringLiteral("127.0.0.1"), np.payloadTransferInfo().value(QStringLiteral("port")).toInt());
+                sockets.append(socket);
+                received.append(QByteArray());
+            }
+            for (int i = 0; i < numberOfFiles; i++) {
+                connect(sockets.at(i).data(), &QIODevice::readyRead, this, [&received, &sockets, i] {
+                    received[i] += sockets.at(i)->readAll();
+                });
+            }
+
+            QVERIFY(spyUpload.count() || spyUpload.wait(10000));
+            QCOMPARE(job->error(), 0);
+            for (int i = 0; i < numberOfFiles; i++) {
+                const int file = device->sentPackets.at(i).get<QString>(QStringLiteral("filename")).toInt();
+                QTRY_COMPARE(received.at(i).size(), contents.at(file).size());
+                QCOMPARE(received.at(i), contents.at(file));
+            }
+
+            m_daemon->removeDevice(device);
+            kcc->removeTrustedDevice(deviceId);
+        }
+
+        void testResumeTransfer()
+        {
+            const QString destFile = QDir::tempPath() + QStringLiteral("/kdeconnect-test-resumedfile");
+            QFile::remove(destFile);
+
+            QByteArray content;
+            for (int i = 0; i < 100000; i++) {
+                content += QByteArray::number(i);
+            }
+            const qint64 interruptedAt = content.size() / 3;
+
+            //The first transfer is cut before the whole payload arrives
+            QSharedPointer<ResumableSource> firstSource(new ResumableSource(content, interruptedAt));
+            NetworkPacket np(PACKET_TYPE_SHARE_REQUEST);
+            np.set<qint64>(QStringLiteral("lastModified"), 42);
+            np.setPayload(firstSource, content.size());
+            np.setPayloadTransferInfo({{QStringLiteral("resumable"), true}});
+
+            FileTransferJob* firstJob = np.createPayloadTransferJob(QUrl::fromLocalFile(destFile));
+            QSignalSpy firstSpy(firstJob, &KJob::result);
+            firstJob->start();
+            QTRY_COMPARE(firstSource->resumeOffset, Q_INT64_C(0));
+            Q_EMIT firstSource->readChannelFinished();
+            QVERIFY(firstSpy.count() || firstSpy.wait());
+            QCOMPARE(firstJob->error(), 3);
+            QVERIFY(!QFile::exists(destFile));
+            QVERIFY(QFile::exists(destFile + QStringLiteral(".part")));
+            QVERIFY(QFile::exists(destFile + QStringLiteral(".part.resume")));
+
+            //Sending it again only transfers what is missing
+            QSharedPointer<ResumableSource> secondSource(new ResumableSource(content, content.size()));
+            np.setPayload(secondSource, content.size());
+
+            FileTransferJob* secondJob = np.createPayloadTransferJob(QUrl::fromLocalFile(destFile));
+            QSignalSpy secondSpy(secondJob, &KJob::result);
+            secondJob->start();
+            QVERIFY(secondSpy.count() || secondSpy.wait());
+            QCOMPARE(secondJob->error(), 0);
+            QCOMPARE(secondSource->resumeOffset, interruptedAt);
+
+            QVERIFY(!QFile::exists(destFile + QStringLiteral(".part")));
+            QVERIFY(!QFile::exists(destFile + QStringLiteral(".part.resume")));
+            QFile resultFile(destFile);
+            QVERIFY(resultFile.open(QIODevice::ReadOnly));
+            QCOMPARE(resultFile.readAll(), content);
+            resultFile.remove();
+        }
+
+        void testResumeOtherFile()
+        {
+            const QString destFile = QDir::tempPath() + QStringLiteral("/kdeconnect-test-replacedfile");
+            QFile::remove(destFile);
+
+            QByteArray oldContent, newContent;
+            for (int i = 0; i < 100000; i++) {
+                oldContent += QByteArray::number(i % 10);
+                newContent += QByteArray::number(9 - i % 10);
+            }
+            QCOMPARE(oldContent.size(), newContent.size());
+
+            //An older file with the same name and size is interrupted
+            QSharedPointer<ResumableSource> firstSource(new ResumableSource(oldContent, oldContent.size() / 2));
+            NetworkPacket np(PACKET_TYPE_SHARE_REQUEST);
+            np.set<qint64>(QStringLiteral("lastModified"), 42);
+            np.setPayload(firstSource, oldContent.size());
+            np.setPayloadTransferInfo({{QStringLiteral("resumable"), true}});
+
+            FileTransferJob* firstJob = np.createPayloadTransferJob(QUrl::fromLocalFile(destFile));
+            QSignalSpy firstSpy(firstJob, &KJob::result);
+            firstJob->start();
+            QTRY_COMPARE(firstSource->resumeOffset, Q_INT64_C(0));
+            Q_EMIT firstSource->readChannelFinished();
+            QVERIFY(firstSpy.count() || firstSpy.wait());
+            QVERIFY(QFile::exists(destFile + QStringLiteral(".part.resume")));
+
+            //The new one starts from the beginning
+            QSharedPointer<ResumableSource> secondSource(new ResumableSource(newContent, newContent.size()));
+            np.set<qint64>(QStringLiteral("lastModified"), 43);
+            np.setPayload(secondSource, newContent.size());
+
+            FileTransferJob* secondJob = np.createPayloadTransferJob(QUrl::fromLocalFile(destFile));
+            QSignalSpy secondSpy(secondJob, &KJob::result);
+            secondJob->start();
+            QVERIFY(secondSpy.count() || secondSpy.wait());
+            QCOMPARE(secondJob->error(), 0);
+            QCOMPARE(secondSource->resumeOffset, Q_INT64_C(0));
+
+            QFile resultFile(destFile);
+            QVERIFY(resultFile.open(QIODevice::ReadOnly));
+            QCOMPARE(resultFile.readAll(), newContent);
+            resultFile.remove();
+        }
+
+        void testResumeWithoutIdentity()
+        {
+            const QString destFile = QDir::tempPath() + QStringLiteral("/kdeconnect-test-anonymousfile");
+            QFile::remove(destFile);
+
+            const QByteArray content(100000, 'a');
+
+            //Without its modification time the sender's file can't be recognized later, so nothing is kept
+            QSharedPointer<ResumableSource> source(new ResumableSource(content, content.size() / 2));
+            NetworkPacket np(PACKET_TYPE_SHARE_REQUEST);
+            np.setPayload(source, content.size());
+            np.setPayloadTransferInfo({{QStringLiteral("resumable"), true}});
+
+            FileTransferJob* job = np.createPayloadTransferJob(QUrl::fromLocalFile(destFile));
+            QSignalSpy spy(job, &KJob::result);
+            job->start();
+            QTRY_COMPARE(source->resumeOffset, Q_INT64_C(0));
+            Q_EMIT source->readChannelFinished();
+            QVERIFY(spy.count() || spy.wait());
+            QCOMPARE(job->error(), 3);
+            QVERIFY(!QFile::exists(destFile + QStringLiteral(".part")));
+            QVERIFY(!QFile::exists(destFile + QStringLiteral(".part.resume")));
+        }
+
+        void testExpiredPartialFiles()
+        {
+            QTemporaryDir dir;
+            QVERIFY(dir.isValid());
+            const auto path = [&dir](const QString& name) {
+                return dir.path() + QLatin1Char('/') + name;
+            };
+            const auto createFile = [&path](const QString& name) {
+                QFile file(path(name));
+                return file.open(QIODevice::WriteOnly) && file.write("data") == 4;
+            };
+            QVERIFY(createFile(QStringLiteral("interrupted.part")));
+            QVERIFY(createFile(QStringLiteral("interrupted.part.resume")));
+            QVERIFY(createFile(QStringLiteral("running.part")));
+            QVERIFY(createFile(QStringLiteral("received")));
+
+            //Recent partial files can still be resumed
+            FileTransferJob::removeExpiredPartialFiles(dir.path(), 60 * 1000);
+            QVERIFY(QFile::exists(path(QStringLiteral("interrupted.part"))));
+            QVERIFY(QFile::exists(path(QStringLiteral("interrupted.part.resume"))));
+
+            //Expired ones are removed, leaving alone the transfers still running and the received files
+            FileTransferJob::removeExpiredPartialFiles(dir.path(), 0);
+            QVERIFY(!QFile::exists(path(QStringLiteral("interrupted.part"))));
+            QVERIFY(!QFile::exists(path(QStringLiteral("interrupted.part.resume"))));
+            QVERIFY(QFile::exists(path(QStringLiteral("running.part"))));
+            QVERIFY(QFile::exists(path(QStringLiteral("received"))));
+        }
+
+        void testTransferDigest()
+        {
+            const QString destFile = QDir::tempPath() + QStringLiteral("/kdeconnect-test-hashedfile");
+            QFile::remove(destFile);
+
+            const QByteArray content = QByteArray(100000, 'k');
+            const QByteArray digest = QCryptographicHash::hash(content, QCryptographicHash::Sha256).toHex();
+
+            NetworkPacket np(PACKET_TYPE_SHARE_REQUEST);
+            np.setPayloadTransferInfo({{QStringLiteral("digest"), QStringLiteral("sha256")}});
+
+            //A file that doesn't match the digest sent after it is discarded
+            np.setPayload(QSharedPointer<QIODevice>(new ResumableSource(content, content.size())), content.size());
+            FileTransferJob* corruptedJob = np.createPayloadTransferJob(QUrl::fromLocalFile(destFile));
+            QSignalSpy corruptedSpy(corruptedJob, &KJob::result);
+            corruptedJob->start();
+            QTest::qWait(100);
+            QCOMPARE(corruptedSpy.count(), 0);
+            corruptedJob->setExpectedDigest(QCryptographicHash::hash("something else", QCryptographicHash::Sha256).toHex());
+            QCOMPARE(corruptedSpy.count(), 1);
+            QCOMPARE(corruptedJob->error(), KJob::UserDefinedError + 1);
+            QVERIFY(!QFile::exists(destFile));
+            QVERIFY(!QFile::exists(destFile + QStringLiteral(".part")));
+
+            //The digest can also arrive before the data is complete
+            np.setPayload(QSharedPointer<QIODevice>(new ResumableSource(content, content.size())), content.size());
+            FileTransferJob* job = np.createPayloadTransferJob(QUrl::fromLocalFile(destFile));
+            QSignalSpy spy(job, &KJob::result);
+            job->setExpectedDigest(digest);
+            job->start();
+            QVERIFY(spy.count() || spy.wait());
+            QCOMPARE(job->error(), 0);
+
+            QFile resultFile(destFile);
+            QVERIFY(resultFile.open(QIODevice::ReadOnly));
+            QCOMPARE(resultFile.readAll(), content);
+            resultFile.remove();
+        }
+
     private:
         TestDaemon* m_daemon;
 };
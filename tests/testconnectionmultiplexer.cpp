@@ -0,0 +1,172 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../core/connectionmultiplexer.h"
+
+#include <QSignalSpy>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTest>
+#include <QtEndian>
+
+class TestConnectionMultiplexer : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void cleanup();
+    void defaultChannel();
+    void newChannel();
+    void closeChannel();
+    void writeBeyondCredit();
+    void tooManyUnclaimedChannels();
+
+private:
+    //A raw multiplexing message, as a misbehaving other end would write it
+    static QByteArray message(quint8 type, const QUuid& id, const QByteArray& data = QByteArray());
+
+    QTcpServer* m_server;
+    QTcpSocket* m_client;
+    QTcpSocket* m_serverSide;
+    ConnectionMultiplexer* m_clientMultiplexer;
+    ConnectionMultiplexer* m_serverMultiplexer;
+};
+
+void TestConnectionMultiplexer::init()
+{
+    m_server = new QTcpServer(this);
+    QVERIFY(m_server->listen(QHostAddress::LocalHost));
+
+    m_client = new QTcpSocket(this);
+    m_client->connectToHost(QHostAddress::LocalHost, m_server->serverPort());
+    QVERIFY(m_client->waitForConnected());
+    QVERIFY(m_server->waitForNewConnection(5000));
+    m_serverSide = m_server->nextPendingConnection();
+    QVERIFY(m_serverSide);
+
+    m_clientMultiplexer = new ConnectionMultiplexer(m_client, this);
+    m_serverMultiplexer = new ConnectionMultiplexer(m_serverSide, this);
+}
+
+void TestConnectionMultiplexer::cleanup()
+{
+    delete m_clientMultiplexer;
+    delete m_serverMultiplexer;
+    delete m_client;
+    delete m_server;
+}
+
+void TestConnectionMultiplexer::defaultChannel()
+{
+    MultiplexChannel* sender = m_clientMultiplexer->defaultChannel();
+    MultiplexChannel* receiver = m_serverMultiplexer->defaultChannel();
+    QVERIFY(sender->isOpen());
+    QCOMPARE(sender->id(), receiver->id());
+
+    sender->write("hello\n");
+    QTRY_VERIFY(receiver->canReadLine());
+    QCOMPARE(receiver->readLine(), QByteArray("hello\n"));
+
+    //Both directions work at the same time
+    receiver->write("world\n");
+    QTRY_VERIFY(sender->canReadLine());
+    QCOMPARE(sender->readLine(), QByteArray("world\n"));
+}
+
+void TestConnectionMultiplexer::newChannel()
+{
+    const QUuid id = m_clientMultiplexer->newChannel();
+    QScopedPointer<MultiplexChannel> sender(m_clientMultiplexer->takeChannel(id));
+    QVERIFY(sender);
+    QVERIFY(!m_clientMultiplexer->takeChannel(id));
+
+    //More than the window of a channel, so it has to wait to be asked for more
+    QByteArray data(1024 * 1024, Qt::Uninitialized);
+    for (int i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<char>(i % 251);
+    }
+    sender->write(data);
+
+    //The default channel is not held up by the data nobody reads yet
+    m_clientMultiplexer->defaultChannel()->write("packet\n");
+    QTRY_VERIFY(m_serverMultiplexer->defaultChannel()->canReadLine());
+    QCOMPARE(m_serverMultiplexer->defaultChannel()->readLine(), QByteArray("packet\n"));
+
+    QScopedPointer<MultiplexChannel> receiver(m_serverMultiplexer->takeChannel(id));
+    QVERIFY(receiver);
+    QByteArray received;
+    QTRY_VERIFY((received += receiver->readAll()).size() == data.size());
+    QCOMPARE(received, data);
+}
+
+void TestConnectionMultiplexer::closeChannel()
+{
+    const QUuid id = m_clientMultiplexer->newChannel();
+    MultiplexChannel* sender = m_clientMultiplexer->takeChannel(id);
+    sender->write("payload");
+    sender->close();
+    sender->deleteLater();
+
+    QScopedPointer<MultiplexChannel> receiver(m_serverMultiplexer->takeChannel(id));
+    QSignalSpy finished(receiver.data(), &QIODevice::readChannelFinished);
+    QTRY_COMPARE(finished.count(), 1);
+
+    //What was written before closing still arrives
+    QCOMPARE(receiver->readAll(), QByteArray("payload"));
+    QCOMPARE(receiver->read(1), QByteArray());
+    QVERIFY(receiver->write("late") < 0);
+}
+
+QByteArray TestConnectionMultiplexer::message(quint8 type, const QUuid& id, const QByteArray& data)
+{
+    QByteArray header(3, Qt::Uninitialized);
+    header[0] = static_cast<char>(type);
+    qToBigEndian(static_cast<quint16>(data.size()), reinterpret_cast<uchar*>(header.data() + 1));
+    return header + id.toRfc4122() + data;
+}
+
+void TestConnectionMultiplexer::writeBeyondCredit()
+{
+    //Data for a channel the server never asked anything for
+    const QUuid id = QUuid::createUuid();
+    m_client->write(message(1, id));
+    m_client->write(message(4, id, QByteArray(1000, 'x')));
+
+    QTRY_VERIFY(!m_serverSide->isOpen());
+}
+
+void TestConnectionMultiplexer::tooManyUnclaimedChannels()
+{
+    for (int i = 0; i < 64; ++i) {
+        m_client->write(message(1, QUuid::createUuid()));
+    }
+    m_client->flush();
+    QTest::qWait(100);
+    QVERIFY(m_serverSide->isOpen());
+
+    //Opening channels nobody takes can't grow the other end's memory without a limit
+    m_client->write(message(1, QUuid::createUuid()));
+    QTRY_VERIFY(!m_serverSide->isOpen());
+}
+
+QTEST_GUILESS_MAIN(TestConnectionMultiplexer)
+
+#include "testconnectionmultiplexer.moc"
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "smsapp/conversationlistmodel.h"
+
+#include <QSignalSpy>
+#include <QtTest>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+#include <QAbstractItemModelTester>
+#endif
+
+/**
+ * This class tests that ConversationListModel keeps one row per conversation, newest first
+ */
+class ConversationListModelTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void cleanup();
+    void bulkLoad();
+    void newConversation();
+    void updateMovesUp();
+    void olderMessage();
+
+private:
+    static ConversationMessage message(qint64 threadId, qint64 date, const QString& body);
+    QList<qint64> threadIds() const;
+
+    ConversationListModel* m_model = nullptr;
+};
+
+ConversationMessage ConversationListModelTest::message(qint64 threadId, qint64 date, const QString& body)
+{
+    return ConversationMessage(ConversationMessage::EventTextMessage, body, QStringLiteral("+1 (222) 333-%1").arg(threadId),
+                               date, ConversationMessage::MessageTypeInbox, 1, threadId, static_cast<qint32>(date));
+}
+
+QList<qint64> ConversationListModelTest::threadIds() const
+{
+    QList<qint64> ids;
+    for (int row = 0; row < m_model->rowCount(); ++row) {
+        ids.append(m_model->data(m_model->index(row), ConversationListModel::ConversationIdRole).toLongLong());
+    }
+    return ids;
+}
+
+void ConversationListModelTest::init()
+{
+    m_model = new ConversationListModel(this);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+    new QAbstractItemModelTester(m_model, QAbstractItemModelTester::FailureReportingMode::QtTest, m_model);
+#endif
+
+    // Conversations 1 and 2 appear twice, the newest message of each wins
+    m_model->setConversations({
+        message(1, 100, QStringLiteral("old")),
+        message(2, 300, QStringLiteral("two")),
+        message(1, 400, QStringLiteral("new")),
+        message(3, 200, QStringLiteral("three")),
+        message(2, 250, QStringLiteral("older")),
+    });
+}
+
+void ConversationListModelTest::cleanup()
+{
+    delete m_model;
+    m_model = nullptr;
+}
+
+void ConversationListModelTest::bulkLoad()
+{
+    QCOMPARE(threadIds(), QList<qint64>({1, 2, 3}));
+    QCOMPARE(m_model->data(m_model->index(0), Qt::ToolTipRole).toString(), QStringLiteral("new"));
+    QCOMPARE(m_model->data(m_model->index(0), ConversationListModel::DateRole).toLongLong(), Q_INT64_C(400));
+    QCOMPARE(m_model->data(m_model->index(1), Qt::ToolTipRole).toString(), QStringLiteral("two"));
+    QCOMPARE(m_model->data(m_model->index(2), ConversationListModel::AddressRole).toString(), QStringLiteral("+1 (222) 333-3"));
+
+    // Loading again replaces the rows
+    QSignalSpy removed(m_model, &QAbstractItemModel::rowsRemoved);
+    m_model->setConversations({message(4, 100, QStringLiteral("four"))});
+    QCOMPARE(removed.count(), 1);
+    QCOMPARE(threadIds(), QList<qint64>({4}));
+}
+
+void ConversationListModelTest::newConversation()
+{
+    QSignalSpy inserted(m_model, &QAbstractItemModel::rowsInserted);
+    m_model->createRowFromMessage(message(4, 350, QStringLiteral("four")).toVariant());
+
+    QCOMPARE(inserted.count(), 1);
+    QCOMPARE(inserted.first().at(1).toInt(), 1);
+    QCOMPARE(inserted.first().at(2).toInt(), 1);
+    QCOMPARE(threadIds(), QList<qint64>({1, 4, 2, 3}));
+    QCOMPARE(m_model->data(m_model->index(1), Qt::ToolTipRole).toString(), QStringLiteral("four"));
+}
+
+void ConversationListModelTest::updateMovesUp()
+{
+    QSignalSpy moved(m_model, &QAbstractItemModel::rowsMoved);
+    QSignalSpy changed(m_model, &QAbstractItemModel::dataChanged);
+    m_model->createRowFromMessage(message(3, 500, QStringLiteral("newest")).toVariant());
+
+    QCOMPARE(moved.count(), 1);
+    QCOMPARE(threadIds(), QList<qint64>({3, 1, 2}));
+    QCOMPARE(changed.count(), 1);
+    QCOMPARE(changed.first().at(0).toModelIndex().row(), 0);
+    QCOMPARE(m_model->data(m_model->index(0), Qt::ToolTipRole).toString(), QStringLiteral("newest"));
+
+    // A newer message which doesn't pass another conversation stays in place
+    m_model->createRowFromMessage(message(2, 350, QStringLiteral("still second")).toVariant());
+    QCOMPARE(moved.count(), 1);
+    QCOMPARE(threadIds(), QList<qint64>({3, 1, 2}));
+    QCOMPARE(m_model->data(m_model->index(2), Qt::ToolTipRole).toString(), QStringLiteral("still second"));
+}
+
+void ConversationListModelTest::olderMessage()
+{
+    // Loading the history of a conversation doesn't change its row
+    QSignalSpy changed(m_model, &QAbstractItemModel::dataChanged);
+    m_model->createRowFromMessage(message(1, 50, QStringLiteral("history")).toVariant());
+
+    QCOMPARE(changed.count(), 0);
+    QCOMPARE(threadIds(), QList<qint64>({1, 2, 3}));
+    QCOMPARE(m_model->data(m_model->index(0), Qt::ToolTipRole).toString(), QStringLiteral("new"));
+}
+
+QTEST_MAIN(ConversationListModelTest);
+#include "testconversationlistmodel.moc"
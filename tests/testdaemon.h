@@ -40,6 +40,10 @@ public:
         Daemon::addDevice(device);
     }
 
+    void removeDevice(Device* device) {
+        Daemon::removeDevice(device);
+    }
+
     void reportError(const QString & title, const QString & description) override
     {
         qWarning() << "error:" << title << description;
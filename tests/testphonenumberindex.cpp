@@ -0,0 +1,150 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "phonenumberindex.h"
+
+#include <QtTest>
+
+/**
+ * This class tests that PhoneNumberIndex finds the same matches as SmsHelper::isPhoneNumberMatch
+ */
+class PhoneNumberIndexTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void testExactMatch();
+    void testMissingCountryCode();
+    void testShorterContactNumber();
+    void testShortCodes();
+    void testPreferExactMatch();
+    void testRemove();
+    void testRemoveMany();
+    void benchmarkLookup();
+
+private:
+    PhoneNumberIndex m_index;
+};
+
+void PhoneNumberIndexTest::init()
+{
+    m_index.clear();
+    m_index.insert(QStringLiteral("+1 (222) 333-4444"), QStringLiteral("alice"));
+    m_index.insert(QStringLiteral("+1 (555) 666-7777"), QStringLiteral("bob"));
+    m_index.insert(QStringLiteral("12345"), QStringLiteral("shortcode"));
+}
+
+void PhoneNumberIndexTest::testExactMatch()
+{
+    QCOMPARE(m_index.lookup(QStringLiteral("12223334444")), QStringLiteral("alice"));
+    QCOMPARE(m_index.lookup(QStringLiteral("001 (555) 666-7777")), QStringLiteral("bob"));
+    QCOMPARE(m_index.lookup(QStringLiteral("12345")), QStringLiteral("shortcode"));
+    QVERIFY(m_index.lookup(QStringLiteral("+1 (999) 333-4444")).isEmpty());
+    QVERIFY(m_index.lookup(QString()).isEmpty());
+}
+
+/**
+ * The address of the message is shorter than the number in the contact book
+ */
+void PhoneNumberIndexTest::testMissingCountryCode()
+{
+    QCOMPARE(m_index.lookup(QStringLiteral("(222) 333-4444")), QStringLiteral("alice"));
+    QCOMPARE(m_index.lookup(QStringLiteral("333-4444")), QStringLiteral("alice"));
+}
+
+/**
+ * The number in the contact book is shorter than the address of the message
+ */
+void PhoneNumberIndexTest::testShorterContactNumber()
+{
+    m_index.insert(QStringLiteral("888-9999"), QStringLiteral("carol"));
+    QCOMPARE(m_index.lookup(QStringLiteral("+1 (222) 888-9999")), QStringLiteral("carol"));
+}
+
+void PhoneNumberIndexTest::testShortCodes()
+{
+    // A short code must not match the end of a longer number, in either direction
+    QVERIFY(m_index.lookup(QStringLiteral("4444")).isEmpty());
+    m_index.insert(QStringLiteral("7777"), QStringLiteral("shortcode2"));
+    QCOMPARE(m_index.lookup(QStringLiteral("+1 (555) 666-7777")), QStringLiteral("bob"));
+    QCOMPARE(m_index.lookup(QStringLiteral("7777")), QStringLiteral("shortcode2"));
+}
+
+void PhoneNumberIndexTest::testPreferExactMatch()
+{
+    m_index.insert(QStringLiteral("333-4444"), QStringLiteral("dave"));
+    QCOMPARE(m_index.lookup(QStringLiteral("333-4444")), QStringLiteral("dave"));
+    QCOMPARE(m_index.lookup(QStringLiteral("+1 (222) 333-4444")), QStringLiteral("alice"));
+    // The longest number the address ends with is the most specific
+    QCOMPARE(m_index.lookup(QStringLiteral("+44 1 (222) 333-4444")), QStringLiteral("alice"));
+}
+
+void PhoneNumberIndexTest::testRemove()
+{
+    m_index.insert(QStringLiteral("+1 (222) 000-1111"), QStringLiteral("alice"));
+    QCOMPARE(m_index.count(), 4);
+    m_index.remove(QStringLiteral("alice"));
+    QCOMPARE(m_index.count(), 2);
+    QVERIFY(m_index.lookup(QStringLiteral("+1 (222) 333-4444")).isEmpty());
+    QVERIFY(m_index.lookup(QStringLiteral("+1 (222) 000-1111")).isEmpty());
+    QCOMPARE(m_index.lookup(QStringLiteral("+1 (555) 666-7777")), QStringLiteral("bob"));
+}
+
+/**
+ * Contacts changing again and again, enough for the removed numbers to be dropped from the index
+ */
+void PhoneNumberIndexTest::testRemoveMany()
+{
+    for (int round = 0; round < 5; ++round) {
+        for (int i = 0; i < 100; ++i) {
+            m_index.insert(QStringLiteral("+1 (333) 444-%1").arg(1000 + i), QStringLiteral("person%1").arg(i));
+        }
+        QCOMPARE(m_index.count(), 103);
+        for (int i = round % 2; i < 100; i += 2) {
+            m_index.remove(QStringLiteral("person%1").arg(i));
+        }
+        QCOMPARE(m_index.count(), 53);
+        QCOMPARE(m_index.lookup(QStringLiteral("+1 (333) 444-%1").arg(1000 + (round + 1) % 2)), QStringLiteral("person%1").arg((round + 1) % 2));
+        QVERIFY(m_index.lookup(QStringLiteral("+1 (333) 444-%1").arg(1000 + round % 2)).isEmpty());
+        QCOMPARE(m_index.lookup(QStringLiteral("+1 (222) 333-4444")), QStringLiteral("alice"));
+        QCOMPARE(m_index.lookup(QStringLiteral("12345")), QStringLiteral("shortcode"));
+
+        for (int i = 0; i < 100; ++i) {
+            m_index.remove(QStringLiteral("person%1").arg(i));
+        }
+        QCOMPARE(m_index.count(), 3);
+        QVERIFY(m_index.lookup(QStringLiteral("+1 (333) 444-1001")).isEmpty());
+    }
+    QCOMPARE(m_index.lookup(QStringLiteral("(555) 666-7777")), QStringLiteral("bob"));
+}
+
+void PhoneNumberIndexTest::benchmarkLookup()
+{
+    for (int i = 0; i < 10000; ++i) {
+        m_index.insert(QStringLiteral("+1 (%1) 555-%2").arg(200 + i / 100).arg(1000 + i % 100), QStringLiteral("person%1").arg(i));
+    }
+    QBENCHMARK {
+        QCOMPARE(m_index.lookup(QStringLiteral("(299) 555-1099")), QStringLiteral("person9999"));
+    }
+}
+
+QTEST_MAIN(PhoneNumberIndexTest);
+#include "testphonenumberindex.moc"
@@ -0,0 +1,230 @@
+/*
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../plugins/sms/smsstore.h"
+
+#include <QTemporaryDir>
+#include <QtTest>
+
+#include <limits>
+
+/*
+ * This class tests that messages written to the store are found again after reopening it
+ */
+class SmsStoreTest : public QObject
+{
+Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void appendAndReopen();
+    void truncatedRecord();
+    void unknownFormat();
+    void readFlagChanges();
+    void compaction();
+    void privateFile();
+
+private:
+    static ConversationMessage message(qint64 threadId, qint64 date, qint32 uID, qint32 read = 1);
+
+    QScopedPointer<QTemporaryDir> m_dir;
+    QString m_path;
+};
+
+ConversationMessage SmsStoreTest::message(qint64 threadId, qint64 date, qint32 uID, qint32 read)
+{
+    return ConversationMessage(ConversationMessage::EventTextMessage, QStringLiteral("message %1").arg(uID),
+                               QStringLiteral("+1 (222) 333-4444"), date, ConversationMessage::MessageTypeInbox,
+                               read, threadId, uID);
+}
+
+void SmsStoreTest::init()
+{
+    m_dir.reset(new QTemporaryDir);
+    m_path = m_dir->filePath(QStringLiteral("sms/messages.log"));
+}
+
+void SmsStoreTest::appendAndReopen()
+{
+    {
+        SmsStore store(m_path);
+        QVERIFY(store.threadIds().isEmpty());
+        store.append({message(1, 300, 3), message(1, 100, 1), message(2, 200, 2)});
+        store.append({message(1, 200, 4)});
+        QVERIFY(store.contains(1, 4));
+    }
+
+    SmsStore store(m_path);
+    QCOMPARE(store.threadIds().size(), 2);
+    QVERIFY(store.contains(1, 1));
+    QVERIFY(store.contains(2, 2));
+    QVERIFY(!store.contains(2, 1));
+    QCOMPARE(store.messageCount(1), 3);
+
+    const ConversationMessage latest = store.latestMessage(1);
+    QCOMPARE(latest.uID(), 3);
+    QCOMPARE(latest.date(), Q_INT64_C(300));
+    QCOMPARE(latest.body(), QStringLiteral("message 3"));
+    QCOMPARE(latest.address(), QStringLiteral("+1 (222) 333-4444"));
+    QCOMPARE(latest.type(), qint32(ConversationMessage::MessageTypeInbox));
+    QCOMPARE(latest.read(), 1);
+    QVERIFY(latest.containsTextBody());
+
+    const QList<ConversationMessage> conversation = store.conversation(1);
+    QCOMPARE(conversation.size(), 3);
+    QCOMPARE(conversation[0].uID(), 1);
+    QCOMPARE(conversation[1].uID(), 4);
+    QCOMPARE(conversation[2].uID(), 3);
+
+    QVERIFY(store.conversation(3).isEmpty());
+
+    // Windows are read backwards from a date
+    const QList<ConversationMessage> newest = store.conversation(1, std::numeric_limits<qint64>::max(), 2);
+    QCOMPARE(newest.size(), 2);
+    QCOMPARE(newest[0].uID(), 4);
+    QCOMPARE(newest[1].uID(), 3);
+    const QList<ConversationMessage> older = store.conversation(1, newest[0].date(), 2);
+    QCOMPARE(older.size(), 1);
+    QCOMPARE(older[0].uID(), 1);
+    QVERIFY(store.conversation(1, 100, 2).isEmpty());
+}
+
+void SmsStoreTest::truncatedRecord()
+{
+    qint64 completeSize;
+    {
+        SmsStore store(m_path);
+        store.append({message(1, 100, 1)});
+        completeSize = QFileInfo(m_path).size();
+        store.append({message(1, 200, 2)});
+    }
+
+    // Cut the last record short, as if the daemon had been killed while writing it
+    QFile file(m_path);
+    QVERIFY(file.resize(QFileInfo(m_path).size() - 3));
+
+    {
+        SmsStore store(m_path);
+        QVERIFY(store.contains(1, 1));
+        QVERIFY(!store.contains(1, 2));
+        QCOMPARE(QFileInfo(m_path).size(), completeSize);
+
+        store.append({message(1, 300, 3)});
+    }
+
+    SmsStore store(m_path);
+    QCOMPARE(store.messageCount(1), 2);
+    QCOMPARE(store.latestMessage(1).uID(), 3);
+}
+
+void SmsStoreTest::unknownFormat()
+{
+    QDir().mkpath(QFileInfo(m_path).absolutePath());
+    QFile file(m_path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("not a message store");
+    file.close();
+
+    SmsStore store(m_path);
+    QVERIFY(store.threadIds().isEmpty());
+    store.append({message(1, 100, 1)});
+    QCOMPARE(store.latestMessage(1).uID(), 1);
+}
+
+void SmsStoreTest::readFlagChanges()
+{
+    {
+        SmsStore store(m_path);
+        store.append({message(1, 100, 1, 0), message(1, 200, 2, 0)});
+        QVERIFY(store.contains(message(1, 100, 1, 0)));
+        QVERIFY(!store.contains(message(1, 100, 1, 1)));
+        QCOMPARE(store.latestDate(1), Q_INT64_C(200));
+        QCOMPARE(store.latestDate(2), Q_INT64_C(-1));
+
+        store.append({message(1, 100, 1, 1)});
+        QVERIFY(store.contains(message(1, 100, 1, 1)));
+    }
+
+    // The newest record of a message is the one which counts
+    SmsStore store(m_path);
+    QVERIFY(store.contains(message(1, 100, 1, 1)));
+    QVERIFY(store.contains(message(1, 200, 2, 0)));
+    QCOMPARE(store.messageCount(1), 2);
+    const QList<ConversationMessage> conversation = store.conversation(1);
+    QCOMPARE(conversation[0].read(), 1);
+    QCOMPARE(conversation[1].read(), 0);
+}
+
+void SmsStoreTest::compaction()
+{
+    const int messages = 1000;
+    qint64 grownSize = 0;
+    {
+        SmsStore store(m_path);
+        QList<ConversationMessage> unread, read;
+        for (int i = 0; i < messages; i++) {
+            unread.append(message(1 + i % 2, 100 + i, i, 0));
+            read.append(message(1 + i % 2, 100 + i, i, 1));
+        }
+        // Marked read, unread and read again
+        store.append(unread);
+        store.append(read);
+        store.append(unread);
+        store.append(read);
+        store.append({message(3, 50, messages, 0)});
+        grownSize = QFileInfo(m_path).size();
+    }
+
+    // Most records are outdated, opening the store drops them
+    {
+        SmsStore store(m_path);
+        QVERIFY(QFileInfo(m_path).size() < grownSize / 2);
+        QCOMPARE(store.messageCount(1), messages / 2);
+        QCOMPARE(store.messageCount(2), messages / 2);
+        QVERIFY(store.contains(message(1, 100, 0, 1)));
+        QVERIFY(store.contains(message(3, 50, messages, 0)));
+        QCOMPARE(QFileInfo(m_path).permissions() & (QFile::ReadGroup | QFile::WriteGroup | QFile::ReadOther | QFile::WriteOther),
+                 QFile::Permissions());
+
+        // Still usable after being rewritten
+        store.append({message(3, 60, messages + 1, 0)});
+        QCOMPARE(store.latestMessage(3).uID(), messages + 1);
+    }
+
+    SmsStore store(m_path);
+    QCOMPARE(store.messageCount(1), messages / 2);
+    QCOMPARE(store.messageCount(3), 2);
+    const QList<ConversationMessage> conversation = store.conversation(2);
+    QCOMPARE(conversation.size(), messages / 2);
+    QCOMPARE(conversation.first().uID(), 1);
+    QCOMPARE(conversation.first().read(), 1);
+    QCOMPARE(conversation.last().body(), QStringLiteral("message %1").arg(messages - 1));
+}
+
+void SmsStoreTest::privateFile()
+{
+    SmsStore store(m_path);
+    store.append({message(1, 100, 1)});
+    QCOMPARE(QFileInfo(m_path).permissions() & (QFile::ReadGroup | QFile::WriteGroup | QFile::ReadOther | QFile::WriteOther),
+             QFile::Permissions());
+}
+
+QTEST_GUILESS_MAIN(SmsStoreTest);
+#include "testsmsstore.moc"
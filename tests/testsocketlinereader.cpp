@@ -34,6 +34,7 @@ public Q_SLOTS:
 
 private Q_SLOTS:
     void socketLineReader();
+    void partialLines();
 
 private:
     QTimer m_timer;
@@ -46,6 +47,7 @@ private:
 
 void TestSocketLineReader::initTestCase()
 {
+    m_reader = nullptr;
     m_server = new Server(this);
 
     QVERIFY2(m_server->listen(QHostAddress::LocalHost, 8694), "Failed to create local tcp server");
@@ -96,6 +98,33 @@ void TestSocketLineReader::socketLineReader()
     }
 }
 
+void TestSocketLineReader::partialLines()
+{
+    QVERIFY(m_reader);
+
+    //Every write is flushed on its own, so it arrives in a separate segment (or TLS record, on
+    //an encrypted socket) and lines reach the reader split at arbitrary points. The long line
+    //is bigger than anything received so far, so the reader also has to grow its buffer.
+    const QByteArray longLine = QByteArray(200000, 'x') + '\n';
+    QList<QByteArray> fragments;
+    fragments << "foo" << "bar\nbar" << "foo\n\npan" << "da\n"
+              << longLine.left(70000) << longLine.mid(70000, 70000) << longLine.mid(140000) + "last\n";
+
+    m_packets.clear();
+    for (const QByteArray& fragment : qAsConst(fragments)) {
+        m_conn->write(fragment);
+        m_conn->flush();
+        QTest::qWait(50);
+    }
+
+    QTRY_COMPARE(m_packets.count(), 5);
+    QCOMPARE(m_packets[0], QByteArray("foobar\n"));
+    QCOMPARE(m_packets[1], QByteArray("barfoo\n"));
+    QCOMPARE(m_packets[2], QByteArray("panda\n"));
+    QCOMPARE(m_packets[3], longLine);
+    QCOMPARE(m_packets[4], QByteArray("last\n"));
+}
+
 void TestSocketLineReader::newPacket()
 {
     if (!m_reader->bytesAvailable()) {
@@ -20,6 +20,7 @@
 
 #include "../core/backends/lan/server.h"
 #include "../core/backends/lan/socketlinereader.h"
+#include "../core/backends/lan/tlssessioncache.h"
 
 #include <QSslKey>
 #include <QtCrypto>
@@ -47,6 +48,7 @@ private Q_SLOTS:
     void testTrustedDevice();
     void testUntrustedDevice();
     void testTrustedDeviceWithWrongCertificate();
+    void testFragmentedRecords();
 
 
 private:
@@ -126,6 +128,11 @@ void TestSslSocketLineReader::testTrustedDevice()
     m_clientSocket->setPeerVerifyMode(QSslSocket::VerifyPeer);
     m_clientSocket->addCaCertificate(serverSocket->localCertificate());
 
+    TlsSessionCache* sessionCache = TlsSessionCache::instance();
+    const quint64 handshakes = sessionCache->fullHandshakes() + sessionCache->resumedHandshakes();
+    sessionCache->attach(serverSocket, QStringLiteral("Test Client"));
+    sessionCache->attach(m_clientSocket, QStringLiteral("Test Server"));
+
     int connected_sockets = 0;
     auto connected_lambda = [&](){
         connected_sockets++;
@@ -139,6 +146,9 @@ void TestSslSocketLineReader::testTrustedDevice()
     m_clientSocket->startClientEncryption();
     m_loop.exec(); //Block until QEventLoop::quit gets called by the lambda
 
+    //Both ends of the handshake are counted
+    QCOMPARE(sessionCache->fullHandshakes() + sessionCache->resumedHandshakes(), handshakes + 2);
+
     // Both client and server socket should be encrypted here and should have remote certificate because VerifyPeer is used
     QVERIFY2(m_clientSocket->isOpen(), "Client socket already closed");
     QVERIFY2(serverSocket->isOpen(), "Server socket already closed");
@@ -281,6 +291,72 @@ void TestSslSocketLineReader::testTrustedDeviceWithWrongCertificate()
 
 }
 
+void TestSslSocketLineReader::testFragmentedRecords()
+{
+    int maxAttemps = 5;
+    while(!m_server->hasPendingConnections() && maxAttemps > 0) {
+        --maxAttemps;
+        QTest::qSleep(1000);
+    }
+    QCOMPARE(true, m_server->hasPendingConnections());
+
+    QSslSocket* serverSocket = m_server->nextPendingConnection();
+    QVERIFY2(serverSocket != 0, "Null socket returned by server");
+
+    setSocketAttributes(serverSocket, QStringLiteral("Test Server"));
+    setSocketAttributes(m_clientSocket, QStringLiteral("Test Client"));
+    serverSocket->setPeerVerifyMode(QSslSocket::QueryPeer);
+    m_clientSocket->setPeerVerifyMode(QSslSocket::QueryPeer);
+
+    int connected_sockets = 0;
+    auto connected_lambda = [&](){
+        connected_sockets++;
+        if (connected_sockets >= 2) {
+            m_loop.quit();
+        }
+    };
+    connect(serverSocket, &QSslSocket::encrypted, connected_lambda);
+    connect(m_clientSocket, &QSslSocket::encrypted, connected_lambda);
+    serverSocket->startServerEncryption();
+    m_clientSocket->startClientEncryption();
+    m_loop.exec(); //Block until QEventLoop::quit gets called by the lambda
+    QVERIFY2(serverSocket->isEncrypted(), "Server is not encrypted");
+
+    QList<QByteArray> lines;
+    m_reader = new SocketLineReader(serverSocket, this);
+    connect(m_reader, &SocketLineReader::readyRead, this, [&]() {
+        while (m_reader->bytesAvailable() > 0) {
+            lines.append(m_reader->readLine());
+        }
+        if (lines.size() >= 2) {
+            m_loop.quit();
+        }
+    });
+
+    // Every write is flushed on its own and the server reads it before the next one, so it
+    // goes in its own TLS record and the reader gets the lines cut at the record boundaries
+    const QByteArray first = "{\"id\":1,\"type\":\"kdeconnect.ping\",\"body\":{}}\n";
+    const QByteArray second = "{\"id\":2,\"type\":\"kdeconnect.ping\",\"body\":{\"message\":\"hi\"}}\n";
+    const QByteArray data = first + second;
+    const QList<int> cuts = {1, 10, first.size() - 1, first.size() + 3, data.size() - 1, data.size()};
+    int written = 0;
+    for (int cut : cuts) {
+        m_clientSocket->write(data.mid(written, cut - written));
+        m_clientSocket->flush();
+        QTest::qWait(50);
+        written = cut;
+    }
+    if (lines.size() < 2) {
+        m_loop.exec();
+    }
+
+    QCOMPARE(lines.size(), 2);
+    QCOMPARE(lines[0], first);
+    QCOMPARE(lines[1], second);
+
+    delete m_reader;
+}
+
 void TestSslSocketLineReader::newPacket()
 {
     if (!m_reader->bytesAvailable()) {